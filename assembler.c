@@ -1,24 +1,37 @@
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "src/utils.h"
 #include "src/tables.h"
+#include "src/mnemonics.h"
 #include "src/translate_utils.h"
+#include "src/reader.h"
+#include "src/object.h"
+#include "src/state.h"
+#include "src/stats.h"
+#include "src/trace.h"
+#include "src/pool.h"
 #include "src/translate.h"
+#include "src/sim.h"
 #include "assembler.h"
+#include "mipsasm.h"
+#include "server.h"
 
 const int MAX_ARGS = 3;
-const int BUF_SIZE = 1024;
-const char* IGNORE_CHARS = " \f\n\r\t\v,()";
 
 /*******************************
  * Helper Functions
  *******************************/
 
 /* You should not be calling this function yourself. */
-static void raise_label_error(uint32_t input_line, const char* label) {
-    write_to_log("Error - invalid label at line %d: %s\n", input_line, label);
+static void raise_label_error(uint32_t input_line, Slice label) {
+    write_to_log("Error - invalid label at line %d: %.*s\n", input_line,
+        (int) label.len, label.ptr);
 }
 
 /* Call this function if more than MAX_ARGS arguments are found while parsing
@@ -46,64 +59,227 @@ static void raise_inst_error(uint32_t input_line, const char* name, char** args,
     log_inst(name, args, num_args);
 }
 
-/* Truncates the string at the first occurrence of the '#' character. */
-static void skip_comment(char* str) {
-    char* comment_start = strchr(str, '#');
-    if (comment_start) {
-        *comment_start = '\0';
+/* Reads STR and determines whether it is a label (ends in ':'), and if so,
+   whether it is a valid label. The label, without its ':', is stored in LABEL.
+
+   Three scenarios can happen:
+    1. STR is not a label (does not end in ':'). Returns 0.
+    2. STR ends in ':', but is not a valid label. Returns -1.
+    3. STR ends in ':' and is a valid label. Returns 1.
+ */
+static int read_label(Slice str, Slice* label) {
+    if (str.ptr[str.len - 1] != ':') {
+        return 0;
     }
+    label->ptr = str.ptr;
+    label->len = str.len - 1;
+    return is_valid_label_n(label->ptr, label->len) ? 1 : -1;
 }
 
-/* Reads STR and determines whether it is a label (ends in ':'), and if so,
-   whether it is a valid label, and then tries to add it to the symbol table.
+/* Counts in STATS, which may be NULL, that the instruction described by DESC
+   was expanded into N instructions.
+ */
+static void count_expansion(AsmStats* stats, const InstDesc* desc, int n) {
+  if (!stats || !desc) return;
 
-   INPUT_LINE is which line of the input file we are currently processing. Note
-   that the first line is line 1 and that empty lines are included in this count.
+  if (desc->id == INST_LI) {
+    if (n == 1) stats->li_short += 1;
+    if (n == 2) stats->li_long += 1;
+  } else if (desc->id == INST_BLT && n == 2) {
+    stats->blt += 1;
+  }
+}
 
-   BYTE_OFFSET is the offset of the NEXT instruction (should it exist). 
+/* Most arguments read from a line of the intermediate file. */
+#define MAX_LINE_ARGS 50
 
-   Four scenarios can happen:
-    1. STR is not a label (does not end in ':'). Returns 0.
-    2. STR ends in ':', but is not a valid label. Returns -1.
-    3a. STR ends in ':' and is a valid label. Addition to symbol table fails.
-        Returns -1.
-    3b. STR ends in ':' and is a valid label. Addition to symbol table succeeds.
-        Returns 1.
+/* The tokens of one line, copied out of the input and NUL-terminated so that
+   they can be handed to the instruction parser.
  */
-static int add_if_label(uint32_t input_line, char* str, uint32_t byte_offset,
-    SymbolTable* symtbl) {
-    
-    size_t len = strlen(str);
-    if (str[len - 1] == ':') {
-        str[len - 1] = '\0';
-        if (is_valid_label(str)) {
-            if (add_to_table(symtbl, str, byte_offset) == 0) {
-                return 1;
-            } else {
-                return -1;
-            }
-        } else {
-            raise_label_error(input_line, str);
-            return -1;
-        }
-    } else {
-        return 0;
+typedef struct {
+    char* buf;
+    size_t cap;
+    Slice label;            // label at the start of the line; empty if there is none
+    char* name;
+    char* args[MAX_LINE_ARGS];
+    int num_args;
+} LineTokens;
+
+static void free_tokens(LineTokens* toks) {
+    free(toks->buf);
+}
+
+/* Makes room in TOKS for tokens taking up to LEN bytes. */
+static void reserve_tokens(LineTokens* toks, size_t len) {
+    if (toks->cap < len) {
+      toks->cap = 2 * len;
+      free(toks->buf);
+      toks->buf = (char*) malloc(toks->cap);
+      if (toks->buf == NULL) allocation_failed();
+    }
+}
+
+/* Copies TOK into the buffer of TOKS at offset *USED. */
+static char* copy_token(LineTokens* toks, size_t* used, Slice tok) {
+    char* copy = toks->buf + *used;
+    memcpy(copy, tok.ptr, tok.len);
+    copy[tok.len] = '\0';
+    *used += tok.len + 1;
+    return copy;
+}
+
+/* What split_source_line() found on a line. */
+enum {
+    LINE_EMPTY,         // no instruction (there may still be a label)
+    LINE_INST,          // an instruction
+    LINE_BAD_LABEL,     // an invalid label, stored in the label of the tokens
+    LINE_EXTRA_ARG      // an instruction with more than MAX_ARGS arguments
+};
+
+/* Strips the comment from LINE, reads a leading label into TOKS and splits
+   the rest of the line into the name and arguments of TOKS, following the
+   guidelines listed for pass_one(). MASKS classifies the bytes of LINE, or
+   is NULL if they have not been classified yet. Nothing is logged or added
+   to the symbol table. Returns one of the LINE_ values above; with
+   LINE_EXTRA_ARG, the first extra argument is ARGS[MAX_ARGS].
+ */
+static int split_source_line(Slice line, const CharMasks* masks, LineTokens* toks) {
+    //a label, the name and one argument more than is allowed
+    Slice words[MAX_LINE_ARGS + 3];
+    uint32_t colons;
+    int n = scan_tokens(line, masks, words, MAX_ARGS + 3, &colons);
+    int first = 0;
+
+    toks->label.len = 0;
+    if (n == 0) return LINE_EMPTY;
+
+    if (colons & 1) {
+      if (read_label(words[0], &toks->label) == -1) {
+        //not a valid label: the rest of the line is ignored
+        return LINE_BAD_LABEL;
+      }
+      //valid label: the next token is the instruction
+      if (n == 1) return LINE_EMPTY;
+      first = 1;
     }
+
+    //the tokens and their terminators fit in the line plus one byte per token
+    reserve_tokens(toks, line.len + n);
+    size_t used = 0;
+    toks->name = copy_token(toks, &used, words[first]);
+
+    toks->num_args = 0;
+    for (int i = first + 1; i < n && toks->num_args <= MAX_ARGS; i++) {
+      toks->args[toks->num_args++] = copy_token(toks, &used, words[i]);
+    }
+    for (int i = toks->num_args; i <= MAX_ARGS; i++) {
+      toks->args[i] = NULL;
+    }
+
+    return toks->num_args > MAX_ARGS ? LINE_EXTRA_ARG : LINE_INST;
+}
+
+/* Splits LINE with split_source_line(), logs any error and adds its label to
+   SYMTBL at BYTE_OFFSET, the offset of the next instruction. INPUT_LINE is
+   which line of the input file LINE is, and MASKS is passed on to
+   split_source_line().
+
+   Returns 1 if an instruction was found, 0 if there is nothing to assemble on
+   this line, and -1 if an error was found and logged.
+ */
+static int parse_line(uint32_t input_line, Slice line, const CharMasks* masks,
+    uint32_t byte_offset, SymbolTable* symtbl, LineTokens* toks) {
+
+    int status = split_source_line(line, masks, toks);
+    if (status == LINE_BAD_LABEL) {
+      raise_label_error(input_line, toks->label);
+      return -1;
+    }
+    if (toks->label.len > 0
+        && add_to_table_n(symtbl, toks->label.ptr, toks->label.len, byte_offset) != 0) {
+      return -1;
+    }
+    if (status == LINE_EXTRA_ARG) {
+      raise_extra_arg_error(input_line, toks->args[MAX_ARGS]);
+      return -1;
+    }
+    return status == LINE_INST;
 }
 
-/* helper for if we should expand 2 lines. */
-int how_many_expansions(const char* name, char** args, int num_args) {
-  long int imm;
-  translate_num(&imm, args[1], -2147483648, 4294967295);
-  
-  if ((strcmp(name, "blt") == 0) && num_args == 3) return 2;
-  else if ((num_args == 2) && (strcmp(name, "li") == 0) && (-32768 > imm || imm > 65535)) return 2;
-  else return 1;
+/* Splits a line of the intermediate file into the name and arguments of
+   TOKS. Returns 0 if the line is empty and 1 otherwise.
+ */
+static int split_inst_line(Slice line, LineTokens* toks) {
+    Slice tok;
+    if (!next_token(&line, &tok)) return 0;
+
+    reserve_tokens(toks, tok.len + line.len + 2);
+    size_t used = 0;
+    toks->name = copy_token(toks, &used, tok);
+
+    toks->num_args = 0;
+    while (toks->num_args < MAX_LINE_ARGS && next_token(&line, &tok)) {
+      toks->args[toks->num_args++] = copy_token(toks, &used, tok);
+    }
+    for (int i = toks->num_args; i < MAX_ARGS; i++) {
+      toks->args[i] = NULL;
+    }
+    return 1;
 }
 
 /*******************************
  * Implement the Following
  *******************************/
+/* Does the work of pass_one(), writing the intermediate file through OUTPUT
+   instead, unless it is NULL.
+ */
+static int scan_source(FILE* input, OutBuf* output, SymbolTable* symtbl, InstList* insts,
+    AsmStats* stats) {
+    uint32_t lineCount = 0;
+    uint32_t byteOffset = 0;
+    int hasErrorOccured = 0;
+
+    SourceReader reader;
+    if (reader_open(&reader, input) != 0) {
+      hasErrorOccured = -1;
+    }
+
+    LineTokens toks = { NULL, 0 };
+    Slice line;
+    CharMasks masks;
+
+    while (reader_next_line(&reader, &line)) {
+      lineCount += 1;
+
+      int status = parse_line(lineCount, line, reader_line_masks(&reader, line, &masks),
+          byteOffset, symtbl, &toks);
+      if (status == -1) {
+        hasErrorOccured = -1;
+      }
+      if (status != 1) continue;
+
+      //if 2 expansions, byteOffset += 8
+      Expansion exp;
+      plan_expansion(&exp, toks.name, toks.args, toks.num_args);
+      byteOffset += exp.size;
+      count_expansion(stats, exp.desc, exp.count);
+      for (int i = 0; i < exp.count; i++) {
+        if (output) {
+          write_expansion(output, &exp, i);
+        }
+        if (insts) {
+          inst_list_add_expansion(insts, &exp, i, lineCount);
+        }
+      }
+    }
+    free_tokens(&toks);
+    reader_close(&reader);
+    if (stats) {
+      stats->lines_read[STATS_PASS_ONE] += lineCount;
+    }
+    return hasErrorOccured;
+}
+
 /* First pass of the assembler. You should implement pass_two() first.
 
    This function should read each line, strip all comments, scan for labels,
@@ -127,83 +303,21 @@ int how_many_expansions(const char* name, char** args, int num_args) {
    Just like in pass_two(), if the function encounters an error it should NOT
    exit, but process the entire file and return -1. If no errors were encountered, 
    it should return 0.
- */
-int pass_one(FILE* input, FILE* output, SymbolTable* symtbl) {
-    uint32_t lineCount = 0;
-    uint32_t byteOffset = 0;
-    int hasErrorOccured = 0;
-    
-    char buf[BUF_SIZE];
-
-    while (fgets(buf, sizeof(buf), input)) {
-      lineCount += 1;
-      skip_comment(buf);
-
-      char* name;
-      char* args[50];
-      int num_args = 0;
-
-      //tokenize
-      char *tok;
-      tok = strtok(buf, IGNORE_CHARS);
-      if (tok == NULL) continue;
-      name = tok;
-      
-      int isLabel; 
-      isLabel = add_if_label(lineCount, name, byteOffset, symtbl);
-      if (isLabel == 0) {
-        //not a label
-        while (tok != NULL) {
-          tok = strtok(NULL, IGNORE_CHARS);
-          args[num_args] = tok;
-          num_args += 1;
-        }
-        num_args = num_args - 1; 
-        if (num_args > MAX_ARGS) {
-          const char *extraArg = args[MAX_ARGS];
-          raise_extra_arg_error(lineCount, extraArg);
-          hasErrorOccured = -1;
-        } else {
-          //if 2 expansions, byteOffset += 8
-          if(how_many_expansions(name, args, num_args) == 2) {
-            byteOffset += 8; //incr for the next loop if only 1 expansion
-          } else {
-            byteOffset += 4;
-          }
-          write_pass_one(output, name, args, num_args);
-        }
-      } else if (isLabel == -1) {
-        //not a valid label: do nothing
-        hasErrorOccured = -1;
-      } else if (isLabel  == 1) {
-        //valid label and succeeds
 
-        //reassign name and tok
-        tok = strtok(NULL, IGNORE_CHARS);
-        if (tok == NULL) continue;
-        name = tok;
-        
-        //tokenize as normal
-        while (tok != NULL) {
-          tok = strtok(NULL, IGNORE_CHARS);
-          args[num_args] = tok;
-          num_args += 1;
-        }  
-        //adjustment
-        num_args = num_args - 1;
-        if (num_args > MAX_ARGS) {
-          const char *extraArg = args[MAX_ARGS];
-          raise_extra_arg_error(lineCount, extraArg);
-          hasErrorOccured = -1;
-        } else {
-          if(how_many_expansions(name, args, num_args) == 2) {
-            byteOffset += 8;
-          } else {
-            byteOffset += 4;
-          }
-          write_pass_one(output, name, args, num_args);
-        }  
-      }
+   The expanded instructions are written as text to OUTPUT and appended as
+   records to INSTS. Either of them may be NULL if that form is not needed.
+   Lines and expansions are counted in STATS, unless it is NULL.
+ */
+int pass_one(FILE* input, FILE* output, SymbolTable* symtbl, InstList* insts,
+    AsmStats* stats) {
+    if (!output) {
+      return scan_source(input, NULL, symtbl, insts, stats);
+    }
+    OutBuf out;
+    outbuf_open_file(&out, output);
+    int hasErrorOccured = scan_source(input, &out, symtbl, insts, stats);
+    if (outbuf_close(&out) != 0) {
+      hasErrorOccured = -1;
     }
     return hasErrorOccured;
 }
@@ -218,39 +332,37 @@ int pass_one(FILE* input, FILE* output, SymbolTable* symtbl) {
    If an error is reached, DO NOT EXIT the function. Keep translating the rest of
    the document, and at the end, return -1. Return 0 if no errors were encountered.
    
-   the output is the result of pass 2. the input is the intermediate file. */
-int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl) {
-    // Since we pass this buffer to strtok(), the chars here will GET CLOBBERED.
+   the output is the result of pass 2. the input is the intermediate file.
+   Lines and symbol lookups are counted in STATS, unless it is NULL. */
+int pass_two(FILE *input, ObjectWriter* output, SymbolTable* symtbl, SymbolTable* reltbl,
+    AsmStats* stats) {
     uint32_t lineCount = 0;
-    char buf[BUF_SIZE];
     int hasErrorOccured = 0;
+    uint64_t lookups = get_lookup_count();
     
     // Store input line number / byte offset below. When should each be incremented? 
     // input line number incremented for every while loop. byte offset incremented for every translate_inst 
     // in a while loop
     uint32_t addr; //addr = byte offset
 
-    // First, read the next line into a buffer.
-    while(fgets(buf, sizeof(buf), input)) {
-        lineCount += 1;
+    SourceReader reader;
+    if (reader_open(&reader, input) != 0) {
+      hasErrorOccured = -1;
+    }
 
-        char* tok; 
-        char* name;
-        char* args[MAX_ARGS];
-        int num_args = 0;
+    // Tokens are copied out of the (read-only) input into TOKS.
+    LineTokens toks = { NULL, 0 };
+    Slice line;
 
-        // Next, use strtok() to scan for next character. If there's nothing,
-        // go to the next line.
-        tok = strtok(buf, IGNORE_CHARS);
-        if (tok == NULL) continue;
-        name = tok;
-        while (tok != NULL) {
-          // Parse for instruction arguments. You should use strtok() to tokenize  the rest of the line. 
-          tok = strtok(NULL, IGNORE_CHARS);
-          args[num_args] = tok;
-          num_args += 1;
-        }
-        num_args = num_args - 1; //account for strtok behav
+    // First, read the next line.
+    while (reader_next_line(&reader, &line)) {
+        lineCount += 1;
+
+        // Next, split it into tokens. If there's nothing, go to the next line.
+        if (!split_inst_line(line, &toks)) continue;
+        const char* name = toks.name;
+        char** args = toks.args;
+        int num_args = toks.num_args;
 
       // Use translate_inst() to translate the instruction and write to output file.
       addr = (4 * lineCount) - 4;
@@ -263,148 +375,2022 @@ int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl
       printf("number of args is %d\n", num_args);
       printf("addr is %d\n", addr);
       printf("\n"); */
-      hasErrorOccured = translate_inst(output, name, args, num_args, addr, symtbl, reltbl); 
       // If an error occurs, the instruction will not be written and you should call
       // raise_inst_error(). 
-      if (hasErrorOccured == -1) {
+      uint32_t instruction;
+      if (encode_inst(&instruction, lookup_inst(name), args, num_args, addr, symtbl, reltbl) == -1) {
         raise_inst_error(lineCount, name, args, num_args);
+        hasErrorOccured = -1;
+      } else {
+        object_add_word(output, instruction);
       }
     }   
+    free_tokens(&toks);
+    reader_close(&reader);
+    if (stats) {
+      stats->lines_read[STATS_PASS_TWO] += lineCount;
+      stats->lookups += get_lookup_count() - lookups;
+    }
     // Repeat until no more characters are left, and the return the correct return val
     return hasErrorOccured;
 }
 
+/* Does the work of pass_two() on the records produced by pass_one() instead
+   of an intermediate file. The record at index i is at byte offset 4 * i, and
+   errors are reported with the line it would have had in the intermediate
+   file, so the output and log are the same as with pass_two().
+ */
+int pass_two_records(const InstList* insts, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, AsmStats* stats) {
+    int hasErrorOccured = 0;
+    uint64_t lookups = get_lookup_count();
+
+    for (uint32_t i = 0; i < insts->len; i++) {
+      const InstRecord* rec = &insts->recs[i];
+      uint32_t instruction;
+
+      if (rec->id == INST_INVALID
+          || encode_record(&instruction, rec, 4 * i, symtbl, reltbl) == -1) {
+        raise_inst_error(i + 1, rec->text, NULL, 0);
+        hasErrorOccured = -1;
+        continue;
+      }
+      object_add_word(output, instruction);
+    }
+    if (stats) {
+      stats->lines_read[STATS_PASS_TWO] += insts->len;
+      stats->lookups += get_lookup_count() - lookups;
+    }
+    return hasErrorOccured;
+}
+
 /*******************************
- * Do Not Modify Code Below
+ * Deferred Output
  *******************************/
 
-static int open_files(FILE** input, FILE** output, const char* input_name, 
-    const char* output_name) {
-    
-    *input = fopen(input_name, "r");
-    if (!*input) {
-        write_to_log("Error: unable to open input file: %s\n", input_name);
-        return -1;
+/* An instruction error that is only reported once the instructions before it
+   have been, so that the log matches the serial two-pass assembler.
+ */
+typedef struct {
+    uint32_t inst_line;
+    const char* inst;       // "name arg1 arg2 ..."
+} DeferredError;
+
+/* Encoded words and instruction errors kept in memory until they can be
+   written out in order.
+ */
+typedef struct {
+    uint32_t* words;
+    uint32_t len, cap;
+    DeferredError* errors;
+    uint32_t num_errors, error_cap;
+    Arena strings;          // owns the text of ERRORS
+} PendingOutput;
+
+static void* grow_array(void* arr, uint32_t* cap, size_t elem_size) {
+    *cap = *cap ? *cap * 2 : 64;
+    arr = realloc(arr, *cap * elem_size);
+    if (arr == NULL) allocation_failed();
+    return arr;
+}
+
+static void pending_init(PendingOutput* out) {
+    memset(out, 0, sizeof(*out));
+    arena_init(&out->strings, 4096);
+}
+
+static void pending_free(PendingOutput* out) {
+    free(out->words);
+    free(out->errors);
+    arena_free(&out->strings);
+}
+
+static void defer_inst_error(PendingOutput* out, uint32_t inst_line, const char* inst) {
+    if (out->num_errors == out->error_cap) {
+        out->errors = grow_array(out->errors, &out->error_cap, sizeof(DeferredError));
     }
-    *output = fopen(output_name, "w");
-    if (!*output) {
-        write_to_log("Error: unable to open output file: %s\n", output_name);
-        fclose(*input);
-        return -1;
+    out->errors[out->num_errors].inst_line = inst_line;
+    out->errors[out->num_errors].inst = inst;
+    out->num_errors += 1;
+}
+
+static void push_word(PendingOutput* out, uint32_t word) {
+    if (out->len == out->cap) {
+        out->words = grow_array(out->words, &out->cap, sizeof(uint32_t));
     }
-    return 0;
+    out->words[out->len++] = word;
 }
 
-static void close_files(FILE* input, FILE* output) {
-    fclose(input);
-    fclose(output);
+/* Logs the deferred errors of OUT, which must already be in line order. */
+static void report_errors(const PendingOutput* out) {
+    for (uint32_t i = 0; i < out->num_errors; i++) {
+        raise_inst_error(out->errors[i].inst_line, out->errors[i].inst, NULL, 0);
+    }
 }
 
-/* Runs the two-pass assembler. Most of the actual work is done in pass_one()
-   and pass_two().
+static int compare_errors(const void* a, const void* b) {
+    uint32_t la = ((const DeferredError*) a)->inst_line;
+    uint32_t lb = ((const DeferredError*) b)->inst_line;
+    return (la > lb) - (la < lb);
+}
+
+/*******************************
+ * Single Pass
+ *******************************/
+
+/* A branch whose label had not been defined yet when it was read. A
+   placeholder word is emitted and patched once the whole file is read.
  */
-int assemble(const char* in_name, const char* tmp_name, const char* out_name) {
-    FILE *src, *dst;
-    int err = 0;
-    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
-    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+typedef struct {
+    uint32_t index;         // position of the placeholder in WORDS
+    uint32_t inst_line;     // line of the instruction in the intermediate file
+    InstRecord rec;
+    int failed;
+} Fixup;
 
-    if (in_name) {
-        printf("Running pass one: %s -> %s\n", in_name, tmp_name);
-        if (open_files(&src, &dst, in_name, tmp_name) != 0) {
-            free_table(symtbl);
-            free_table(reltbl);
-            exit(1);
+typedef struct {
+    PendingOutput out;      // errors are found out of order and sorted at the end
+    Fixup* fixups;
+    uint32_t num_fixups, fixup_cap;
+} SinglePassState;
+
+/* Encodes instruction I of the expansion EXP. INST_LINE is the line it
+   would have had in the intermediate file. Returns -1 on error.
+ */
+static int single_pass_inst(SinglePassState* state, const Expansion* exp, int i,
+    uint32_t inst_line, SymbolTable* symtbl, SymbolTable* reltbl) {
+
+    uint32_t addr = (4 * inst_line) - 4;
+    uint32_t word;
+    InstRecord rec;
+
+    if (expansion_record(&rec, exp, i) == -1) {
+        defer_inst_error(&state->out, inst_line, expansion_to_string(&state->out.strings, exp, i));
+        return -1;
+    }
+
+    if (get_inst(rec.id)->format == FMT_BRANCH && get_addr_for_symbol(symtbl, rec.sym) == -1) {
+        //forward reference: patched in finish_single_pass()
+        if (state->num_fixups == state->fixup_cap) {
+            state->fixups = grow_array(state->fixups, &state->fixup_cap, sizeof(Fixup));
         }
+        Fixup* fixup = &state->fixups[state->num_fixups++];
+        fixup->index = state->out.len;
+        fixup->inst_line = inst_line;
+        fixup->rec = rec;
+        fixup->rec.sym = arena_strdup(&state->out.strings, rec.sym);
+        fixup->rec.text = expansion_to_string(&state->out.strings, exp, i);
+        fixup->failed = 0;
+        push_word(&state->out, 0);
+        return 0;
+    }
 
-        if (pass_one(src, dst, symtbl) != 0) {
-            err = 1;
+    if (encode_record(&word, &rec, addr, symtbl, reltbl) == -1) {
+        defer_inst_error(&state->out, inst_line, expansion_to_string(&state->out.strings, exp, i));
+        return -1;
+    }
+    push_word(&state->out, word);
+    return 0;
+}
+
+/* Patches every forward branch, writes the text section to OUTPUT and reports
+   instruction errors in line order. Returns -1 if any branch failed.
+ */
+static int finish_single_pass(SinglePassState* state, ObjectWriter* output, SymbolTable* symtbl) {
+    int hasErrorOccured = 0;
+
+    for (uint32_t i = 0; i < state->num_fixups; i++) {
+        Fixup* fixup = &state->fixups[i];
+        uint32_t addr = (4 * fixup->inst_line) - 4;
+        if (encode_record(&state->out.words[fixup->index], &fixup->rec, addr, symtbl, NULL) == -1) {
+            defer_inst_error(&state->out, fixup->inst_line, fixup->rec.text);
+            fixup->failed = 1;
+            hasErrorOccured = -1;
         }
-        close_files(src, dst);
     }
 
-    if (out_name) {
-        printf("Running pass two: %s -> %s\n", tmp_name, out_name);
-        if (open_files(&src, &dst, tmp_name, out_name) != 0) {
-            free_table(symtbl);
-            free_table(reltbl);
-            exit(1);
+    //write every word except the placeholders of failed fixups, which are
+    //stored in the order they were emitted
+    uint32_t start = 0;
+    for (uint32_t f = 0; f < state->num_fixups; f++) {
+        if (state->fixups[f].failed) {
+            uint32_t index = state->fixups[f].index;
+            object_add_words(output, state->out.words + start, index - start);
+            start = index + 1;
         }
+    }
+    object_add_words(output, state->out.words + start, state->out.len - start);
 
-        fprintf(dst, ".text\n");
-        if (pass_two(src, dst, symtbl, reltbl) != 0) {
-            err = 1;
+    if (state->out.num_errors > 0) {
+        qsort(state->out.errors, state->out.num_errors, sizeof(DeferredError), compare_errors);
+    }
+    report_errors(&state->out);
+    return hasErrorOccured;
+}
+
+/* Assembles INPUT in a single pass, writing the text section to OUTPUT. Labels
+   are added to SYMTBL and relocations to RELTBL exactly as pass_one() and
+   pass_two() would, but instructions are encoded as soon as they are read.
+   Branches to labels that are not defined yet are patched at the end of the
+   file. Lines, expansions and lookups are counted in STATS, unless it is NULL.
+
+   Returns -1 if any error was found, 0 otherwise.
+ */
+int single_pass(FILE* input, ObjectWriter* output, SymbolTable* symtbl, SymbolTable* reltbl,
+    AsmStats* stats) {
+    uint32_t lineCount = 0;
+    uint32_t byteOffset = 0;
+    uint32_t instLine = 0;
+    int hasErrorOccured = 0;
+    uint64_t lookups = get_lookup_count();
+
+    SinglePassState state;
+    memset(&state, 0, sizeof(state));
+    pending_init(&state.out);
+
+    SourceReader reader;
+    if (reader_open(&reader, input) != 0) {
+      hasErrorOccured = -1;
+    }
+
+    LineTokens toks = { NULL, 0 };
+    Slice line;
+    CharMasks masks;
+
+    while (reader_next_line(&reader, &line)) {
+      lineCount += 1;
+
+      int status = parse_line(lineCount, line, reader_line_masks(&reader, line, &masks),
+          byteOffset, symtbl, &toks);
+      if (status == -1) {
+        hasErrorOccured = -1;
+      }
+      if (status != 1) continue;
+
+      Expansion exp;
+      plan_expansion(&exp, toks.name, toks.args, toks.num_args);
+      byteOffset += exp.size;
+      count_expansion(stats, exp.desc, exp.count);
+      for (int i = 0; i < exp.count; i++) {
+        instLine += 1;
+        if (single_pass_inst(&state, &exp, i, instLine, symtbl, reltbl) == -1) {
+          hasErrorOccured = -1;
         }
-        
-        fprintf(dst, "\n.symbol\n");
-        write_table(symtbl, dst);
+      }
+    }
 
-        fprintf(dst, "\n.relocation\n");
-        write_table(reltbl, dst);
+    if (finish_single_pass(&state, output, symtbl) == -1) {
+      hasErrorOccured = -1;
+    }
 
-        close_files(src, dst);
+    free_tokens(&toks);
+    reader_close(&reader);
+    pending_free(&state.out);
+    free(state.fixups);
+    if (stats) {
+      stats->lines_read[STATS_SINGLE_PASS] += lineCount;
+      stats->lookups += get_lookup_count() - lookups;
     }
-    
-    free_table(symtbl);
-    free_table(reltbl);
-    return err;
+    return hasErrorOccured;
 }
 
-static void print_usage_and_exit() {
-    printf("Usage:\n");
-    printf("  Runs both passes: assembler <input file> <intermediate file> <output file>\n");
-    printf("  Run pass #1:      assembler -p1 <input file> <intermediate file>\n");
-    printf("  Run pass #2:      assembler -p2 <intermediate file> <output file>\n");
-    printf("Append -log <file name> after any option to save log files to a text file.\n");
-    exit(0);
+/*******************************
+ * Parallel Pass One
+ *******************************/
+
+/* Smallest piece of work worth handing to another thread. */
+#define MIN_CHUNK_BYTES (64 * 1024)
+#define MIN_CHUNK_INSTS 4096
+
+/* Chunks per thread, so that threads that finish early can take more. */
+#define CHUNKS_PER_JOB 4
+
+static uint32_t num_chunks_for(size_t size, size_t min_size, int jobs) {
+    size_t n = size / min_size;
+    if (n > (size_t) jobs * CHUNKS_PER_JOB) n = (size_t) jobs * CHUNKS_PER_JOB;
+    return n > 0 ? n : 1;
 }
 
-int main(int argc, char **argv) {
-    if (argc != 4 && argc != 6) {
-        print_usage_and_exit();
+/* Cuts the input of READER into N pieces of about the same size, stored in
+   PIECES. Every piece but the last ends just after a newline, and some may be
+   empty.
+ */
+static void split_lines(const SourceReader* reader, uint32_t n, Slice* pieces) {
+    size_t start = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      size_t end = reader->size;
+      if (i + 1 < n) {
+        size_t target = reader->size / n * (i + 1);
+        if (target < start) target = start;
+        const char* nl = memchr(reader->data + target, '\n', reader->size - target);
+        if (nl) end = nl - reader->data + 1;
+      }
+      pieces[i].ptr = reader->data + start;
+      pieces[i].len = end - start;
+      start = end;
     }
+}
 
-    int mode = 0;
-    if (strcmp(argv[1], "-p1") == 0) {
-        mode = 1;
-    } else if (strcmp(argv[1], "-p2") == 0) {
-        mode = 2;
-    }
-
-    char *input, *inter, *output;
-    if (mode == 1) {
-        input = argv[2];
-        inter = argv[3];
-        output = NULL;
-    } else if (mode == 2) {
-        input = NULL;
-        inter = argv[2];
-        output = argv[3];
-    } else {
-        input = argv[1];
-        inter = argv[2];
-        output = argv[3];
-    }
+/* Something pass one found in a chunk that can only be applied once the
+   chunks before it are: a label, which needs its final byte offset and may
+   turn out to be a duplicate, or an error, which needs its line number.
+ */
+enum { EVENT_LABEL, EVENT_BAD_LABEL, EVENT_EXTRA_ARG };
 
-    if (argc == 6) {
-        if (strcmp(argv[4], "-log") == 0) {
-            set_log_file(argv[5]);
-        } else {
-            print_usage_and_exit();
-        }
+typedef struct {
+    uint8_t kind;
+    uint32_t line;          // line number within the chunk
+    Slice label;            // the label of EVENT_LABEL and EVENT_BAD_LABEL
+    const char* extra_arg;  // first extra argument on the line, or NULL
+    // for EVENT_LABEL, where the label is and what the rest of its line
+    // produced, which is dropped if the label cannot be added
+    uint32_t offset;        // byte offset within the chunk
+    uint32_t size;          // bytes the instruction adds to the byte offset
+    uint32_t first_rec, num_recs;
+    size_t text_start, text_len;
+    const InstDesc* desc;   // the instruction, counted in the stats only if
+    int count;              // the label is added
+} LineEvent;
+
+/* A run of consecutive source lines scanned by one task of pass one. */
+typedef struct {
+    Slice text;
+    uint32_t lines;         // number of lines in the chunk
+    uint32_t size;          // byte offset of the end of the chunk from its start
+    LineEvent* events;
+    uint32_t num_events, event_cap;
+    InstList insts;         // records, if pass one produces them
+    OutBuf inter;           // intermediate text, if pass one writes it
+    AsmStats stats;
+} SourceChunk;
+
+typedef struct {
+    SourceChunk* chunks;
+    int want_insts;
+    int want_text;
+} SourceJob;
+
+static LineEvent* add_event(SourceChunk* chunk, int kind, uint32_t line) {
+    if (chunk->num_events == chunk->event_cap) {
+        chunk->events = grow_array(chunk->events, &chunk->event_cap, sizeof(LineEvent));
     }
+    LineEvent* ev = &chunk->events[chunk->num_events++];
+    memset(ev, 0, sizeof(*ev));
+    ev->kind = kind;
+    ev->line = line;
+    return ev;
+}
 
-    int err = assemble(input, inter, output);
+/* Does what pass_one() does for the lines of one chunk, except that labels
+   and errors are recorded as events instead of being applied.
+ */
+static void scan_source_chunk(void* arg, uint32_t task) {
+    SourceJob* job = (SourceJob*) arg;
+    SourceChunk* chunk = &job->chunks[task];
+    SourceReader reader = { chunk->text.ptr, chunk->text.len, 0, 0 };
+    LineTokens toks = { NULL, 0 };
+    Slice line;
+    CharMasks masks;
 
-    if (err) {
-        write_to_log("One or more errors encountered during assembly operation.\n");
-    } else {
-        write_to_log("Assembly operation completed successfully.\n");
+    trace_begin_index("pass_one chunk", task);
+    while (reader_next_line(&reader, &line)) {
+      chunk->lines += 1;
+
+      int status = split_source_line(line, reader_line_masks(&reader, line, &masks), &toks);
+      if (status == LINE_BAD_LABEL) {
+        add_event(chunk, EVENT_BAD_LABEL, chunk->lines)->label = toks.label;
+        continue;
+      }
+
+      LineEvent* label = NULL;
+      if (toks.label.len > 0) {
+        label = add_event(chunk, EVENT_LABEL, chunk->lines);
+        label->label = toks.label;
+        label->offset = chunk->size;
+        label->first_rec = chunk->insts.len;
+        label->text_start = chunk->inter.len;
+      }
+      if (status == LINE_EXTRA_ARG) {
+        const char* extra_arg = arena_strdup(&chunk->insts.strings, toks.args[MAX_ARGS]);
+        if (!label) label = add_event(chunk, EVENT_EXTRA_ARG, chunk->lines);
+        label->extra_arg = extra_arg;
+        continue;
+      }
+      if (status != LINE_INST) continue;
+
+      Expansion exp;
+      plan_expansion(&exp, toks.name, toks.args, toks.num_args);
+      chunk->size += exp.size;
+      if (!label) {
+        count_expansion(&chunk->stats, exp.desc, exp.count);
+      }
+      for (int i = 0; i < exp.count; i++) {
+        if (job->want_text) {
+          write_expansion(&chunk->inter, &exp, i);
+        }
+        if (job->want_insts) {
+          inst_list_add_expansion(&chunk->insts, &exp, i, chunk->lines);
+        }
+      }
+
+      if (label) {
+        label->size = exp.size;
+        label->desc = exp.desc;
+        label->count = exp.count;
+        label->num_recs = chunk->insts.len - label->first_rec;
+        label->text_len = chunk->inter.len - label->text_start;
+      }
     }
+    chunk->stats.lines_read[STATS_PASS_ONE] = chunk->lines;
+    free_tokens(&toks);
+    trace_end("pass_one chunk");
+}
 
-    if (is_log_file_set()) {
-        printf("Results saved to %s\n", argv[5]);
+/* Appends the records and intermediate text of CHUNK in the given ranges to
+   INSTS and OUTPUT, either of which may be NULL.
+ */
+static void emit_source_range(SourceChunk* chunk, uint32_t rec_start, uint32_t rec_end,
+    size_t text_start, size_t text_end, uint32_t first_line, InstList* insts, OutBuf* output) {
+    if (insts) {
+      inst_list_append(insts, chunk->insts.recs + rec_start, rec_end - rec_start, first_line);
+    }
+    if (output) {
+      outbuf_write(output, chunk->inter.data + text_start, text_end - text_start);
     }
+}
 
+/* Replays the events of every chunk in order. Labels are added to SYMTBL at
+   their final byte offset, found from the sizes of the chunks before them,
+   and errors are logged with their final line number, so the symbol table
+   and log end up exactly as pass_one() leaves them. The records and text of
+   the chunks are then passed on, except for those of lines whose label was
+   rejected, and their counters are added to STATS unless it is NULL. Frees
+   the chunks and returns -1 if any error was found.
+ */
+static int merge_source_chunks(SourceChunk* chunks, uint32_t n, SymbolTable* symtbl,
+    InstList* insts, OutBuf* output, AsmStats* stats) {
+    int hasErrorOccured = 0;
+    uint32_t first_line = 0;
+    uint32_t base = 0;
+
+    trace_begin("pass_one merge", NULL);
+    for (uint32_t i = 0; i < n; i++) {
+      SourceChunk* chunk = &chunks[i];
+      uint32_t dropped = 0;
+      uint32_t rec_next = 0;
+      size_t text_next = 0;
+
+      for (uint32_t j = 0; j < chunk->num_events; j++) {
+        LineEvent* ev = &chunk->events[j];
+        uint32_t line = first_line + ev->line;
+
+        if (ev->kind == EVENT_BAD_LABEL) {
+          raise_label_error(line, ev->label);
+          hasErrorOccured = -1;
+        } else if (ev->kind == EVENT_EXTRA_ARG) {
+          raise_extra_arg_error(line, ev->extra_arg);
+          hasErrorOccured = -1;
+        } else if (add_to_table_n(symtbl, ev->label.ptr, ev->label.len,
+              base + ev->offset - dropped) != 0) {
+          //the rest of the line is ignored, as in parse_line()
+          emit_source_range(chunk, rec_next, ev->first_rec, text_next, ev->text_start,
+              first_line, insts, output);
+          rec_next = ev->first_rec + ev->num_recs;
+          text_next = ev->text_start + ev->text_len;
+          dropped += ev->size;
+          hasErrorOccured = -1;
+        } else {
+          count_expansion(&chunk->stats, ev->desc, ev->count);
+          if (ev->extra_arg) {
+            raise_extra_arg_error(line, ev->extra_arg);
+            hasErrorOccured = -1;
+          }
+        }
+      }
+      emit_source_range(chunk, rec_next, chunk->insts.len, text_next, chunk->inter.len,
+          first_line, insts, output);
+
+      base += chunk->size - dropped;
+      first_line += chunk->lines;
+      if (stats) {
+        stats_add(stats, &chunk->stats);
+      }
+
+      //the records just appended still point at strings of the chunk
+      if (insts) {
+        arena_adopt(&insts->strings, &chunk->insts.strings);
+      }
+      free(chunk->events);
+      inst_list_free(&chunk->insts);
+      outbuf_close(&chunk->inter);
+    }
+    free(chunks);
+    trace_end("pass_one merge");
+    return hasErrorOccured;
+}
+
+/* Does the work of pass_one_parallel(), writing the intermediate file through
+   OUTPUT instead, unless it is NULL.
+ */
+static int scan_source_parallel(FILE* input, OutBuf* output, SymbolTable* symtbl,
+    InstList* insts, int jobs, AsmStats* stats) {
+    int hasErrorOccured = 0;
+
+    SourceReader reader;
+    if (reader_open(&reader, input) != 0) {
+      hasErrorOccured = -1;
+    }
+
+    uint32_t n = num_chunks_for(reader.size, MIN_CHUNK_BYTES, jobs);
+    SourceJob job = { NULL, insts != NULL, output != NULL };
+    job.chunks = (SourceChunk*) calloc(n, sizeof(SourceChunk));
+    if (job.chunks == NULL) allocation_failed();
+
+    Slice* pieces = (Slice*) malloc(n * sizeof(Slice));
+    if (pieces == NULL) allocation_failed();
+    split_lines(&reader, n, pieces);
+    for (uint32_t i = 0; i < n; i++) {
+      job.chunks[i].text = pieces[i];
+      inst_list_init(&job.chunks[i].insts);
+      outbuf_open_memory(&job.chunks[i].inter);
+    }
+    free(pieces);
+
+    run_tasks(jobs, n, scan_source_chunk, &job);
+
+    if (merge_source_chunks(job.chunks, n, symtbl, insts, output, stats) != 0) {
+      hasErrorOccured = -1;
+    }
+    reader_close(&reader);
+    return hasErrorOccured;
+}
+
+/* Does the same as pass_one(), scanning the input on up to JOBS threads. The
+   input is split into line-aligned chunks, and each chunk is scanned with
+   offsets and line numbers counted from its own start. The total size of
+   the chunks before each one then gives its byte offset, and the chunks are
+   merged in order, so the symbol table, records, intermediate file and log
+   are the same as with pass_one().
+ */
+int pass_one_parallel(FILE* input, FILE* output, SymbolTable* symtbl, InstList* insts,
+    int jobs, AsmStats* stats) {
+    if (!output) {
+      return scan_source_parallel(input, NULL, symtbl, insts, jobs, stats);
+    }
+    OutBuf out;
+    outbuf_open_file(&out, output);
+    int hasErrorOccured = scan_source_parallel(input, &out, symtbl, insts, jobs, stats);
+    if (outbuf_close(&out) != 0) {
+      hasErrorOccured = -1;
+    }
+    return hasErrorOccured;
+}
+
+/*******************************
+ * Parallel Pass Two
+ *******************************/
+
+/* A run of consecutive instructions translated by one task of pass two.
+   Everything the task produces stays in the chunk until the chunks are merged
+   in order.
+ */
+typedef struct {
+    Slice text;             // the lines of the chunk, when reading an intermediate file
+    uint32_t first;         // number of instructions (lines) before the chunk
+    uint32_t count;         // number of instructions (lines) in the chunk
+    PendingOutput out;
+    SymbolTable* reltbl;
+    AsmStats stats;
+} Chunk;
+
+typedef struct {
+    Chunk* chunks;
+    const InstList* insts;
+    SymbolTable* symtbl;
+} ChunkJob;
+
+static Chunk* create_chunks(uint32_t n) {
+    Chunk* chunks = (Chunk*) calloc(n, sizeof(Chunk));
+    if (chunks == NULL) allocation_failed();
+    for (uint32_t i = 0; i < n; i++) {
+        pending_init(&chunks[i].out);
+        chunks[i].reltbl = create_table(SYMTBL_NON_UNIQUE);
+    }
+    return chunks;
+}
+
+/* Writes out the words, relocations and errors of every chunk in order, which
+   gives exactly what the serial pass would have, adds the counters of the
+   chunks to STATS unless it is NULL, and frees the chunks. Returns -1 if any
+   chunk had an error.
+ */
+static int merge_chunks(Chunk* chunks, uint32_t n, ObjectWriter* output, SymbolTable* reltbl,
+    AsmStats* stats) {
+    int hasErrorOccured = 0;
+
+    trace_begin("pass_two merge", NULL);
+    for (uint32_t i = 0; i < n; i++) {
+        Chunk* chunk = &chunks[i];
+        object_add_words(output, chunk->out.words, chunk->out.len);
+        for (uint32_t j = 0; j < chunk->reltbl->len; j++) {
+            add_to_table(reltbl, chunk->reltbl->tbl[j].name, chunk->reltbl->tbl[j].addr);
+        }
+        report_errors(&chunk->out);
+        if (chunk->out.num_errors > 0) {
+            hasErrorOccured = -1;
+        }
+        if (stats) {
+            stats_add(stats, &chunk->stats);
+        }
+        pending_free(&chunk->out);
+        free_table(chunk->reltbl);
+    }
+    free(chunks);
+    trace_end("pass_two merge");
+    return hasErrorOccured;
+}
+
+static void count_chunk_lines(void* arg, uint32_t task) {
+    Chunk* chunk = &((ChunkJob*) arg)->chunks[task];
+    const char* p = chunk->text.ptr;
+    const char* end = p + chunk->text.len;
+
+    trace_begin_index("count lines", task);
+    chunk->count = 0;
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        chunk->count += 1;
+        p += 1;
+    }
+    //a last line without a newline
+    if (chunk->text.len > 0 && end[-1] != '\n') {
+        chunk->count += 1;
+    }
+    trace_end("count lines");
+}
+
+/* Does what pass_two() does for the lines of one chunk. */
+static void translate_text_chunk(void* arg, uint32_t task) {
+    ChunkJob* job = (ChunkJob*) arg;
+    Chunk* chunk = &job->chunks[task];
+    SourceReader reader = { chunk->text.ptr, chunk->text.len, 0, 0 };
+    LineTokens toks = { NULL, 0 };
+    uint32_t lineCount = chunk->first;
+    uint64_t lookups = get_lookup_count();
+    Slice line;
+
+    trace_begin_index("pass_two chunk", task);
+    while (reader_next_line(&reader, &line)) {
+        lineCount += 1;
+        if (!split_inst_line(line, &toks)) continue;
+
+        uint32_t addr = (4 * lineCount) - 4;
+        uint32_t instruction;
+        if (encode_inst(&instruction, lookup_inst(toks.name), toks.args, toks.num_args,
+                addr, job->symtbl, chunk->reltbl) == -1) {
+            defer_inst_error(&chunk->out, lineCount,
+                inst_to_string(&chunk->out.strings, toks.name, toks.args, toks.num_args));
+        } else {
+            push_word(&chunk->out, instruction);
+        }
+    }
+    chunk->stats.lines_read[STATS_PASS_TWO] = chunk->count;
+    chunk->stats.lookups = get_lookup_count() - lookups;
+    free_tokens(&toks);
+    trace_end("pass_two chunk");
+}
+
+/* Does what pass_two_records() does for the records of one chunk. */
+static void translate_record_chunk(void* arg, uint32_t task) {
+    ChunkJob* job = (ChunkJob*) arg;
+    Chunk* chunk = &job->chunks[task];
+    uint64_t lookups = get_lookup_count();
+
+    trace_begin_index("pass_two chunk", task);
+    for (uint32_t i = chunk->first; i < chunk->first + chunk->count; i++) {
+        const InstRecord* rec = &job->insts->recs[i];
+        uint32_t instruction;
+
+        if (rec->id == INST_INVALID
+            || encode_record(&instruction, rec, 4 * i, job->symtbl, chunk->reltbl) == -1) {
+            defer_inst_error(&chunk->out, i + 1, rec->text);
+        } else {
+            push_word(&chunk->out, instruction);
+        }
+    }
+    chunk->stats.lines_read[STATS_PASS_TWO] = chunk->count;
+    chunk->stats.lookups = get_lookup_count() - lookups;
+    trace_end("pass_two chunk");
+}
+
+/* Does the same as pass_two(), translating on up to JOBS threads. The input
+   is split into line-aligned chunks, whose line numbers are found by
+   counting the lines of every chunk first. Each chunk is then translated
+   into its own words, relocations and errors, and the chunks are merged in
+   order, so the output and log are identical to those of pass_two().
+ */
+int pass_two_parallel(FILE* input, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, int jobs, AsmStats* stats) {
+    int hasErrorOccured = 0;
+
+    SourceReader reader;
+    if (reader_open(&reader, input) != 0) {
+      hasErrorOccured = -1;
+    }
+
+    uint32_t n = num_chunks_for(reader.size, MIN_CHUNK_BYTES, jobs);
+    ChunkJob job = { create_chunks(n), NULL, symtbl };
+
+    Slice* pieces = (Slice*) malloc(n * sizeof(Slice));
+    if (pieces == NULL) allocation_failed();
+    split_lines(&reader, n, pieces);
+    for (uint32_t i = 0; i < n; i++) {
+      job.chunks[i].text = pieces[i];
+    }
+    free(pieces);
+
+    run_tasks(jobs, n, count_chunk_lines, &job);
+    for (uint32_t i = 1; i < n; i++) {
+      job.chunks[i].first = job.chunks[i - 1].first + job.chunks[i - 1].count;
+    }
+    run_tasks(jobs, n, translate_text_chunk, &job);
+
+    if (merge_chunks(job.chunks, n, output, reltbl, stats) != 0) {
+      hasErrorOccured = -1;
+    }
+    reader_close(&reader);
+    return hasErrorOccured;
+}
+
+/* Does the same as pass_two_records(), translating on up to JOBS threads. */
+int pass_two_records_parallel(const InstList* insts, ObjectWriter* output,
+    SymbolTable* symtbl, SymbolTable* reltbl, int jobs, AsmStats* stats) {
+    uint32_t n = num_chunks_for(insts->len, MIN_CHUNK_INSTS, jobs);
+    ChunkJob job = { create_chunks(n), insts, symtbl };
+
+    for (uint32_t i = 0; i < n; i++) {
+      job.chunks[i].first = (uint64_t) insts->len * i / n;
+      job.chunks[i].count = (uint64_t) insts->len * (i + 1) / n - job.chunks[i].first;
+    }
+    run_tasks(jobs, n, translate_record_chunk, &job);
+
+    return merge_chunks(job.chunks, n, output, reltbl, stats);
+}
+
+/*******************************
+ * Do Not Modify Code Below
+ *******************************/
+
+static int open_input(FILE** input, const char* input_name) {
+    *input = fopen(input_name, "r");
+    if (!*input) {
+        write_to_log("Error: unable to open input file: %s\n", input_name);
+        return -1;
+    }
+    return 0;
+}
+
+static int open_output(FILE** output, const char* output_name) {
+    *output = fopen(output_name, "w");
+    if (!*output) {
+        write_to_log("Error: unable to open output file: %s\n", output_name);
+        return -1;
+    }
+    return 0;
+}
+
+static int open_files(FILE** input, FILE** output, const char* input_name, 
+    const char* output_name) {
+    
+    if (open_input(input, input_name) != 0) {
+        return -1;
+    }
+    if (open_output(output, output_name) != 0) {
+        fclose(*input);
+        return -1;
+    }
+    return 0;
+}
+
+static void close_files(FILE* input, FILE* output) {
+    fclose(input);
+    fclose(output);
+}
+
+/* Returns the size of FILE, after flushing anything still buffered by stdio. */
+static uint64_t file_size(FILE* file) {
+    struct stat st;
+    fflush(file);
+    if (fstat(fileno(file), &st) != 0) {
+        return 0;
+    }
+    return st.st_size;
+}
+
+/* Records in STATS, unless it is NULL, the table sizes of a run that wrote
+   the text section through OBJ.
+ */
+static void count_tables(AsmStats* stats, ObjectWriter* obj, SymbolTable* symtbl,
+    SymbolTable* reltbl) {
+    if (stats) {
+        stats->insts_emitted += obj->num_words;
+        stats->symbols += symtbl->len;
+        stats->relocations += reltbl->len;
+    }
+}
+
+/* Does the same as count_tables(), and also counts the size of OUTPUT, which
+   the text section was written to.
+ */
+static void count_output(AsmStats* stats, ObjectWriter* obj, FILE* output,
+    SymbolTable* symtbl, SymbolTable* reltbl) {
+    count_tables(stats, obj, symtbl, reltbl);
+    if (stats) {
+        stats->bytes_written += file_size(output);
+    }
+}
+
+/* Runs the two-pass assembler. Most of the actual work is done in pass_one()
+   and pass_two().
+
+   When both IN_NAME and OUT_NAME are given, pass one hands its instruction
+   records straight to pass two, and the intermediate file is only written as
+   a debug dump if TMP_NAME is not NULL. Otherwise only one pass runs, and the
+   intermediate file is how the passes communicate.
+
+   OPTS selects the format of the output file, and how many threads the
+   passes run on. If STATS is not NULL, the passes are timed and counted in it.
+ */
+int assemble(const char* in_name, const char* tmp_name, const char* out_name,
+    const AsmOptions* opts, AsmStats* stats) {
+    FILE *src, *dst = NULL;
+    int err = 0;
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    InstList insts;
+    int use_records = in_name && out_name;
+
+    inst_list_init(&insts);
+
+    if (in_name) {
+        int opened;
+        trace_begin("open files", in_name);
+        if (tmp_name) {
+            printf("Running pass one: %s -> %s\n", in_name, tmp_name);
+            opened = open_files(&src, &dst, in_name, tmp_name);
+        } else {
+            printf("Running pass one: %s\n", in_name);
+            opened = open_input(&src, in_name);
+        }
+        trace_end("open files");
+        if (opened != 0) {
+            free_table(symtbl);
+            free_table(reltbl);
+            exit(1);
+        }
+
+        StatsTimer timer;
+        stats_begin(&timer);
+        trace_begin("pass_one", in_name);
+        int status = opts->jobs > 1
+            ? pass_one_parallel(src, dst, symtbl, use_records ? &insts : NULL, opts->jobs, stats)
+            : pass_one(src, dst, symtbl, use_records ? &insts : NULL, stats);
+        trace_end("pass_one");
+        stats_end(stats, STATS_PASS_ONE, &timer);
+        if (status != 0) {
+            err = 1;
+        }
+        fclose(src);
+        if (dst) {
+            if (stats) stats->bytes_written += file_size(dst);
+            fclose(dst);
+        }
+    }
+
+    if (out_name) {
+        int opened;
+        trace_begin("open files", out_name);
+        if (use_records) {
+            printf("Running pass two: %s -> %s\n", tmp_name ? tmp_name : in_name, out_name);
+            opened = open_output(&dst, out_name);
+        } else {
+            printf("Running pass two: %s -> %s\n", tmp_name, out_name);
+            opened = open_files(&src, &dst, tmp_name, out_name);
+        }
+        trace_end("open files");
+        if (opened != 0) {
+            inst_list_free(&insts);
+            free_table(symtbl);
+            free_table(reltbl);
+            exit(1);
+        }
+
+        StatsTimer timer;
+        stats_begin(&timer);
+        trace_begin("pass_two", out_name);
+        ObjectWriter obj;
+        object_begin(&obj, dst, opts->format, opts->little_endian);
+        if (use_records) {
+            int status = opts->jobs > 1
+                ? pass_two_records_parallel(&insts, &obj, symtbl, reltbl, opts->jobs, stats)
+                : pass_two_records(&insts, &obj, symtbl, reltbl, stats);
+            if (status != 0) {
+                err = 1;
+            }
+        } else {
+            int status = opts->jobs > 1
+                ? pass_two_parallel(src, &obj, symtbl, reltbl, opts->jobs, stats)
+                : pass_two(src, &obj, symtbl, reltbl, stats);
+            if (status != 0) {
+                err = 1;
+            }
+            fclose(src);
+        }
+        trace_end("pass_two");
+        
+        if (object_finish(&obj, symtbl, reltbl) != 0) {
+            write_to_log("Error: unable to write output file: %s\n", out_name);
+            err = 1;
+        }
+        stats_end(stats, STATS_PASS_TWO, &timer);
+        count_output(stats, &obj, dst, symtbl, reltbl);
+
+        fclose(dst);
+    }
+    
+    inst_list_free(&insts);
+    free_table(symtbl);
+    free_table(reltbl);
+    return err;
+}
+
+/* Runs both passes on INPUT, handing the records of pass one straight to
+   pass two, and writes the program through OUTPUT, which is finished here.
+   If INTER is not NULL, the intermediate file is written to it as well.
+   SYMTBL, RELTBL and INSTS must be empty, and are left filled in so that the
+   caller can reset and reuse them. Unlike assemble(), nothing is printed
+   and no file is opened, so several threads can each run their own
+   assembly. If STATS is not NULL, the passes are timed and counted in it,
+   except for the bytes written, which only the caller knows.
+
+   Returns -1 if any error was found, 0 otherwise.
+ */
+int assemble_stream(FILE* input, OutBuf* inter, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, InstList* insts, const AsmOptions* opts, AsmStats* stats) {
+    int err = 0;
+
+    StatsTimer timer;
+    stats_begin(&timer);
+    trace_begin("pass_one", NULL);
+    int status = opts->jobs > 1
+        ? scan_source_parallel(input, inter, symtbl, insts, opts->jobs, stats)
+        : scan_source(input, inter, symtbl, insts, stats);
+    trace_end("pass_one");
+    stats_end(stats, STATS_PASS_ONE, &timer);
+    if (status != 0) {
+        err = -1;
+    }
+
+    stats_begin(&timer);
+    trace_begin("pass_two", NULL);
+    status = opts->jobs > 1
+        ? pass_two_records_parallel(insts, output, symtbl, reltbl, opts->jobs, stats)
+        : pass_two_records(insts, output, symtbl, reltbl, stats);
+    trace_end("pass_two");
+    if (status != 0) {
+        err = -1;
+    }
+    if (object_finish(output, symtbl, reltbl) != 0) {
+        err = -1;
+    }
+    stats_end(stats, STATS_PASS_TWO, &timer);
+    count_tables(stats, output, symtbl, reltbl);
+    return err;
+}
+
+/* Does the same as assemble_stream() with the single-pass assembler, which
+   gives the same program without any intermediate file.
+ */
+int single_pass_stream(FILE* input, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, AsmStats* stats) {
+    int err = 0;
+
+    StatsTimer timer;
+    stats_begin(&timer);
+    trace_begin("single_pass", NULL);
+    if (single_pass(input, output, symtbl, reltbl, stats) != 0) {
+        err = -1;
+    }
+    trace_end("single_pass");
+    if (object_finish(output, symtbl, reltbl) != 0) {
+        err = -1;
+    }
+    stats_end(stats, STATS_SINGLE_PASS, &timer);
+    count_tables(stats, output, symtbl, reltbl);
+    return err;
+}
+
+/*******************************
+ * Batch Mode
+ *******************************/
+
+/* One input/output pair of a batch manifest. */
+typedef struct {
+    const char* input;
+    const char* output;
+    int err;
+    OutBuf log;             // diagnostics logged while assembling this file
+} BatchFile;
+
+/* What one thread of a batch keeps between files, so that it is allocated
+   once rather than once per file.
+ */
+typedef struct {
+    SymbolTable* symtbl;
+    SymbolTable* reltbl;
+    InstList insts;
+} BatchWorker;
+
+typedef struct {
+    BatchFile* files;
+    BatchWorker* workers;
+    const AsmOptions* opts;
+} BatchJob;
+
+/* Stores the next whitespace-separated word of REST in WORD and advances
+   REST past it. Returns 0 if no word is left.
+ */
+static int next_word(Slice* rest, Slice* word) {
+    const char* p = rest->ptr;
+    const char* end = p + rest->len;
+
+    while (p < end && isspace((unsigned char) *p)) p++;
+    word->ptr = p;
+    while (p < end && !isspace((unsigned char) *p)) p++;
+    word->len = p - word->ptr;
+
+    rest->ptr = p;
+    rest->len = end - p;
+    return word->len > 0;
+}
+
+/* Reads the manifest MANIFEST_NAME, in which each line names an input file
+   and the output file to assemble it into. Blank lines and lines starting
+   with # are skipped. The file names are copied into NAMES.
+
+   Returns the number of files stored in FILES, or -1 if the manifest cannot
+   be read or a line does not name exactly two files.
+ */
+static int read_manifest(const char* manifest_name, BatchFile** files, Arena* names) {
+    FILE* manifest;
+    if (open_input(&manifest, manifest_name) != 0) {
+        return -1;
+    }
+    SourceReader reader;
+    if (reader_open(&reader, manifest) != 0) {
+        fclose(manifest);
+        return -1;
+    }
+
+    uint32_t n = 0, cap = 0;
+    uint32_t line_num = 0;
+    Slice line;
+    *files = NULL;
+
+    while (reader_next_line(&reader, &line)) {
+        Slice words[3];
+        line_num += 1;
+
+        if (!next_word(&line, &words[0]) || words[0].ptr[0] == '#') {
+            continue;
+        }
+        if (!next_word(&line, &words[1]) || next_word(&line, &words[2])) {
+            write_to_log("Error: expected an input and an output file at line %u of %s\n",
+                line_num, manifest_name);
+            free(*files);
+            *files = NULL;
+            reader_close(&reader);
+            fclose(manifest);
+            return -1;
+        }
+
+        if (n == cap) {
+            *files = grow_array(*files, &cap, sizeof(BatchFile));
+        }
+        BatchFile* file = &(*files)[n++];
+        memset(file, 0, sizeof(*file));
+        file->input = arena_strndup(names, words[0].ptr, words[0].len);
+        file->output = arena_strndup(names, words[1].ptr, words[1].len);
+    }
+
+    reader_close(&reader);
+    fclose(manifest);
+    return n;
+}
+
+/* Assembles FILE with both passes like assemble(), using the tables of
+   WORKER, but prints nothing and returns 1 rather than exiting if a file
+   cannot be opened.
+ */
+static int assemble_batch_file(BatchFile* file, BatchWorker* worker, const AsmOptions* opts) {
+    FILE *src, *dst;
+    int err = 0;
+
+    reset_table(worker->symtbl);
+    reset_table(worker->reltbl);
+    inst_list_clear(&worker->insts);
+
+    trace_begin("open files", file->input);
+    int opened = open_files(&src, &dst, file->input, file->output);
+    trace_end("open files");
+    if (opened != 0) {
+        return 1;
+    }
+    trace_begin("pass_one", NULL);
+    if (pass_one(src, NULL, worker->symtbl, &worker->insts, NULL) != 0) {
+        err = 1;
+    }
+    trace_end("pass_one");
+
+    trace_begin("pass_two", NULL);
+    ObjectWriter obj;
+    object_begin(&obj, dst, opts->format, opts->little_endian);
+    if (pass_two_records(&worker->insts, &obj, worker->symtbl, worker->reltbl, NULL) != 0) {
+        err = 1;
+    }
+    trace_end("pass_two");
+    if (object_finish(&obj, worker->symtbl, worker->reltbl) != 0) {
+        write_to_log("Error: unable to write output file: %s\n", file->output);
+        err = 1;
+    }
+
+    close_files(src, dst);
+    return err;
+}
+
+static void assemble_batch_task(void* arg, uint32_t worker, uint32_t task) {
+    BatchJob* job = (BatchJob*) arg;
+    BatchFile* file = &job->files[task];
+
+    trace_begin("assemble file", file->input);
+    outbuf_open_memory(&file->log);
+    OutBuf* previous = capture_log(&file->log);
+    file->err = assemble_batch_file(file, &job->workers[worker], job->opts);
+    capture_log(previous);
+    trace_end("assemble file");
+}
+
+/* Assembles every file named in the manifest MANIFEST_NAME on up to
+   OPTS->jobs threads, each file on a single thread. Threads that run out of
+   files take some from the others.
+
+   The diagnostics of each file are kept apart and logged in manifest order
+   once every file is done, each under the name of its file, followed by a
+   summary of which files failed. Returns 1 if any file failed, 0 otherwise.
+ */
+int assemble_batch(const char* manifest_name, const AsmOptions* opts) {
+    BatchFile* files;
+    Arena names;
+
+    arena_init(&names, 4096);
+    trace_begin("read manifest", manifest_name);
+    int n = read_manifest(manifest_name, &files, &names);
+    trace_end("read manifest");
+    if (n < 0) {
+        arena_free(&names);
+        return 1;
+    }
+
+    uint32_t num_workers = opts->jobs < n ? opts->jobs : n;
+    if (num_workers < 1) num_workers = 1;
+    BatchWorker* workers = (BatchWorker*) malloc(num_workers * sizeof(BatchWorker));
+    if (workers == NULL) allocation_failed();
+    for (uint32_t i = 0; i < num_workers; i++) {
+        workers[i].symtbl = create_table(SYMTBL_UNIQUE_NAME);
+        workers[i].reltbl = create_table(SYMTBL_NON_UNIQUE);
+        inst_list_init(&workers[i].insts);
+    }
+
+    printf("Running batch: %s (%d files)\n", manifest_name, n);
+    BatchJob job = { files, workers, opts };
+    run_worker_tasks(num_workers, n, assemble_batch_task, &job);
+
+    int failed = 0;
+    for (int i = 0; i < n; i++) {
+        if (files[i].log.len > 0) {
+            write_to_log("%s -> %s:\n%.*s", files[i].input, files[i].output,
+                (int) files[i].log.len, files[i].log.data);
+        }
+        outbuf_close(&files[i].log);
+        failed += files[i].err != 0;
+    }
+
+    printf("Batch summary: %d files, %d failed\n", n, failed);
+    for (int i = 0; i < n; i++) {
+        printf("  %-6s %s -> %s\n", files[i].err ? "FAILED" : "ok",
+            files[i].input, files[i].output);
+    }
+
+    for (uint32_t i = 0; i < num_workers; i++) {
+        free_table(workers[i].symtbl);
+        free_table(workers[i].reltbl);
+        inst_list_free(&workers[i].insts);
+    }
+    free(workers);
+    free(files);
+    arena_free(&names);
+    return failed > 0;
+}
+
+/*******************************
+ * Incremental Assembly
+ *******************************/
+
+/* How often a line hash occurs in the previous build and in the source. */
+typedef struct {
+    uint64_t hash;
+    uint32_t old_line;      // the last line of the previous build with the hash
+    uint32_t old_count, new_count;
+} HashCount;
+
+/* Returns the slot of HASH in TABLE, which has MASK + 1 slots, claiming an
+   empty one if the hash is not there yet.
+ */
+static HashCount* hash_count_slot(HashCount* table, uint32_t mask, uint64_t hash) {
+    uint32_t i = (uint32_t) (hash ^ (hash >> 32)) & mask;
+    while (table[i].old_count + table[i].new_count > 0 && table[i].hash != hash) {
+      i = (i + 1) & mask;
+    }
+    table[i].hash = hash;
+    return &table[i];
+}
+
+/* Pairs line I of the source with line OLD of the previous build. */
+typedef struct {
+    uint32_t line, old;
+} LineAnchor;
+
+/* Keeps the longest run of ANCHORS, which are in source order, whose old
+   lines are also in order, and returns how many are left. This is the
+   longest increasing subsequence of the old lines, found by patience
+   sorting.
+ */
+static uint32_t longest_anchor_run(LineAnchor* anchors, uint32_t n) {
+    uint32_t* tails = (uint32_t*) malloc((n ? n : 1) * sizeof(uint32_t));
+    uint32_t* prev = (uint32_t*) malloc((n ? n : 1) * sizeof(uint32_t));
+    if (tails == NULL || prev == NULL) allocation_failed();
+
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t lo = 0, hi = len;
+      while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (anchors[tails[mid]].old < anchors[i].old) lo = mid + 1;
+        else hi = mid;
+      }
+      prev[i] = lo > 0 ? tails[lo - 1] : STATE_NONE;
+      tails[lo] = i;
+      if (lo == len) len += 1;
+    }
+
+    //walk back from the end of the run, filling ANCHORS from the back
+    uint32_t k = len ? tails[len - 1] : STATE_NONE;
+    for (uint32_t i = len; i > 0; i--) {
+      anchors[i - 1] = anchors[k];
+      k = prev[k];
+    }
+    free(tails);
+    free(prev);
+    return len;
+}
+
+/* Finds the lines of the source whose hashes, in HASHES, match a line of the
+   previous build in STATE, and stores in SAME[i] which line of STATE line i
+   is, or STATE_NONE if it changed. Like patience diff, lines whose hash
+   occurs exactly once in both versions anchor the match, keeping the
+   longest run of them that is in the same order in both; each anchor, and
+   the start and end of the file, then matches as many equal lines before
+   and after it as it can. Only the lines left between anchors count as
+   changed. Returns how many lines were matched.
+ */
+static uint32_t match_lines(const BuildState* state, const uint64_t* hashes, uint32_t n,
+    uint32_t* same) {
+    uint32_t m = state->num_lines;
+    uint32_t matched = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+      same[i] = STATE_NONE;
+    }
+    if (m == 0 || n == 0) {
+      return 0;
+    }
+
+    uint32_t mask = 15;
+    while (mask < 2 * ((uint64_t) n + m)) {
+      mask = mask * 2 + 1;
+    }
+    HashCount* counts = (HashCount*) calloc((size_t) mask + 1, sizeof(HashCount));
+    if (counts == NULL) allocation_failed();
+    for (uint32_t o = 0; o < m; o++) {
+      HashCount* c = hash_count_slot(counts, mask, state->lines[o].hash);
+      c->old_line = o;
+      c->old_count += 1;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      hash_count_slot(counts, mask, hashes[i])->new_count += 1;
+    }
+
+    LineAnchor* anchors = (LineAnchor*) malloc((n + 2) * sizeof(LineAnchor));
+    if (anchors == NULL) allocation_failed();
+    uint32_t num_anchors = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      const HashCount* c = hash_count_slot(counts, mask, hashes[i]);
+      if (c->old_count == 1 && c->new_count == 1) {
+        anchors[num_anchors].line = i;
+        anchors[num_anchors].old = c->old_line;
+        num_anchors += 1;
+      }
+    }
+    free(counts);
+    num_anchors = longest_anchor_run(anchors, num_anchors);
+
+    //the start and end of the file anchor the lines before the first
+    //anchor and after the last one
+    memmove(anchors + 1, anchors, num_anchors * sizeof(LineAnchor));
+    anchors[0].line = anchors[0].old = STATE_NONE;
+    anchors[num_anchors + 1].line = n;
+    anchors[num_anchors + 1].old = m;
+    num_anchors += 2;
+
+    for (uint32_t a = 0; a + 1 < num_anchors; a++) {
+      //lines strictly between this anchor and the next one
+      uint32_t i = anchors[a].line + 1, o = anchors[a].old + 1;
+      uint32_t end = anchors[a + 1].line, old_end = anchors[a + 1].old;
+      if (a > 0) {
+        same[anchors[a].line] = anchors[a].old;
+        matched += 1;
+      }
+      while (i < end && o < old_end && state->lines[o].hash == hashes[i]) {
+        same[i++] = o++;
+        matched += 1;
+      }
+      while (end > i && old_end > o && state->lines[old_end - 1].hash == hashes[end - 1]) {
+        same[--end] = --old_end;
+        matched += 1;
+      }
+    }
+    free(anchors);
+    return matched;
+}
+
+/* Returns 1 if the records of line OLD of STATE, and its label, can be used. */
+static int valid_state_line(const BuildState* state, const StateLine* old) {
+    if (old->first_rec > state->num_recs || old->num_recs > state->num_recs - old->first_rec) {
+      return 0;
+    }
+    return old->label == STATE_NONE || state_string(state, old->label) != NULL;
+}
+
+/* Works out the word of a record of the previous build, which is at ADDR in
+   this one. A branch is only re-encoded if the distance to its label
+   changed, and a jump gets a new relocation entry. Returns 0 on success and
+   -1 if the label of a branch is missing or too far away.
+ */
+static int reuse_record(uint32_t* word, const BuildState* state, const StateRec* rec,
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl) {
+    const char* sym = state_string(state, rec->sym);
+
+    *word = rec->word;
+    if (rec->kind == STATE_PLAIN) {
+      return 0;
+    }
+    if (sym == NULL) {
+      return -1;
+    }
+    if (rec->kind == STATE_JUMP) {
+      add_to_table(reltbl, sym, addr);
+      return 0;
+    }
+
+    int64_t target = get_addr_for_symbol(symtbl, sym);
+    if (target == -1) return -1;
+    int64_t offset = (target - ((int64_t) addr + 4)) / 4;
+    if (check_num_bounds(offset, -32768, 65536) != 0) return -1;
+    if ((rec->word & 0xffff) != (offset & 0xffff)) {
+      *word = (rec->word & 0xffff0000) | (offset & 0xffff);
+    }
+    return 0;
+}
+
+/* Returns how the word of REC depends on the symbol table. */
+static uint32_t record_kind(const InstRecord* rec) {
+    switch (get_inst(rec->id)->format) {
+      case FMT_BRANCH:
+        return STATE_BRANCH;
+      case FMT_JUMP:
+        return STATE_JUMP;
+      default:
+        return STATE_PLAIN;
+    }
+}
+
+/* Assembles LINES, reusing what STATE remembers about the lines that did not
+   change, and stores the state of this build in NEXT. The labels of every
+   line go into SYMTBL in order, exactly as pass_one() adds them; then the
+   words of unchanged lines are taken from STATE and the records of changed
+   lines are encoded, at the same addresses pass_two_records() gives them.
+
+   Nothing is written or reported here: returns 0 on success and -1 if the
+   source has any error, which is left for a full build to report.
+ */
+static int assemble_lines(const Slice* lines, const uint64_t* hashes, const uint32_t* same,
+    uint32_t n, const BuildState* state, StateBuilder* next, SymbolTable* symtbl,
+    SymbolTable* reltbl, AsmStats* stats) {
+    InstList changed;
+    LineTokens toks = { NULL, 0 };
+    uint32_t byteOffset = 0;
+    int err = 0;
+
+    inst_list_init(&changed);
+
+    StatsTimer timer;
+    stats_begin(&timer);
+    trace_begin("pass_one", NULL);
+    for (uint32_t i = 0; i < n && err == 0; i++) {
+      if (same[i] != STATE_NONE) {
+        const StateLine* old = &state->lines[same[i]];
+        const char* label = state_string(state, old->label);
+        if (label && add_to_table(symtbl, label, byteOffset) != 0) {
+          err = -1;
+        }
+        state_add_line(next, hashes[i], label, label ? strlen(label) : 0, old->size);
+        byteOffset += old->size;
+        continue;
+      }
+
+      int status = parse_line(i + 1, lines[i], NULL, byteOffset, symtbl, &toks);
+      if (status == -1) {
+        err = -1;
+        break;
+      }
+      uint32_t size = 0;
+      if (status == 1) {
+        Expansion exp;
+        plan_expansion(&exp, toks.name, toks.args, toks.num_args);
+        size = exp.size;
+        count_expansion(stats, exp.desc, exp.count);
+        for (int k = 0; k < exp.count; k++) {
+          inst_list_add_expansion(&changed, &exp, k, i + 1);
+        }
+      }
+      state_add_line(next, hashes[i], toks.label.len > 0 ? toks.label.ptr : NULL,
+          toks.label.len, size);
+      byteOffset += size;
+    }
+    trace_end("pass_one");
+    stats_end(stats, STATS_PASS_ONE, &timer);
+    free_tokens(&toks);
+
+    stats_begin(&timer);
+    trace_begin("pass_two", NULL);
+    uint64_t lookups = get_lookup_count();
+    uint32_t cursor = 0;
+    for (uint32_t i = 0; i < n && err == 0; i++) {
+      StateLine* line = &next->lines[i];
+      line->first_rec = next->num_recs;
+
+      if (same[i] != STATE_NONE) {
+        const StateLine* old = &state->lines[same[i]];
+        for (uint32_t k = 0; k < old->num_recs && err == 0; k++) {
+          const StateRec* rec = &state->recs[old->first_rec + k];
+          uint32_t word;
+          if (reuse_record(&word, state, rec, 4 * next->num_recs, symtbl, reltbl) != 0) {
+            err = -1;
+            break;
+          }
+          state_add_rec(next, word, rec->kind, state_string(state, rec->sym));
+        }
+      } else {
+        while (cursor < changed.len && changed.recs[cursor].line == i + 1) {
+          const InstRecord* rec = &changed.recs[cursor++];
+          uint32_t word;
+          if (rec->id == INST_INVALID
+              || encode_record(&word, rec, 4 * next->num_recs, symtbl, reltbl) == -1) {
+            err = -1;
+            break;
+          }
+          state_add_rec(next, word, record_kind(rec), rec->sym);
+        }
+      }
+      line->num_recs = next->num_recs - line->first_rec;
+    }
+    if (stats) {
+      stats->lookups += get_lookup_count() - lookups;
+    }
+    trace_end("pass_two");
+    stats_end(stats, STATS_PASS_TWO, &timer);
+
+    inst_list_free(&changed);
+    return err;
+}
+
+/* Assembles IN_NAME into OUT_NAME like assemble(), using the state file
+   STATE_NAME left by the previous incremental build to skip the lines that
+   did not change since then. The output is the same as that of a clean
+   build. The state file is replaced by one describing this build; if it is
+   missing or unreadable, every line counts as changed.
+
+   A source with errors is handed to assemble() instead, so that they are
+   reported exactly as usual, and the state file is left alone.
+ */
+int assemble_incremental(const char* in_name, const char* out_name, const char* state_name,
+    const AsmOptions* opts, AsmStats* stats) {
+    FILE *src, *dst;
+    SourceReader reader;
+    BuildState state;
+    StateBuilder next;
+    int err = 0;
+
+    trace_begin("open files", in_name);
+    int opened = open_input(&src, in_name);
+    trace_end("open files");
+    if (opened != 0) {
+        exit(1);
+    }
+    if (reader_open(&reader, src) != 0) {
+        fclose(src);
+        return assemble(in_name, NULL, out_name, opts, stats);
+    }
+
+    Slice* lines = NULL;
+    uint64_t* hashes = NULL;
+    uint32_t n = 0, cap = 0, hash_cap = 0;
+    Slice line;
+    trace_begin("hash lines", in_name);
+    while (reader_next_line(&reader, &line)) {
+        if (n == cap) {
+            lines = (Slice*) grow_array(lines, &cap, sizeof(Slice));
+            hashes = (uint64_t*) grow_array(hashes, &hash_cap, sizeof(uint64_t));
+        }
+        lines[n] = line;
+        hashes[n] = hash_line(line.ptr, line.len);
+        n += 1;
+    }
+    trace_end("hash lines");
+
+    trace_begin("load state", state_name);
+    state_load(&state, state_name);
+    uint32_t* same = (uint32_t*) malloc((n ? n : 1) * sizeof(uint32_t));
+    if (same == NULL) allocation_failed();
+    uint32_t reused = match_lines(&state, hashes, n, same);
+    for (uint32_t i = 0; i < n; i++) {
+        if (same[i] != STATE_NONE && !valid_state_line(&state, &state.lines[same[i]])) {
+            same[i] = STATE_NONE;
+            reused -= 1;
+        }
+    }
+    trace_end("load state");
+
+    printf("Running incremental assembly: %s -> %s (%u of %u lines unchanged)\n",
+        in_name, out_name, reused, n);
+
+    AsmStats saved;
+    if (stats) {
+        saved = *stats;
+        stats->lines_read[STATS_PASS_ONE] += n;
+        stats->lines_reused += reused;
+    }
+
+    //errors are reported by the full build, not this attempt
+    OutBuf discarded;
+    outbuf_open_memory(&discarded);
+    OutBuf* previous = capture_log(&discarded);
+
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    state_builder_init(&next);
+    int status = assemble_lines(lines, hashes, same, n, &state, &next, symtbl, reltbl, stats);
+
+    capture_log(previous);
+    outbuf_close(&discarded);
+    state_unload(&state);
+    free(same);
+    free(hashes);
+    free(lines);
+    reader_close(&reader);
+    fclose(src);
+
+    if (status != 0) {
+        printf("Errors found, running a full build\n");
+        if (stats) {
+            *stats = saved;
+        }
+        state_builder_free(&next);
+        free_table(symtbl);
+        free_table(reltbl);
+        return assemble(in_name, NULL, out_name, opts, stats);
+    }
+
+    trace_begin("open files", out_name);
+    opened = open_output(&dst, out_name);
+    trace_end("open files");
+    if (opened != 0) {
+        state_builder_free(&next);
+        free_table(symtbl);
+        free_table(reltbl);
+        exit(1);
+    }
+
+    StatsTimer timer;
+    stats_begin(&timer);
+    ObjectWriter obj;
+    object_begin(&obj, dst, opts->format, opts->little_endian);
+    for (uint32_t i = 0; i < next.num_recs; i++) {
+        object_add_word(&obj, next.recs[i].word);
+    }
+    if (object_finish(&obj, symtbl, reltbl) != 0) {
+        write_to_log("Error: unable to write output file: %s\n", out_name);
+        err = 1;
+    }
+    stats_end(stats, STATS_PASS_TWO, &timer);
+    count_output(stats, &obj, dst, symtbl, reltbl);
+    fclose(dst);
+
+    trace_begin("save state", state_name);
+    if (err == 0 && state_save(&next, state_name) != 0) {
+        write_to_log("Error: unable to write state file: %s\n", state_name);
+        err = 1;
+    }
+    trace_end("save state");
+
+    state_builder_free(&next);
+    free_table(symtbl);
+    free_table(reltbl);
+    return err;
+}
+
+/* Loads the text output of the assembler from IN_NAME and runs it until it
+   halts, faults or has run MAX_STEPS instructions (no limit if 0), then
+   prints its registers and how fast it ran. Loading and decoding the
+   program are not part of the timing.
+
+   Returns 0 if the program halted and 1 otherwise.
+ */
+int run_object(const char* in_name, uint64_t max_steps) {
+    FILE* input = fopen(in_name, "r");
+    if (!input) {
+        write_to_log("Error: unable to open input file: %s\n", in_name);
+        return 1;
+    }
+    Machine m;
+    int err = sim_load(&m, input, SIM_MEMORY_SIZE);
+    fclose(input);
+    if (err) {
+        return 1;
+    }
+
+    printf("Running %s\n", in_name);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    SimStatus status = sim_run(&m, max_steps);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (status == SIM_STEP_LIMIT) {
+        printf("Stopped after %llu instructions\n", (unsigned long long) m.steps);
+    }
+    sim_print_registers(stdout, &m);
+    printf("Ran %llu instructions in %.3f s (%.1f million instructions/s)\n",
+        (unsigned long long) m.steps, seconds, seconds > 0 ? m.steps / seconds / 1e6 : 0.0);
+
+    sim_free(&m);
+    return status == SIM_HALTED ? 0 : 1;
+}
+
+#ifndef ASSEMBLER_NO_MAIN
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  Runs both passes: assembler <input file> [<intermediate file>] <output file>\n");
+    printf("  Run pass #1:      assembler -p1 <input file> <intermediate file>\n");
+    printf("  Run pass #2:      assembler -p2 <intermediate file> <output file>\n");
+    printf("  Run single pass:  assembler -single <input file> <output file>\n");
+    printf("  Run a batch:      assembler -batch <manifest file>\n");
+    printf("  Run a server:     assembler -serve <socket file>\n");
+    printf("  Run a program:    assembler -run <object file>\n");
+    printf("Each line of a manifest names an input file and its output file.\n");
+    printf("A server assembles the requests of assembler-client on a Unix domain socket,\n");
+    printf("each in the format it asks for, until it gets SIGINT or SIGTERM.\n");
+    printf("A program runs from the text output of the assembler until it returns or runs\n");
+    printf("off the end of its code; append -steps <count> to stop it sooner.\n");
+    printf("Append -log <file name> after any option to save log files to a text file.\n");
+    printf("Append -fmt text|bin|elf to choose the output format (text by default), and\n");
+    printf("-EB or -EL to write bin and elf output big-endian (default) or little-endian.\n");
+    printf("Append -j <threads> to run both passes, the files of a batch, or the requests\n");
+    printf("to a server on several threads (a server uses one per processor by default).\n");
+    printf("Append -stats to print statistics of the run, or -stats-json <file name> to\n");
+    printf("save them as JSON (not with -batch, -serve or -run).\n");
+    printf("Append -trace <file name> to save a timeline of the run in Chrome trace format\n");
+    printf("(not with -serve or -run).\n");
+    printf("Append -incremental <state file> when running both passes without an\n");
+    printf("intermediate file to only reassemble the lines changed since the last run.\n");
+    exit(0);
+}
+
+/* Sends a line of diagnostics from libmipsasm to the log file USER, or to
+   stderr if there is none.
+ */
+static void log_diagnostic(void* user, const char* message) {
+    OutBuf* log = (OutBuf*) user;
+    if (log) {
+        outbuf_puts(log, message);
+        outbuf_putc(log, '\n');
+    } else {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+
+/* Writes the LEN bytes at DATA to FILE and closes it. Returns -1 if any of it
+   could not be written.
+ */
+static int write_and_close(FILE* file, const char* data, size_t len) {
+    int err = fwrite(data, 1, len, file) == len ? 0 : -1;
+    if (fclose(file) != 0) {
+        err = -1;
+    }
+    return err;
+}
+
+/* Assembles IN_NAME into OUT_NAME with libmipsasm, with the two passes or, if
+   SINGLE is set, the single pass. The intermediate file of the two passes is
+   also written to TMP_NAME, unless it is NULL. Diagnostics are written to LOG,
+   or to stderr if it is NULL. Like assemble(), this exits if a file cannot
+   be opened.
+ */
+static int assemble_files(const char* in_name, const char* tmp_name, const char* out_name,
+    int single, const AsmOptions* opts, OutBuf* log, AsmStats* stats) {
+    FILE *src, *inter = NULL, *dst;
+    int err = 0;
+
+    if (single) {
+        printf("Running single pass: %s -> %s\n", in_name, out_name);
+    } else if (tmp_name) {
+        printf("Running pass one: %s -> %s\n", in_name, tmp_name);
+    } else {
+        printf("Running pass one: %s\n", in_name);
+    }
+    trace_begin("open files", in_name);
+    int opened = tmp_name ? open_files(&src, &inter, in_name, tmp_name) : open_input(&src, in_name);
+    trace_end("open files");
+    if (opened != 0) {
+        exit(1);
+    }
+
+    SourceReader reader;
+    if (reader_open(&reader, src) != 0) {
+        write_to_log("Error: unable to read input file: %s\n", in_name);
+        err = 1;
+    }
+    fclose(src);
+
+    MipsAsmContext* ctx = mips_context_create();
+    if (ctx == NULL) allocation_failed();
+    switch (opts->format) {
+        case OUTPUT_BIN: mips_set_format(ctx, MIPSASM_BIN); break;
+        case OUTPUT_ELF: mips_set_format(ctx, MIPSASM_ELF); break;
+        default:         mips_set_format(ctx, MIPSASM_TEXT); break;
+    }
+    mips_set_little_endian(ctx, opts->little_endian);
+    mips_set_jobs(ctx, opts->jobs);
+    mips_set_single_pass(ctx, single);
+    mips_set_keep_intermediate(ctx, inter != NULL);
+    mips_set_output_on_error(ctx, 1);
+    mips_set_diagnostics(ctx, log_diagnostic, log);
+    mips_context_set_stats(ctx, stats);
+
+    char* out;
+    size_t out_len;
+    if (mips_assemble_buffer(ctx, reader.data, reader.size, &out, &out_len) != 0) {
+        err = 1;
+    }
+    reader_close(&reader);
+
+    if (inter) {
+        size_t len;
+        const char* text = mips_intermediate(ctx, &len);
+        if (write_and_close(inter, text, len) != 0) {
+            write_to_log("Error: unable to write intermediate file: %s\n", tmp_name);
+            err = 1;
+        }
+        if (stats) stats->bytes_written += len;
+    }
+    mips_context_free(ctx);
+
+    if (!single) {
+        printf("Running pass two: %s -> %s\n", tmp_name ? tmp_name : in_name, out_name);
+    }
+    trace_begin("open files", out_name);
+    opened = open_output(&dst, out_name);
+    trace_end("open files");
+    if (opened != 0) {
+        free(out);
+        exit(1);
+    }
+    if (write_and_close(dst, out, out_len) != 0) {
+        write_to_log("Error: unable to write output file: %s\n", out_name);
+        err = 1;
+    }
+    if (stats) stats->bytes_written += out_len;
+    free(out);
+    return err;
+}
+
+int main(int argc, char **argv) {
+    int mode = 0;
+    char* files[3];
+    int num_files = 0;
+    char* log_name = NULL;
+    AsmOptions opts = { OUTPUT_TEXT, 0, 1 };
+    int fmt_given = 0;
+    int jobs_given = 0;
+    int print_stats_wanted = 0;
+    char* stats_name = NULL;
+    char* trace_name = NULL;
+    char* state_name = NULL;
+    long long max_steps = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i == 1 && strcmp(argv[i], "-p1") == 0) {
+            mode = 1;
+        } else if (i == 1 && strcmp(argv[i], "-p2") == 0) {
+            mode = 2;
+        } else if (i == 1 && strcmp(argv[i], "-single") == 0) {
+            mode = 3;
+        } else if (i == 1 && strcmp(argv[i], "-batch") == 0 && i + 1 < argc) {
+            mode = 4;
+            files[num_files++] = argv[++i];
+        } else if (i == 1 && strcmp(argv[i], "-serve") == 0 && i + 1 < argc) {
+            mode = 5;
+            files[num_files++] = argv[++i];
+        } else if (i == 1 && strcmp(argv[i], "-run") == 0 && i + 1 < argc) {
+            mode = 6;
+            files[num_files++] = argv[++i];
+        } else if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc) {
+            char* end;
+            max_steps = strtoll(argv[++i], &end, 10);
+            if (*end != '\0' || max_steps < 1) {
+                print_usage_and_exit();
+            }
+        } else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc) {
+            log_name = argv[++i];
+        } else if (strcmp(argv[i], "-fmt") == 0 && i + 1 < argc) {
+            if (parse_output_format(&opts.format, argv[++i]) != 0) {
+                print_usage_and_exit();
+            }
+            fmt_given = 1;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            char* end;
+            long jobs = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || jobs < 1 || jobs > 1024) {
+                print_usage_and_exit();
+            }
+            opts.jobs = jobs;
+            jobs_given = 1;
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            print_stats_wanted = 1;
+        } else if (strcmp(argv[i], "-stats-json") == 0 && i + 1 < argc) {
+            stats_name = argv[++i];
+        } else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+            trace_name = argv[++i];
+        } else if (strcmp(argv[i], "-incremental") == 0 && i + 1 < argc) {
+            state_name = argv[++i];
+        } else if (strcmp(argv[i], "-EB") == 0) {
+            opts.little_endian = 0;
+        } else if (strcmp(argv[i], "-EL") == 0) {
+            opts.little_endian = 1;
+        } else if (argv[i][0] == '-' || num_files == 3) {
+            print_usage_and_exit();
+        } else {
+            files[num_files++] = argv[i];
+        }
+    }
+
+    char *input = NULL, *inter = NULL, *output = NULL;
+    if (mode == 1 && num_files == 2 && !fmt_given) {
+        input = files[0];
+        inter = files[1];
+    } else if (mode == 2 && num_files == 2) {
+        inter = files[0];
+        output = files[1];
+    } else if (mode == 3 && num_files == 2) {
+        input = files[0];
+        output = files[1];
+    } else if (mode == 4 && num_files == 1) {
+        input = files[0];
+    } else if (mode == 5 && num_files == 1 && !fmt_given) {
+        input = files[0];
+    } else if (mode == 6 && num_files == 1 && !fmt_given && !jobs_given) {
+        input = files[0];
+    } else if (mode == 0 && num_files == 3) {
+        input = files[0];
+        inter = files[1];
+        output = files[2];
+    } else if (mode == 0 && num_files == 2) {
+        input = files[0];
+        output = files[1];
+    } else {
+        print_usage_and_exit();
+    }
+    if ((mode >= 4 && (print_stats_wanted || stats_name)) || (mode >= 5 && trace_name)) {
+        print_usage_and_exit();
+    }
+    if (state_name && (mode != 0 || inter)) {
+        print_usage_and_exit();
+    }
+    if (max_steps && mode != 6) {
+        print_usage_and_exit();
+    }
+
+    //everything main logs goes to the log file, which is flushed at exit
+    OutBuf log;
+    OutBuf* logp = NULL;
+    if (log_name && open_log_file(&log, log_name) == 0) {
+        logp = &log;
+        capture_log(logp);
+        atexit(flush_log);
+    }
+
+    if (mode == 5 || mode == 6) {
+        int err;
+        if (mode == 5) {
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            int workers = jobs_given ? opts.jobs : (cpus < 1 ? 1 : cpus > 1024 ? 1024 : (int) cpus);
+            err = serve(input, workers);
+        } else {
+            err = run_object(input, max_steps);
+        }
+        if (logp) {
+            capture_log(NULL);
+            close_log_file(logp);
+        }
+        return err;
+    }
+
+    AsmStats stats;
+    AsmStats* statsp = print_stats_wanted || stats_name ? &stats : NULL;
+    memset(&stats, 0, sizeof(stats));
+
+    if (trace_name) {
+        trace_start();
+    }
+
+    int err;
+    if (mode == 3) {
+        err = assemble_files(input, NULL, output, 1, &opts, logp, statsp);
+    } else if (mode == 4) {
+        err = assemble_batch(input, &opts);
+    } else if (state_name) {
+        err = assemble_incremental(input, output, state_name, &opts, statsp);
+    } else if (mode == 0) {
+        err = assemble_files(input, inter, output, 0, &opts, logp, statsp);
+    } else {
+        err = assemble(input, inter, output, &opts, statsp);
+    }
+
+    if (trace_name && trace_finish(trace_name) != 0) {
+        write_to_log("Error: unable to write trace file: %s\n", trace_name);
+        err = 1;
+    }
+
+    if (err) {
+        write_to_log("One or more errors encountered during assembly operation.\n");
+    } else {
+        write_to_log("Assembly operation completed successfully.\n");
+    }
+
+    if (logp) {
+        printf("Results saved to %s\n", log_name);
+    }
+
+    if (statsp) {
+        stats_finish(&stats);
+        if (print_stats_wanted) {
+            print_stats(stdout, &stats);
+        }
+        if (stats_name) {
+            FILE* stats_file = fopen(stats_name, "w");
+            if (stats_file) {
+                write_stats_json(stats_file, &stats);
+                fclose(stats_file);
+            } else {
+                write_to_log("Error: unable to open statistics file: %s\n", stats_name);
+                err = 1;
+            }
+        }
+    }
+
+    if (logp) {
+        capture_log(NULL);
+        close_log_file(logp);
+    }
     return err;
 }
+#endif
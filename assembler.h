@@ -1,10 +1,52 @@
-#ifndef ASSEMBLER_H
-#define ASSEMBLER_H
-
-int assemble(const char* in_name, const char* tmp_name, const char* out_name);
-
-int pass_one(FILE *input, FILE* output, SymbolTable* symtbl);
-
-int pass_two(FILE *input, FILE* output, SymbolTable* symtbl, SymbolTable* reltbl);
-
-#endif
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+/* Settings given on the command line that affect how files are assembled. */
+typedef struct {
+    OutputFormat format;
+    int little_endian;      // byte order of bin and elf output
+    int jobs;               // threads used by the passes, or by a batch
+} AsmOptions;
+
+int assemble(const char* in_name, const char* tmp_name, const char* out_name,
+    const AsmOptions* opts, AsmStats* stats);
+
+int pass_one(FILE *input, FILE* output, SymbolTable* symtbl, InstList* insts,
+    AsmStats* stats);
+
+int pass_one_parallel(FILE* input, FILE* output, SymbolTable* symtbl, InstList* insts,
+    int jobs, AsmStats* stats);
+
+int pass_two(FILE *input, ObjectWriter* output, SymbolTable* symtbl, SymbolTable* reltbl,
+    AsmStats* stats);
+
+int pass_two_records(const InstList* insts, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, AsmStats* stats);
+
+int pass_two_parallel(FILE* input, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, int jobs, AsmStats* stats);
+
+int pass_two_records_parallel(const InstList* insts, ObjectWriter* output,
+    SymbolTable* symtbl, SymbolTable* reltbl, int jobs, AsmStats* stats);
+
+int assemble_stream(FILE* input, OutBuf* inter, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, InstList* insts, const AsmOptions* opts, AsmStats* stats);
+
+int single_pass_stream(FILE* input, ObjectWriter* output, SymbolTable* symtbl,
+    SymbolTable* reltbl, AsmStats* stats);
+
+int assemble_incremental(const char* in_name, const char* out_name, const char* state_name,
+    const AsmOptions* opts, AsmStats* stats);
+
+int assemble_batch(const char* manifest_name, const AsmOptions* opts);
+
+int run_object(const char* in_name, uint64_t max_steps);
+
+int single_pass(FILE *input, ObjectWriter* output, SymbolTable* symtbl, SymbolTable* reltbl,
+    AsmStats* stats);
+
+struct MipsAsmContext;
+
+void mips_context_set_stats(struct MipsAsmContext* ctx, AsmStats* stats);
+
+#endif
@@ -0,0 +1,463 @@
+#include <limits.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/reader.h"
+#include "src/object.h"
+#include "src/stats.h"
+#include "src/translate.h"
+#include "assembler.h"
+
+const char* BENCH_INPUT = "bench_input.s";
+const char* BENCH_INTER = "bench_inter.txt";
+const char* BENCH_OUTPUT = "bench_output.txt";
+
+/* Each measurement is repeated until it has taken this long in total, and
+   the fastest run is reported.
+ */
+#define MIN_BENCH_SECONDS 0.5
+
+/* Farthest a generated branch may reach, in lines. Even if every line in
+   between expands to two instructions, the offset stays far inside the 16
+   bits of a branch.
+ */
+#define MAX_BRANCH_LINES 8000
+
+/****************************************
+ *  Program generator
+ ****************************************/
+
+/* Shape of a generated program. */
+typedef struct {
+    uint32_t lines;             // lines, each holding one instruction
+    double label_density;       // fraction of lines that start with a label
+    double pseudo_ratio;        // fraction of instructions that are li or blt
+    double branch_ratio;        // fraction of instructions that are branches or jumps
+    uint32_t branch_distance;   // mean distance from a branch to its target, in lines
+    double comment_ratio;       // fraction of lines with a trailing comment
+    uint64_t seed;
+} GenParams;
+
+static const GenParams DEFAULT_PARAMS = { 0, 0.1, 0.1, 0.15, 32, 0.2, 1 };
+
+static const char* REGS[] = {
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7", "$s0", "$s1",
+    "$s2", "$a0", "$a1", "$a2", "$v0", "$v1", "$sp", "$ra", "$0", "$8"
+};
+#define NUM_REGS (sizeof(REGS) / sizeof(REGS[0]))
+
+static uint64_t rng_state;
+
+/* xorshift64*, so that a seed gives the same program everywhere. */
+static uint64_t next_random() {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static double random_unit() {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t random_below(uint32_t n) {
+    return (uint32_t) ((next_random() >> 32) * n >> 32);
+}
+
+static const char* random_reg() {
+    return REGS[random_below(NUM_REGS)];
+}
+
+/* Returns the position in LABELS of the label nearest to line TARGET at or
+   after it, or of the last label if there is none after it.
+ */
+static uint32_t find_label(const uint32_t* labels, uint32_t num_labels, int64_t target) {
+    uint32_t lo = 0, hi = num_labels;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (labels[mid] < target) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < num_labels ? lo : num_labels - 1;
+}
+
+/* Picks the target of a branch on line LINE. Distances follow an exponential
+   distribution around PARAMS->branch_distance, in either direction. Writes
+   the name of the label to NAME and returns its distance in lines.
+ */
+static int64_t pick_target(char* name, const uint32_t* labels, uint32_t num_labels,
+    uint32_t line, const GenParams* params) {
+    double u = random_unit();
+    int64_t dist = (int64_t) (-(double) params->branch_distance * log1p(-u)) + 1;
+    if (dist > MAX_BRANCH_LINES) dist = MAX_BRANCH_LINES;
+    if (next_random() & 1) dist = -dist;
+
+    uint32_t label = find_label(labels, num_labels, (int64_t) line + dist);
+    sprintf(name, "L%u", label);
+    return (int64_t) labels[label] - line;
+}
+
+/* Writes a program shaped by PARAMS to OUTPUT. Every instruction is valid and
+   every branch reaches a label, so the program assembles without errors.
+ */
+static void generate_program(FILE* output, const GenParams* params) {
+    rng_state = params->seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    //the first line always has a label, so every branch has a target
+    uint32_t num_labels = 0, label_cap = 1024;
+    uint32_t* labels = (uint32_t*) malloc(label_cap * sizeof(uint32_t));
+    if (labels == NULL) allocation_failed();
+    for (uint32_t i = 0; i < params->lines; i++) {
+        if (i == 0 || random_unit() < params->label_density) {
+            if (num_labels == label_cap) {
+                label_cap *= 2;
+                labels = (uint32_t*) realloc(labels, label_cap * sizeof(uint32_t));
+                if (labels == NULL) allocation_failed();
+            }
+            labels[num_labels++] = i;
+        }
+    }
+
+    uint32_t next_label = 0;
+    char target[16];
+    for (uint32_t i = 0; i < params->lines; i++) {
+        if (next_label < num_labels && labels[next_label] == i) {
+            fprintf(output, "L%u:", next_label++);
+        }
+        fputc('\t', output);
+
+        double kind = random_unit();
+        if (kind < params->pseudo_ratio / 2) {
+            if (next_random() & 1) {
+                fprintf(output, "li %s, %u", random_reg(), random_below(1000));
+            } else {
+                fprintf(output, "li %s, 0x%x", random_reg(), 0x10000 + random_below(0x7fff0000));
+            }
+        } else if (kind < params->pseudo_ratio) {
+            int64_t dist = pick_target(target, labels, num_labels, i, params);
+            if (dist > MAX_BRANCH_LINES || dist < -MAX_BRANCH_LINES) {
+                fprintf(output, "j %s", target);
+            } else {
+                fprintf(output, "blt %s, %s, %s", random_reg(), random_reg(), target);
+            }
+        } else if (kind < params->pseudo_ratio + params->branch_ratio) {
+            int64_t dist = pick_target(target, labels, num_labels, i, params);
+            uint32_t op = random_below(4);
+            if (op >= 2 || dist > MAX_BRANCH_LINES || dist < -MAX_BRANCH_LINES) {
+                fprintf(output, "%s %s", op == 3 ? "jal" : "j", target);
+            } else {
+                fprintf(output, "%s %s, %s, %s", op == 0 ? "beq" : "bne", random_reg(),
+                    random_reg(), target);
+            }
+        } else {
+            switch (random_below(8)) {
+            case 0:
+                fprintf(output, "addu %s, %s, %s", random_reg(), random_reg(), random_reg());
+                break;
+            case 1:
+                fprintf(output, "%s %s, %s, %s", next_random() & 1 ? "slt" : "sltu",
+                    random_reg(), random_reg(), random_reg());
+                break;
+            case 2:
+                fprintf(output, "or %s, %s, %s", random_reg(), random_reg(), random_reg());
+                break;
+            case 3:
+                fprintf(output, "sll %s, %s, %u", random_reg(), random_reg(), random_below(32));
+                break;
+            case 4:
+                fprintf(output, "addiu %s, %s, %d", random_reg(), random_reg(),
+                    (int) random_below(512) - 256);
+                break;
+            case 5:
+                if (next_random() & 1) {
+                    fprintf(output, "ori %s, %s, 0x%x", random_reg(), random_reg(),
+                        random_below(0x10000));
+                } else {
+                    fprintf(output, "lui %s, 0x%x", random_reg(), random_below(0x10000));
+                }
+                break;
+            case 6:
+                fprintf(output, "%s %s, %u(%s)", next_random() & 1 ? "lw" : "lbu",
+                    random_reg(), 4 * random_below(64), random_reg());
+                break;
+            default:
+                fprintf(output, "%s %s, %u(%s)", next_random() & 1 ? "sw" : "sb",
+                    random_reg(), 4 * random_below(64), random_reg());
+                break;
+            }
+        }
+
+        if (random_unit() < params->comment_ratio) {
+            fputs("\t\t# generated comment, with (punctuation)", output);
+        }
+        fputc('\n', output);
+    }
+    free(labels);
+}
+
+/****************************************
+ *  Harness
+ ****************************************/
+
+/* Best time of each measurement for one program size, in seconds. */
+typedef struct {
+    double pass_one;
+    double pass_two;
+    double assemble;
+} BenchTimes;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static FILE* open_or_die(const char* name, const char* mode) {
+    FILE* file = fopen(name, mode);
+    if (!file) {
+        fprintf(stderr, "Error: unable to open %s\n", name);
+        exit(1);
+    }
+    return file;
+}
+
+/* Runs pass one from the input into the intermediate file, starting from an
+   empty SYMTBL. Returns how long it took.
+ */
+static double time_pass_one(SymbolTable* symtbl, const AsmOptions* opts) {
+    FILE* src = open_or_die(BENCH_INPUT, "r");
+    FILE* dst = open_or_die(BENCH_INTER, "w");
+    reset_table(symtbl);
+
+    double start = now();
+    int err = opts->jobs > 1
+        ? pass_one_parallel(src, dst, symtbl, NULL, opts->jobs, NULL)
+        : pass_one(src, dst, symtbl, NULL, NULL);
+    if (err != 0) {
+        fprintf(stderr, "Error: pass one failed on the generated program\n");
+        exit(1);
+    }
+    fflush(dst);
+    double time = now() - start;
+
+    fclose(src);
+    fclose(dst);
+    return time;
+}
+
+/* Runs pass two from the intermediate file, with the labels SYMTBL got
+   from pass one. Returns how long it took.
+ */
+static double time_pass_two(SymbolTable* symtbl, SymbolTable* reltbl, const AsmOptions* opts) {
+    FILE* src = open_or_die(BENCH_INTER, "r");
+    FILE* dst = open_or_die(BENCH_OUTPUT, "w");
+    reset_table(reltbl);
+
+    double start = now();
+    ObjectWriter obj;
+    object_begin(&obj, dst, opts->format, opts->little_endian);
+    int err = opts->jobs > 1
+        ? pass_two_parallel(src, &obj, symtbl, reltbl, opts->jobs, NULL)
+        : pass_two(src, &obj, symtbl, reltbl, NULL);
+    if (object_finish(&obj, symtbl, reltbl) != 0 || err != 0) {
+        fprintf(stderr, "Error: pass two failed on the generated program\n");
+        exit(1);
+    }
+    double time = now() - start;
+
+    fclose(src);
+    fclose(dst);
+    return time;
+}
+
+static double time_assemble(const AsmOptions* opts) {
+    double start = now();
+    if (assemble(BENCH_INPUT, NULL, BENCH_OUTPUT, opts, NULL) != 0) {
+        fprintf(stderr, "Error: assembly failed on the generated program\n");
+        exit(1);
+    }
+    return now() - start;
+}
+
+/* Measures the generated program in the benchmark input file, on as many
+   threads as OPTS asks for.
+ */
+static BenchTimes measure(const AsmOptions* opts) {
+    BenchTimes best = { 1e30, 1e30, 1e30 };
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+
+    double total = 0;
+    while (total < MIN_BENCH_SECONDS) {
+        double t1 = time_pass_one(symtbl, opts);
+        double t2 = time_pass_two(symtbl, reltbl, opts);
+        if (t1 < best.pass_one) best.pass_one = t1;
+        if (t2 < best.pass_two) best.pass_two = t2;
+        total += t1 + t2;
+    }
+
+    total = 0;
+    while (total < MIN_BENCH_SECONDS) {
+        double t = time_assemble(opts);
+        if (t < best.assemble) best.assemble = t;
+        total += t;
+    }
+
+    free_table(symtbl);
+    free_table(reltbl);
+    return best;
+}
+
+/* Measures one program size in a child process, so that the peak resident
+   set size reported for it is its own. Returns 0 on success.
+ */
+static int bench_size(const GenParams* params, const AsmOptions* opts) {
+    FILE* input = open_or_die(BENCH_INPUT, "w");
+    generate_program(input, params);
+    fclose(input);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        //assemble() reports its progress on stdout
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+        close(fds[0]);
+        BenchTimes times = measure(opts);
+        if (write(fds[1], &times, sizeof(times)) != sizeof(times)) _exit(1);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    BenchTimes times;
+    ssize_t got = read(fds[0], &times, sizeof(times));
+    close(fds[0]);
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0 || got != sizeof(times)) {
+        fprintf(stderr, "Error: benchmark of %u lines failed\n", params->lines);
+        return -1;
+    }
+
+    double lines = params->lines;
+    printf("%10u %14.0f %14.0f %14.0f %12.1f\n", params->lines, lines / times.pass_one,
+        lines / times.pass_two, lines / times.assemble, usage.ru_maxrss / 1024.0);
+    return 0;
+}
+
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  Run the benchmarks:    bench-assembler [-max <lines>] [-j <threads>] [options]\n");
+    printf("  Generate one program:  bench-assembler -gen <lines> [options]\n");
+    printf("Options shaping the generated programs:\n");
+    printf("  -labels <fraction>     lines that start with a label (default %.2f)\n",
+        DEFAULT_PARAMS.label_density);
+    printf("  -pseudo <fraction>     instructions that are li or blt (default %.2f)\n",
+        DEFAULT_PARAMS.pseudo_ratio);
+    printf("  -branches <fraction>   instructions that are branches or jumps (default %.2f)\n",
+        DEFAULT_PARAMS.branch_ratio);
+    printf("  -distance <lines>      mean distance to a branch target (default %u)\n",
+        DEFAULT_PARAMS.branch_distance);
+    printf("  -comments <fraction>   lines with a trailing comment (default %.2f)\n",
+        DEFAULT_PARAMS.comment_ratio);
+    printf("  -seed <number>         seed of the generator (default %llu)\n",
+        (unsigned long long) DEFAULT_PARAMS.seed);
+    exit(0);
+}
+
+static double parse_fraction(const char* str) {
+    char* end;
+    double value = strtod(str, &end);
+    if (*end != '\0' || !(value >= 0 && value <= 1)) {
+        print_usage_and_exit();
+    }
+    return value;
+}
+
+static unsigned long parse_count(const char* str, unsigned long min, unsigned long max) {
+    char* end;
+    unsigned long value = strtoul(str, &end, 10);
+    if (*end != '\0' || value < min || value > max) {
+        print_usage_and_exit();
+    }
+    return value;
+}
+
+int main(int argc, char** argv) {
+    GenParams params = DEFAULT_PARAMS;
+    AsmOptions opts = { OUTPUT_TEXT, 0, 1 };
+    uint32_t max_lines = 10000000;
+    uint32_t gen_lines = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 == argc) {
+            print_usage_and_exit();
+        } else if (strcmp(argv[i], "-gen") == 0) {
+            gen_lines = parse_count(argv[++i], 1, UINT32_MAX / 2);
+        } else if (strcmp(argv[i], "-max") == 0) {
+            max_lines = parse_count(argv[++i], 1000, UINT32_MAX / 2);
+        } else if (strcmp(argv[i], "-j") == 0) {
+            opts.jobs = parse_count(argv[++i], 1, 1024);
+        } else if (strcmp(argv[i], "-labels") == 0) {
+            params.label_density = parse_fraction(argv[++i]);
+        } else if (strcmp(argv[i], "-pseudo") == 0) {
+            params.pseudo_ratio = parse_fraction(argv[++i]);
+        } else if (strcmp(argv[i], "-branches") == 0) {
+            params.branch_ratio = parse_fraction(argv[++i]);
+        } else if (strcmp(argv[i], "-distance") == 0) {
+            params.branch_distance = parse_count(argv[++i], 1, MAX_BRANCH_LINES);
+        } else if (strcmp(argv[i], "-comments") == 0) {
+            params.comment_ratio = parse_fraction(argv[++i]);
+        } else if (strcmp(argv[i], "-seed") == 0) {
+            params.seed = parse_count(argv[++i], 0, ULONG_MAX);
+        } else {
+            print_usage_and_exit();
+        }
+    }
+    if (params.pseudo_ratio + params.branch_ratio > 1) {
+        print_usage_and_exit();
+    }
+
+    if (gen_lines > 0) {
+        params.lines = gen_lines;
+        generate_program(stdout, &params);
+        return 0;
+    }
+
+    printf("%10s %14s %14s %14s %12s\n", "lines", "pass_one l/s", "pass_two l/s",
+        "assemble l/s", "peak RSS MB");
+    int err = 0;
+    for (uint32_t lines = 1000; lines <= max_lines && err == 0; lines *= 10) {
+        params.lines = lines;
+        err = bench_size(&params, &opts);
+    }
+
+    unlink(BENCH_INPUT);
+    unlink(BENCH_INTER);
+    unlink(BENCH_OUTPUT);
+    return err ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/* Sends a source file to a running assembler -serve and saves the output it
+   returns. With -n, the same request is sent that many times over one
+   connection, and the requests answered per second are printed.
+ */
+
+static void print_usage_and_exit() {
+    printf("Usage:\n");
+    printf("  assembler-client <socket file> <input file> <output file>\n");
+    printf("Append -fmt text|bin|elf to choose the output format (text by default), and\n");
+    printf("-EL to write bin and elf output little-endian.\n");
+    printf("Append -n <requests> to send the request several times and time them.\n");
+    exit(0);
+}
+
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, data, len);
+        if (n <= 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static char* read_file(const char* name, size_t* len) {
+    FILE* f = fopen(name, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* data = (char*) malloc(size > 0 ? size : 1);
+    if (!data || fread(data, 1, size, f) != (size_t) size) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+static int connect_to(const char* socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char** argv) {
+    char* files[3];
+    int num_files = 0;
+    uint32_t format = 0, flags = 0;
+    long requests = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-fmt") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "text") == 0) format = 0;
+            else if (strcmp(argv[i], "bin") == 0) format = 1;
+            else if (strcmp(argv[i], "elf") == 0) format = 2;
+            else print_usage_and_exit();
+        } else if (strcmp(argv[i], "-EL") == 0) {
+            flags |= SERVE_LITTLE_ENDIAN;
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            char* end;
+            requests = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || requests < 1) {
+                print_usage_and_exit();
+            }
+        } else if (argv[i][0] == '-' || num_files == 3) {
+            print_usage_and_exit();
+        } else {
+            files[num_files++] = argv[i];
+        }
+    }
+    if (num_files != 3) {
+        print_usage_and_exit();
+    }
+
+    size_t source_len;
+    char* source = read_file(files[1], &source_len);
+    if (!source || source_len > SERVE_MAX_SOURCE) {
+        fprintf(stderr, "Error: unable to read input file: %s\n", files[1]);
+        return 1;
+    }
+    int fd = connect_to(files[0]);
+    if (fd < 0) {
+        fprintf(stderr, "Error: unable to connect to server: %s\n", files[0]);
+        return 1;
+    }
+
+    uint32_t header[3] = { htonl(source_len), htonl(format), htonl(flags) };
+    char* output = NULL;
+    char* diags = NULL;
+    uint32_t status = SERVE_FAILED, output_len = 0, diag_len = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long r = 0; r < requests; r++) {
+        uint32_t reply[3];
+        if (write_all(fd, (const char*) header, sizeof(header)) != 0
+            || write_all(fd, source, source_len) != 0
+            || read_all(fd, (char*) reply, sizeof(reply)) != 0) {
+            fprintf(stderr, "Error: lost connection to server\n");
+            return 1;
+        }
+        status = ntohl(reply[0]);
+        output_len = ntohl(reply[1]);
+        diag_len = ntohl(reply[2]);
+        output = (char*) realloc(output, output_len + 1);
+        diags = (char*) realloc(diags, diag_len + 1);
+        if (!output || !diags || read_all(fd, output, output_len) != 0
+            || read_all(fd, diags, diag_len) != 0) {
+            fprintf(stderr, "Error: lost connection to server\n");
+            return 1;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    close(fd);
+
+    fwrite(diags, 1, diag_len, stderr);
+    if (status == SERVE_OK) {
+        FILE* out = fopen(files[2], "wb");
+        if (!out || fwrite(output, 1, output_len, out) != output_len) {
+            fprintf(stderr, "Error: unable to write output file: %s\n", files[2]);
+            status = SERVE_FAILED;
+        }
+        if (out) fclose(out);
+    }
+    if (requests > 1) {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        printf("%ld requests in %.3f s: %.0f requests/s\n", requests, seconds,
+            requests / seconds);
+    }
+
+    free(source);
+    free(output);
+    free(diags);
+    return status == SERVE_OK ? 0 : 1;
+}
@@ -1,6 +1,6 @@
 		addiu $t0, $t3, $t3				# not a number
 label:	jal								# no label
-		ori $t2, $t5, 0xAB				# invalid register
+		ori $t2, $t10, 0xAB				# invalid register
 		bne $t0, $t1, not_found			# nonexistant label
 		addiu $t3 $t5 0x80808080		# number too large
 
@@ -0,0 +1,431 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/reader.h"
+#include "src/translate_utils.h"
+#include "src/translate.h"
+
+/* Each repetition runs the operation this long, after a warmup of the same
+   length that also picks the number of iterations.
+ */
+#define TARGET_SECONDS 0.02
+
+/* Keeps the compiler from dropping the operations being measured. */
+static volatile uint64_t sink;
+
+/****************************************
+ *  Timing
+ ****************************************/
+
+/* Runs the operation ITERS times with ARG. */
+typedef void (*BenchFunc)(void* arg, uint64_t iters);
+
+typedef struct {
+    const char* name;
+    BenchFunc fn;
+    void* arg;
+} MicroBench;
+
+/* Result of one benchmark. Times are per operation, over REPS repetitions
+   of ITERS operations each.
+ */
+typedef struct {
+    double ns_min;
+    double ns_median;
+    double cycles_min;      // time stamp counter ticks, or 0 if there is none
+    uint64_t iters;
+    int reps;
+} BenchResult;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t read_cycles() {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/* Finds how many iterations of BENCH take about TARGET_SECONDS, warming up
+   caches and branch predictors on the way, then times REPS runs of that many.
+ */
+static BenchResult run_bench(const MicroBench* bench, int reps) {
+    BenchResult result = { 0, 0, 0, 1, reps };
+
+    double start = now();
+    while (1) {
+        double t = now();
+        bench->fn(bench->arg, result.iters);
+        t = now() - t;
+        if (t >= TARGET_SECONDS && now() - start >= TARGET_SECONDS) break;
+        if (t < TARGET_SECONDS) result.iters *= 2;
+    }
+
+    double* ns = (double*) malloc(reps * sizeof(double));
+    if (ns == NULL) allocation_failed();
+    double cycles_min = 0;
+    for (int i = 0; i < reps; i++) {
+        double t = now();
+        uint64_t c = read_cycles();
+        bench->fn(bench->arg, result.iters);
+        c = read_cycles() - c;
+        t = now() - t;
+
+        ns[i] = t * 1e9 / result.iters;
+        double cycles = (double) c / result.iters;
+        if (i == 0 || cycles < cycles_min) cycles_min = cycles;
+    }
+    qsort(ns, reps, sizeof(double), compare_doubles);
+    result.ns_min = ns[0];
+    result.ns_median = ns[reps / 2];
+    result.cycles_min = cycles_min;
+    free(ns);
+    return result;
+}
+
+/****************************************
+ *  Operations
+ ****************************************/
+
+/* A list of inputs that a benchmark cycles through, so that a single lucky
+   input does not decide the result.
+ */
+typedef struct {
+    const char** strs;
+    uint32_t num_strs;
+} StrList;
+
+#define STR_LIST(arr) { arr, sizeof(arr) / sizeof(arr[0]) }
+
+static const char* REG_STRS[] = { "$t0", "$s7", "$ra", "$zero", "$31", "$5", "$sp", "$bad" };
+static const char* NUM_STRS[] = { "5", "-32768", "0x7fff", "0xDEADBEEF", "123456", "-1", "abc" };
+static const char* LABEL_STRS[] = { "loop", "_start", "L12345", "my_long_label_name_1", "1bad",
+    "a$b", "x" };
+
+static const char* LINE_STRS[] = { "loop: addiu $t0, $t1, -100", "  lw $t0, 8($sp)   # load",
+    "beq $t0, $t1, loop", "", "# only a comment", "j a_label_with_a_rather_long_name_to_go_to" };
+
+static StrList reg_list = STR_LIST(REG_STRS);
+static StrList num_list = STR_LIST(NUM_STRS);
+static StrList label_list = STR_LIST(LABEL_STRS);
+static StrList line_list = STR_LIST(LINE_STRS);
+
+static void bench_translate_reg(void* arg, uint64_t iters) {
+    StrList* list = (StrList*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += translate_reg(list->strs[i % list->num_strs]);
+    }
+    sink += sum;
+}
+
+static void bench_translate_num(void* arg, uint64_t iters) {
+    StrList* list = (StrList*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        long int num;
+        sum += translate_num(&num, list->strs[i % list->num_strs], -2147483648L, 4294967295L);
+        sum += num;
+    }
+    sink += sum;
+}
+
+static void bench_is_valid_label(void* arg, uint64_t iters) {
+    StrList* list = (StrList*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += is_valid_label(list->strs[i % list->num_strs]);
+    }
+    sink += sum;
+}
+
+static void bench_scan_tokens(void* arg, uint64_t iters) {
+    StrList* list = (StrList*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        const char* str = list->strs[i % list->num_strs];
+        Slice line = { str, strlen(str) };
+        Slice toks[8];
+        uint32_t colons;
+        sum += scan_tokens(line, NULL, toks, 8, &colons) + colons;
+    }
+    sink += sum;
+}
+
+/* Number of names looked up by the symbol table benchmarks; one in eight is
+   missing from the table.
+ */
+#define NUM_LOOKUPS 1024
+
+typedef struct {
+    SymbolTable* table;
+    char names[NUM_LOOKUPS][16];
+} LookupBench;
+
+static LookupBench* create_lookup_bench(uint32_t size) {
+    LookupBench* bench = (LookupBench*) malloc(sizeof(LookupBench));
+    if (bench == NULL) allocation_failed();
+    bench->table = create_table(SYMTBL_UNIQUE_NAME);
+
+    char name[16];
+    for (uint32_t i = 0; i < size; i++) {
+        sprintf(name, "sym%u", i);
+        add_to_table(bench->table, name, 4 * i);
+    }
+    for (uint32_t i = 0; i < NUM_LOOKUPS; i++) {
+        uint32_t n = (uint32_t) (i * 2654435761u) % size;
+        sprintf(bench->names[i], i % 8 == 7 ? "missing%u" : "sym%u", n);
+    }
+    return bench;
+}
+
+static void free_lookup_bench(LookupBench* bench) {
+    free_table(bench->table);
+    free(bench);
+}
+
+static void bench_get_addr_for_symbol(void* arg, uint64_t iters) {
+    LookupBench* bench = (LookupBench*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += get_addr_for_symbol(bench->table, bench->names[i % NUM_LOOKUPS]);
+    }
+    sink += sum;
+}
+
+/* One instruction, written to /dev/null by the write_pass_one() and
+   translate_inst() benchmarks.
+ */
+typedef struct {
+    const char* name;
+    char* args[3];
+    int num_args;
+} InstBench;
+
+static FILE* null_output;
+static SymbolTable* inst_symtbl;
+static SymbolTable* inst_reltbl;
+
+static InstBench li_small = { "li", { "$t0", "100" }, 2 };
+static InstBench li_large = { "li", { "$t0", "0xDEADBEEF" }, 2 };
+static InstBench blt = { "blt", { "$t0", "$t1", "loop" }, 3 };
+
+static InstBench rtype = { "addu", { "$t0", "$t1", "$t2" }, 3 };
+static InstBench shift = { "sll", { "$t0", "$t1", "5" }, 3 };
+static InstBench jr = { "jr", { "$ra" }, 1 };
+static InstBench itype = { "addiu", { "$t0", "$t1", "-100" }, 3 };
+static InstBench lui = { "lui", { "$t0", "0xABCD" }, 2 };
+static InstBench load = { "lw", { "$t0", "8", "$sp" }, 3 };
+static InstBench store = { "sw", { "$t0", "-4", "$sp" }, 3 };
+static InstBench branch = { "beq", { "$t0", "$t1", "loop" }, 3 };
+static InstBench jump = { "j", { "loop" }, 1 };
+
+static void bench_write_pass_one(void* arg, uint64_t iters) {
+    InstBench* inst = (InstBench*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += write_pass_one(null_output, inst->name, inst->args, inst->num_args);
+    }
+    sink += sum;
+}
+
+/* Words of a text section, formatted by the write_inst_hex benchmarks. */
+#define HEX_WORDS 256
+
+static uint32_t hex_words[HEX_WORDS];
+
+/* Each iteration formats one word; the output buffer is emptied between
+   batches so that nothing is written out.
+ */
+static void bench_write_inst_hex(void* arg, uint64_t iters) {
+    OutBuf* out = (OutBuf*) arg;
+    for (uint64_t i = 0; i < iters; i++) {
+        if (i % HEX_WORDS == 0) out->len = 0;
+        write_inst_hex(out, hex_words[i % HEX_WORDS]);
+    }
+    sink += out->len;
+}
+
+static void bench_write_inst_hex_n(void* arg, uint64_t iters) {
+    OutBuf* out = (OutBuf*) arg;
+    for (uint64_t i = 0; i < iters; i += HEX_WORDS) {
+        out->len = 0;
+        write_inst_hex_n(out, hex_words, iters - i < HEX_WORDS ? iters - i : HEX_WORDS);
+    }
+    sink += out->len;
+}
+
+static void bench_translate_inst(void* arg, uint64_t iters) {
+    InstBench* inst = (InstBench*) arg;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += translate_inst(null_output, inst->name, inst->args, inst->num_args, 0x40,
+            inst_symtbl, inst_reltbl);
+        //jumps add a relocation every time
+        if (inst_reltbl->len > 4096) {
+            reset_table(inst_reltbl);
+        }
+    }
+    sink += sum;
+}
+
+/****************************************
+ *  Driver
+ ****************************************/
+
+static void print_usage_and_exit() {
+    printf("Usage: microbench-assembler [-json] [-reps <count>] [-filter <substring>]\n");
+    printf("Times the primitives of the assembler and reports the time of one call.\n");
+    exit(0);
+}
+
+static void print_result(const char* name, const BenchResult* r, int json, int first) {
+    if (json) {
+        printf("%s\n  {\"name\": \"%s\", \"ns_per_op\": %.3f, \"ns_per_op_median\": %.3f, ",
+            first ? "" : ",", name, r->ns_min, r->ns_median);
+        if (HAVE_TSC) {
+            printf("\"cycles_per_op\": %.2f, ", r->cycles_min);
+        } else {
+            printf("\"cycles_per_op\": null, ");
+        }
+        printf("\"iterations\": %llu, \"repetitions\": %d}", (unsigned long long) r->iters, r->reps);
+    } else {
+        printf("%-36s %10.2f %10.2f %10.1f %12llu\n", name, r->ns_min, r->ns_median,
+            r->cycles_min, (unsigned long long) r->iters);
+    }
+}
+
+int main(int argc, char** argv) {
+    int json = 0;
+    int reps = 15;
+    const char* filter = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "-reps") == 0 && i + 1 < argc) {
+            reps = atoi(argv[++i]);
+            if (reps < 1) print_usage_and_exit();
+        } else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            print_usage_and_exit();
+        }
+    }
+
+    null_output = fopen("/dev/null", "w");
+    if (!null_output) {
+        fprintf(stderr, "Error: unable to open /dev/null\n");
+        return 1;
+    }
+    //the benchmarked calls report nothing unless they fail, and then it is
+    //dropped here
+    OutBuf discarded;
+    outbuf_open_memory(&discarded);
+    capture_log(&discarded);
+    inst_symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    inst_reltbl = create_table(SYMTBL_NON_UNIQUE);
+    add_to_table(inst_symtbl, "loop", 0x20);
+
+    OutBuf hex_out;
+    outbuf_open_memory(&hex_out);
+    for (int i = 0; i < HEX_WORDS; i++) {
+        hex_words[i] = 0x9e3779b9u * (i + 1);
+    }
+
+    LookupBench* lookup_10 = create_lookup_bench(10);
+    LookupBench* lookup_1k = create_lookup_bench(1000);
+    LookupBench* lookup_100k = create_lookup_bench(100000);
+    LookupBench* lookup_1m = create_lookup_bench(1000000);
+
+    MicroBench benches[] = {
+        { "translate_reg", bench_translate_reg, &reg_list },
+        { "translate_num", bench_translate_num, &num_list },
+        { "is_valid_label", bench_is_valid_label, &label_list },
+        { "scan_tokens", bench_scan_tokens, &line_list },
+        { "get_addr_for_symbol/10", bench_get_addr_for_symbol, lookup_10 },
+        { "get_addr_for_symbol/1000", bench_get_addr_for_symbol, lookup_1k },
+        { "get_addr_for_symbol/100000", bench_get_addr_for_symbol, lookup_100k },
+        { "get_addr_for_symbol/1000000", bench_get_addr_for_symbol, lookup_1m },
+        { "write_pass_one/li_small", bench_write_pass_one, &li_small },
+        { "write_pass_one/li_large", bench_write_pass_one, &li_large },
+        { "write_pass_one/blt", bench_write_pass_one, &blt },
+        { "write_inst_hex", bench_write_inst_hex, &hex_out },
+        { "write_inst_hex_n", bench_write_inst_hex_n, &hex_out },
+        { "translate_inst/rtype", bench_translate_inst, &rtype },
+        { "translate_inst/shift", bench_translate_inst, &shift },
+        { "translate_inst/jr", bench_translate_inst, &jr },
+        { "translate_inst/itype", bench_translate_inst, &itype },
+        { "translate_inst/lui", bench_translate_inst, &lui },
+        { "translate_inst/load", bench_translate_inst, &load },
+        { "translate_inst/store", bench_translate_inst, &store },
+        { "translate_inst/branch", bench_translate_inst, &branch },
+        { "translate_inst/jump", bench_translate_inst, &jump },
+    };
+    int num_benches = sizeof(benches) / sizeof(benches[0]);
+
+    if (json) {
+        printf("[");
+    } else {
+        printf("%-36s %10s %10s %10s %12s\n", "benchmark", "ns/op", "median", "cycles/op",
+            "iterations");
+    }
+    int first = 1;
+    for (int i = 0; i < num_benches; i++) {
+        if (filter && !strstr(benches[i].name, filter)) {
+            continue;
+        }
+        //timing the error path of an instruction would be misleading
+        if (benches[i].fn == bench_write_pass_one || benches[i].fn == bench_translate_inst) {
+            InstBench* inst = (InstBench*) benches[i].arg;
+            if (write_pass_one(null_output, inst->name, inst->args, inst->num_args) == 0
+                || (benches[i].fn == bench_translate_inst
+                && translate_inst(null_output, inst->name, inst->args, inst->num_args, 0x40,
+                    inst_symtbl, inst_reltbl) != 0)) {
+                fprintf(stderr, "Error: %s does not assemble\n", benches[i].name);
+                return 1;
+            }
+        }
+        BenchResult result = run_bench(&benches[i], reps);
+        print_result(benches[i].name, &result, json, first);
+        first = 0;
+        fflush(stdout);
+    }
+    if (json) {
+        printf("\n]\n");
+    }
+
+    outbuf_close(&hex_out);
+    free_lookup_bench(lookup_10);
+    free_lookup_bench(lookup_1k);
+    free_lookup_bench(lookup_100k);
+    free_lookup_bench(lookup_1m);
+    free_table(inst_symtbl);
+    free_table(inst_reltbl);
+    fclose(null_output);
+    capture_log(NULL);
+    outbuf_close(&discarded);
+    return 0;
+}
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/object.h"
+#include "src/stats.h"
+#include "src/translate.h"
+#include "assembler.h"
+#include "mipsasm.h"
+
+/* Most threads a context may use, the same limit as the -j option. */
+#define MAX_JOBS 1024
+
+/* Besides its settings, a context keeps the tables and buffers of its last
+   assembly, which are reset rather than freed so that a context used for
+   many small sources does not allocate them again for each one.
+ */
+struct MipsAsmContext {
+    AsmOptions opts;
+    MipsDiagnosticFn diagnostics;
+    void* user;
+    SymbolTable* symtbl;
+    SymbolTable* reltbl;
+    InstList insts;
+    OutBuf log;             // messages of the assembly in progress
+    int single_pass;
+    int keep_inter;
+    int output_on_error;
+    OutBuf inter;           // intermediate file of the last assembly, if kept
+    AsmStats* stats;        // counters of the command line, or NULL
+};
+
+MipsAsmContext* mips_context_create(void) {
+    MipsAsmContext* ctx = (MipsAsmContext*) malloc(sizeof(MipsAsmContext));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->opts.format = OUTPUT_TEXT;
+    ctx->opts.little_endian = 0;
+    ctx->opts.jobs = 1;
+    ctx->diagnostics = NULL;
+    ctx->user = NULL;
+    ctx->symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    ctx->reltbl = create_table(SYMTBL_NON_UNIQUE);
+    inst_list_init(&ctx->insts);
+    outbuf_open_memory(&ctx->log);
+    ctx->single_pass = 0;
+    ctx->keep_inter = 0;
+    ctx->output_on_error = 0;
+    outbuf_open_memory(&ctx->inter);
+    ctx->stats = NULL;
+    return ctx;
+}
+
+void mips_context_free(MipsAsmContext* ctx) {
+    if (!ctx) {
+        return;
+    }
+    free_table(ctx->symtbl);
+    free_table(ctx->reltbl);
+    inst_list_free(&ctx->insts);
+    outbuf_close(&ctx->log);
+    outbuf_close(&ctx->inter);
+    free(ctx);
+}
+
+void mips_set_diagnostics(MipsAsmContext* ctx, MipsDiagnosticFn fn, void* user) {
+    ctx->diagnostics = fn;
+    ctx->user = user;
+}
+
+void mips_set_format(MipsAsmContext* ctx, MipsAsmFormat format) {
+    switch (format) {
+        case MIPSASM_BIN: ctx->opts.format = OUTPUT_BIN; break;
+        case MIPSASM_ELF: ctx->opts.format = OUTPUT_ELF; break;
+        default:          ctx->opts.format = OUTPUT_TEXT; break;
+    }
+}
+
+void mips_set_little_endian(MipsAsmContext* ctx, int little_endian) {
+    ctx->opts.little_endian = little_endian != 0;
+}
+
+int mips_set_jobs(MipsAsmContext* ctx, int jobs) {
+    if (jobs < 1 || jobs > MAX_JOBS) {
+        return -1;
+    }
+    ctx->opts.jobs = jobs;
+    return 0;
+}
+
+void mips_set_single_pass(MipsAsmContext* ctx, int single_pass) {
+    ctx->single_pass = single_pass != 0;
+}
+
+void mips_set_keep_intermediate(MipsAsmContext* ctx, int keep) {
+    ctx->keep_inter = keep != 0;
+}
+
+const char* mips_intermediate(MipsAsmContext* ctx, size_t* len) {
+    if (!ctx->keep_inter || ctx->single_pass) {
+        *len = 0;
+        return NULL;
+    }
+    *len = ctx->inter.len;
+    return ctx->inter.data;
+}
+
+void mips_set_output_on_error(MipsAsmContext* ctx, int output_on_error) {
+    ctx->output_on_error = output_on_error != 0;
+}
+
+/* Lets the command line count the assemblies of CTX in STATS, or stops
+   counting them if STATS is NULL. It is not part of the library's API,
+   since AsmStats is not.
+ */
+void mips_context_set_stats(MipsAsmContext* ctx, AsmStats* stats) {
+    ctx->stats = stats;
+}
+
+/* Hands the messages collected in LOG to the diagnostics of CTX, one line at
+   a time.
+ */
+static void report_diagnostics(MipsAsmContext* ctx, OutBuf* log) {
+    if (!ctx->diagnostics || log->len == 0) {
+        return;
+    }
+
+    //every line, including the last, ends up NUL-terminated in place
+    outbuf_putc(log, '\n');
+    char* line = log->data;
+    char* end = log->data + log->len - 1;
+    while (line < end) {
+        char* newline = (char*) memchr(line, '\n', end - line + 1);
+        *newline = '\0';
+        ctx->diagnostics(ctx->user, line);
+        line = newline + 1;
+    }
+}
+
+/* The messages of the assembly are collected from the log of the calling
+   thread, which the passes write to, and only passed on once it is done. Any
+   threads the passes start hand their errors back to the calling thread, so
+   nothing is logged anywhere else.
+ */
+int mips_assemble_buffer(MipsAsmContext* ctx, const char* src, size_t len,
+    char** out, size_t* out_len) {
+    *out = NULL;
+    *out_len = 0;
+
+    reset_table(ctx->symtbl);
+    reset_table(ctx->reltbl);
+    inst_list_clear(&ctx->insts);
+    ctx->log.len = 0;
+    ctx->inter.len = 0;
+    OutBuf* previous = capture_log(&ctx->log);
+
+    int err = -1;
+    //fmemopen() does not accept a NULL buffer, even an empty one
+    FILE* input = fmemopen(len > 0 ? (void*) src : (void*) "", len, "r");
+    if (input) {
+        ObjectWriter obj;
+        object_begin_memory(&obj, ctx->opts.format, ctx->opts.little_endian);
+        if (ctx->single_pass) {
+            err = single_pass_stream(input, &obj, ctx->symtbl, ctx->reltbl, ctx->stats);
+        } else {
+            err = assemble_stream(input, ctx->keep_inter ? &ctx->inter : NULL, &obj,
+                ctx->symtbl, ctx->reltbl, &ctx->insts, &ctx->opts, ctx->stats);
+        }
+        fclose(input);
+
+        size_t size;
+        char* data = object_take_memory(&obj, &size);
+        if (err == 0 || ctx->output_on_error) {
+            *out = data;
+            *out_len = size;
+        } else {
+            free(data);
+        }
+    } else {
+        write_to_log("Error: unable to read the source buffer\n");
+    }
+    capture_log(previous);
+
+    report_diagnostics(ctx, &ctx->log);
+    return err;
+}
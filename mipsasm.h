@@ -0,0 +1,91 @@
+#ifndef MIPSASM_H
+#define MIPSASM_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* libmipsasm assembles MIPS source held in memory into an object held in
+   memory. All settings and diagnostics belong to a context, so any number of
+   contexts can be used at once, each by one thread at a time.
+ */
+
+#define MIPSASM_API __attribute__((visibility("default")))
+
+typedef struct MipsAsmContext MipsAsmContext;
+
+/* Formats an assembled program can be written in. */
+typedef enum {
+    MIPSASM_TEXT,       // .text/.symbol/.relocation listing, one hex word per line
+    MIPSASM_BIN,        // raw image of the text section
+    MIPSASM_ELF         // ELF32 MIPS relocatable object
+} MipsAsmFormat;
+
+/* Called with each line of diagnostics, such as
+   "Error - invalid instruction at line 3: addu $t0 $t1", without its newline.
+   USER is the pointer given to mips_set_diagnostics().
+ */
+typedef void (*MipsDiagnosticFn)(void* user, const char* message);
+
+/* Returns a new context that writes text output, big-endian, on one thread
+   and drops its diagnostics, or NULL if there is no memory for it.
+ */
+MIPSASM_API MipsAsmContext* mips_context_create(void);
+
+MIPSASM_API void mips_context_free(MipsAsmContext* ctx);
+
+/* Sends the diagnostics of CTX to FN, or drops them if FN is NULL. They are
+   delivered in the order a command-line run would log them, before
+   mips_assemble_buffer() returns.
+ */
+MIPSASM_API void mips_set_diagnostics(MipsAsmContext* ctx, MipsDiagnosticFn fn, void* user);
+
+MIPSASM_API void mips_set_format(MipsAsmContext* ctx, MipsAsmFormat format);
+
+/* Selects the byte order of bin and elf output. */
+MIPSASM_API void mips_set_little_endian(MipsAsmContext* ctx, int little_endian);
+
+/* Lets both passes run on up to JOBS threads, which are started and joined
+   within each call. Returns -1 if JOBS is out of range, 0 otherwise.
+ */
+MIPSASM_API int mips_set_jobs(MipsAsmContext* ctx, int jobs);
+
+/* Selects the single-pass assembler, which gives the same program as the two
+   passes without going through an intermediate file.
+ */
+MIPSASM_API void mips_set_single_pass(MipsAsmContext* ctx, int single_pass);
+
+/* Makes CTX keep the intermediate file of each two-pass assembly, the
+   expanded instructions that pass one hands to pass two.
+ */
+MIPSASM_API void mips_set_keep_intermediate(MipsAsmContext* ctx, int keep);
+
+/* Returns the intermediate file kept by the last mips_assemble_buffer() call
+   on CTX, not NUL-terminated, and sets *LEN to its length. It belongs to CTX
+   and stays valid until CTX assembles again or is freed. Returns NULL if no
+   intermediate file was kept.
+ */
+MIPSASM_API const char* mips_intermediate(MipsAsmContext* ctx, size_t* len);
+
+/* Makes mips_assemble_buffer() hand back the program even if the source has
+   errors, with no words for the lines in error, which is what the command
+   line writes in that case.
+ */
+MIPSASM_API void mips_set_output_on_error(MipsAsmContext* ctx, int output_on_error);
+
+/* Assembles the LEN bytes of source at SRC with the settings of CTX. On
+   success, *OUT is set to the assembled program, which the caller frees with
+   free(), and *OUT_LEN to its length. Returns 0 on success and -1 if the
+   source has errors, which are reported through the diagnostics of CTX, in
+   which case *OUT is NULL unless mips_set_output_on_error() was called.
+ */
+MIPSASM_API int mips_assemble_buffer(MipsAsmContext* ctx, const char* src, size_t len,
+    char** out, size_t* out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,501 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "mipsasm.h"
+#include "server.h"
+
+/* How much is read from a client at a time. */
+#define READ_CHUNK (64 * 1024)
+
+#define MAX_EVENTS 64
+
+/* What a connection is waiting for. */
+typedef enum {
+    CONN_READING,       // the rest of a request
+    CONN_WORKING,       // a worker to assemble its request
+    CONN_WRITING        // the client to take the response
+} ConnState;
+
+typedef struct Conn {
+    int fd;
+    ConnState state;
+    int watched;            // events the event loop polls for, 0 if none
+    int eof;                // the client sent everything it is going to
+    char* in;               // bytes read and not handled yet, starting with a request
+    size_t in_len, in_cap;
+    ServeRequest req;       // the request at the start of IN, once it is complete
+    OutBuf out;             // response, written from OUT_POS on
+    size_t out_pos;
+    struct Conn* next;      // in the work queue or the done list
+    struct Conn* prev_open; // in the list of open connections
+    struct Conn* next_open;
+} Conn;
+
+/* State shared by the event loop and the workers. Only the event loop
+   touches a connection, except while it is CONN_WORKING, when only the
+   worker that took it from the queue does.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    Conn* queue_head;       // requests waiting for a worker, oldest first
+    Conn* queue_tail;
+    Conn* done;             // connections whose response is ready
+    int stopping;
+
+    int epoll_fd;
+    int listen_fd;
+    int wake_fd;            // eventfd that wakes the event loop when DONE grows
+    int signal_fd;
+    Conn* open;
+} Server;
+
+/* Reads the header of the request at the start of the LEN bytes of DATA into
+   REQ. Returns 1 if the whole request is there, 0 if more is needed, and -1
+   if it is not a request this server accepts.
+ */
+int parse_serve_request(const char* data, size_t len, ServeRequest* req) {
+    uint32_t fields[3];
+
+    if (len < SERVE_HEADER_SIZE) {
+        return 0;
+    }
+    memcpy(fields, data, sizeof(fields));
+    req->source_len = ntohl(fields[0]);
+    req->format = ntohl(fields[1]);
+    req->flags = ntohl(fields[2]);
+
+    if (req->source_len > SERVE_MAX_SOURCE || req->format > MIPSASM_ELF
+        || (req->flags & ~SERVE_LITTLE_ENDIAN) != 0) {
+        return -1;
+    }
+    return len - SERVE_HEADER_SIZE >= req->source_len ? 1 : 0;
+}
+
+static void put_header(OutBuf* out, uint32_t a, uint32_t b, uint32_t c) {
+    uint32_t fields[3] = { htonl(a), htonl(b), htonl(c) };
+    outbuf_write(out, (const char*) fields, sizeof(fields));
+}
+
+/*******************************
+ * Workers
+ *******************************/
+
+static void collect_diagnostic(void* user, const char* message) {
+    OutBuf* diags = (OutBuf*) user;
+    outbuf_puts(diags, message);
+    outbuf_putc(diags, '\n');
+}
+
+/* Assembles the request of CONN with CTX, whose diagnostics go to DIAGS, and
+   stores the response in CONN->out.
+ */
+static void answer_request(MipsAsmContext* ctx, OutBuf* diags, Conn* conn) {
+    char* output;
+    size_t output_len;
+
+    diags->len = 0;
+    mips_set_format(ctx, (MipsAsmFormat) conn->req.format);
+    mips_set_little_endian(ctx, conn->req.flags & SERVE_LITTLE_ENDIAN);
+    int err = mips_assemble_buffer(ctx, conn->in + SERVE_HEADER_SIZE, conn->req.source_len,
+        &output, &output_len);
+
+    conn->out.len = 0;
+    conn->out_pos = 0;
+    put_header(&conn->out, err ? SERVE_FAILED : SERVE_OK, output_len, diags->len);
+    outbuf_write(&conn->out, output, output_len);
+    outbuf_write(&conn->out, diags->data, diags->len);
+    free(output);
+}
+
+/* Runs on each worker thread, which keeps one warm context for every
+   request it answers, until the server stops.
+ */
+static void* serve_worker(void* arg) {
+    Server* server = (Server*) arg;
+    MipsAsmContext* ctx = mips_context_create();
+    if (ctx == NULL) allocation_failed();
+    OutBuf diags;
+    outbuf_open_memory(&diags);
+    mips_set_diagnostics(ctx, collect_diagnostic, &diags);
+
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while (!server->queue_head && !server->stopping) {
+            pthread_cond_wait(&server->ready, &server->lock);
+        }
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        Conn* conn = server->queue_head;
+        server->queue_head = conn->next;
+        if (!server->queue_head) server->queue_tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+
+        answer_request(ctx, &diags, conn);
+
+        pthread_mutex_lock(&server->lock);
+        conn->next = server->done;
+        server->done = conn;
+        pthread_mutex_unlock(&server->lock);
+        uint64_t one = 1;
+        if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+            //the counter is already nonzero, so the event loop wakes anyway
+        }
+    }
+
+    outbuf_close(&diags);
+    mips_context_free(ctx);
+    return NULL;
+}
+
+/*******************************
+ * Event Loop
+ *******************************/
+
+/* Makes the event loop poll CONN for EVENTS, or not at all if EVENTS is 0. */
+static void watch(Server* server, Conn* conn, int events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = conn;
+
+    if (events == conn->watched) {
+        return;
+    } else if (events == 0) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, conn->fd, &ev);
+    } else if (conn->watched == 0) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev);
+    } else {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    }
+    conn->watched = events;
+}
+
+static void close_conn(Server* server, Conn* conn) {
+    watch(server, conn, 0);
+    close(conn->fd);
+    if (conn->prev_open) conn->prev_open->next_open = conn->next_open;
+    else server->open = conn->next_open;
+    if (conn->next_open) conn->next_open->prev_open = conn->prev_open;
+    free(conn->in);
+    outbuf_close(&conn->out);
+    free(conn);
+}
+
+static void accept_clients(Server* server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            //EAGAIN once every waiting client is in; anything else is
+            //particular to that client, which has gone
+            return;
+        }
+
+        Conn* conn = (Conn*) calloc(1, sizeof(Conn));
+        if (conn == NULL) allocation_failed();
+        conn->fd = fd;
+        conn->state = CONN_READING;
+        outbuf_open_memory(&conn->out);
+        conn->next_open = server->open;
+        if (server->open) server->open->prev_open = conn;
+        server->open = conn;
+        watch(server, conn, EPOLLIN);
+    }
+}
+
+/* Hands the request of CONN to the workers. */
+static void queue_request(Server* server, Conn* conn) {
+    conn->state = CONN_WORKING;
+    watch(server, conn, 0);
+
+    pthread_mutex_lock(&server->lock);
+    conn->next = NULL;
+    if (server->queue_tail) server->queue_tail->next = conn;
+    else server->queue_head = conn;
+    server->queue_tail = conn;
+    pthread_cond_signal(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+}
+
+/* Decides what CONN does next while it is reading: queue the request it has
+   read completely, wait for more of it, or close. Returns -1 if CONN was
+   closed.
+ */
+static int next_request(Server* server, Conn* conn) {
+    int status = parse_serve_request(conn->in, conn->in_len, &conn->req);
+    if (status < 0 || (status == 0 && conn->eof)) {
+        close_conn(server, conn);
+        return -1;
+    }
+    if (status == 1) {
+        queue_request(server, conn);
+    } else {
+        watch(server, conn, EPOLLIN);
+    }
+    return 0;
+}
+
+/* Reads whatever CONN has sent, until a request is complete. */
+static void read_conn(Server* server, Conn* conn) {
+    for (;;) {
+        if (conn->in_cap - conn->in_len < READ_CHUNK) {
+            conn->in_cap = conn->in_cap ? conn->in_cap * 2 : READ_CHUNK * 2;
+            conn->in = (char*) realloc(conn->in, conn->in_cap);
+            if (conn->in == NULL) allocation_failed();
+        }
+        ssize_t n = read(conn->fd, conn->in + conn->in_len, conn->in_cap - conn->in_len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+            close_conn(server, conn);
+            return;
+        }
+        if (n == 0) {
+            conn->eof = 1;
+        }
+        if (n > 0) {
+            conn->in_len += n;
+            ServeRequest req;
+            if (parse_serve_request(conn->in, conn->in_len, &req) == 0) {
+                continue;
+            }
+        }
+        next_request(server, conn);
+        return;
+    }
+}
+
+/* Writes as much of the response of CONN as the socket takes. Once all of
+   it is written, the request is dropped and CONN goes on to the next one.
+ */
+static void write_conn(Server* server, Conn* conn) {
+    while (conn->out_pos < conn->out.len) {
+        ssize_t n = send(conn->fd, conn->out.data + conn->out_pos,
+            conn->out.len - conn->out_pos, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch(server, conn, EPOLLOUT);
+            return;
+        }
+        if (n < 0) {
+            close_conn(server, conn);
+            return;
+        }
+        conn->out_pos += n;
+    }
+
+    size_t used = SERVE_HEADER_SIZE + conn->req.source_len;
+    memmove(conn->in, conn->in + used, conn->in_len - used);
+    conn->in_len -= used;
+    conn->state = CONN_READING;
+    next_request(server, conn);
+}
+
+/* Starts sending the responses the workers have finished. */
+static void send_finished(Server* server) {
+    uint64_t count;
+    if (read(server->wake_fd, &count, sizeof(count)) < 0) {
+        //nothing to read: another wakeup already took the list
+    }
+
+    pthread_mutex_lock(&server->lock);
+    Conn* conn = server->done;
+    server->done = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    while (conn) {
+        Conn* next = conn->next;
+        conn->state = CONN_WRITING;
+        write_conn(server, conn);
+        conn = next;
+    }
+}
+
+static void conn_event(Server* server, Conn* conn, uint32_t events) {
+    if (conn->state == CONN_READING && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        read_conn(server, conn);
+    } else if (conn->state == CONN_WRITING && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+        write_conn(server, conn);
+    }
+}
+
+/* Opens a listening socket at SOCKET_PATH. A socket left there by an
+   earlier server is replaced, but no other kind of file is. Returns the
+   socket, or -1 on failure.
+ */
+static int open_listener(const char* socket_path) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        write_to_log("Error: socket path is too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+        || listen(fd, SOMAXCONN) != 0) {
+        write_to_log("Error: unable to listen on socket: %s\n", socket_path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void add_fd(Server* server, int fd, void* tag) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = tag;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* Answers assemble requests on the Unix domain socket SOCKET_PATH until the
+   process gets SIGINT or SIGTERM. One thread accepts clients and moves
+   their bytes with epoll; NUM_WORKERS threads assemble the requests, each
+   with a context of its own that stays warm between requests. If not all of
+   the workers can be started, the server runs with those that were.
+
+   Returns 0 once the server has stopped, or 1 if it could not start.
+ */
+int serve(const char* socket_path, int num_workers) {
+    Server server;
+    memset(&server, 0, sizeof(server));
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+
+    server.listen_fd = open_listener(socket_path);
+    if (server.listen_fd < 0) {
+        return 1;
+    }
+
+    //workers inherit the mask, so the signals only reach the signalfd
+    sigset_t signals, old_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+    server.signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    server.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server.signal_fd < 0 || server.wake_fd < 0 || server.epoll_fd < 0) {
+        write_to_log("Error: unable to start the server\n");
+        close(server.listen_fd);
+        unlink(socket_path);
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+        return 1;
+    }
+    add_fd(&server, server.listen_fd, &server.listen_fd);
+    add_fd(&server, server.wake_fd, &server.wake_fd);
+    add_fd(&server, server.signal_fd, &server.signal_fd);
+
+    pthread_t* workers = (pthread_t*) malloc(num_workers * sizeof(pthread_t));
+    if (workers == NULL) allocation_failed();
+    int started = 0;
+    while (started < num_workers
+        && pthread_create(&workers[started], NULL, serve_worker, &server) == 0) {
+        started += 1;
+    }
+    if (started == 0) {
+        write_to_log("Error: unable to start any worker thread\n");
+        free(workers);
+        close(server.epoll_fd);
+        close(server.wake_fd);
+        close(server.signal_fd);
+        close(server.listen_fd);
+        unlink(socket_path);
+        pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+        pthread_mutex_destroy(&server.lock);
+        pthread_cond_destroy(&server.ready);
+        return 1;
+    }
+
+    printf("Serving on %s with %d worker thread%s\n", socket_path, started,
+        started == 1 ? "" : "s");
+    fflush(stdout);
+
+    int running = 1;
+    while (running) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            write_to_log("Error: epoll_wait failed\n");
+            break;
+        }
+
+        //responses go out before new events, whose connections they may close
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == &server.wake_fd) {
+                send_finished(&server);
+            } else if (events[i].data.ptr == &server.signal_fd) {
+                //taken off the signalfd so it is not delivered once unblocked
+                struct signalfd_siginfo info;
+                if (read(server.signal_fd, &info, sizeof(info)) < 0) {
+                    //nothing pending after all; stop regardless
+                }
+                running = 0;
+            }
+        }
+        for (int i = 0; i < n && running; i++) {
+            void* tag = events[i].data.ptr;
+            if (tag == &server.listen_fd) {
+                accept_clients(&server);
+            } else if (tag != &server.wake_fd && tag != &server.signal_fd) {
+                conn_event(&server, (Conn*) tag, events[i].events);
+            }
+        }
+    }
+
+    printf("Stopping server\n");
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.ready);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    while (server.open) {
+        close_conn(&server, server.open);
+    }
+    close(server.epoll_fd);
+    close(server.wake_fd);
+    close(server.signal_fd);
+    close(server.listen_fd);
+    unlink(socket_path);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.ready);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The protocol of assembler -serve, spoken over a Unix domain socket. Every
+   field is a big-endian uint32.
+
+   A request is a header of SERVE_HEADER_SIZE bytes, holding the length of
+   the source, the output format (0 text, 1 bin, 2 elf) and flags, followed
+   by the source itself.
+
+   A response is a header holding the status (SERVE_OK or SERVE_FAILED), the
+   length of the assembled output and the length of the diagnostics,
+   followed by the output and then the diagnostics, one message per line. A
+   failed assembly has no output.
+
+   A connection may send any number of requests, and they are answered in
+   order. A request the server cannot read closes the connection.
+ */
+
+#define SERVE_HEADER_SIZE 12
+
+/* Largest source a request may carry. */
+#define SERVE_MAX_SOURCE (64 * 1024 * 1024)
+
+/* Flags of a request. */
+#define SERVE_LITTLE_ENDIAN 1
+
+/* Status of a response. */
+#define SERVE_OK 0
+#define SERVE_FAILED 1
+
+typedef struct {
+    uint32_t source_len;
+    uint32_t format;
+    uint32_t flags;
+} ServeRequest;
+
+int parse_serve_request(const char* data, size_t len, ServeRequest* req);
+
+int serve(const char* socket_path, int num_workers);
+
+#endif
@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "tables.h"
+#include "arena.h"
+
+/* Sets up an empty ARENA. No memory is allocated until the first call to
+   arena_alloc(). BLOCK_SIZE is the size of each block requested from malloc.
+ */
+void arena_init(Arena* arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = block_size < 64 ? 64 : block_size;
+}
+
+/* Returns SIZE bytes from ARENA, aligned for any pointer-sized type. Requests
+   larger than the block size get a block of their own. Calls 
+   allocation_failed() if memory allocation fails.
+ */
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+    ArenaBlock* block = arena->head;
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        block = (ArenaBlock*) malloc(sizeof(ArenaBlock) + block_size);
+        if (block == NULL) allocation_failed();
+        block->used = 0;
+        block->size = block_size;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    void* ptr = block->data + block->used;
+    block->used += size;
+    return ptr;
+}
+
+/* Copies STR into ARENA and returns the copy. */
+char* arena_strdup(Arena* arena, const char* str) {
+    size_t len = strlen(str) + 1;
+    char* copy = (char*) arena_alloc(arena, len);
+    memcpy(copy, str, len);
+    return copy;
+}
+
+/* Copies the first LEN characters of STR into ARENA and NUL-terminates the
+   copy. STR does not need to be NUL-terminated.
+ */
+char* arena_strndup(Arena* arena, const char* str, size_t len) {
+    char* copy = (char*) arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/* Moves every block of OTHER into ARENA, so that memory allocated from OTHER
+   lives as long as ARENA does. OTHER is left empty.
+ */
+void arena_adopt(Arena* arena, Arena* other) {
+    if (other->head == NULL) {
+        return;
+    }
+    ArenaBlock* tail = other->head;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    //keep filling the current block of ARENA
+    if (arena->head == NULL) {
+        arena->head = other->head;
+    } else {
+        tail->next = arena->head->next;
+        arena->head->next = other->head;
+    }
+    other->head = NULL;
+}
+
+/* Releases everything allocated from ARENA except its newest block, which is
+   kept for reuse.
+ */
+void arena_reset(Arena* arena) {
+    if (arena->head == NULL) {
+        return;
+    }
+    ArenaBlock* block = arena->head->next;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
+
+/* Releases all memory owned by ARENA. */
+void arena_free(Arena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* A bump allocator. Memory is handed out from large blocks and is only
+   released all at once by arena_reset() or arena_free().
+ */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock* head; //block currently being filled; older blocks follow
+    size_t block_size; //size of each new block
+} Arena;
+
+void arena_init(Arena* arena, size_t block_size);
+
+void* arena_alloc(Arena* arena, size_t size);
+
+char* arena_strdup(Arena* arena, const char* str);
+
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+
+void arena_adopt(Arena* arena, Arena* other);
+
+void arena_reset(Arena* arena);
+
+void arena_free(Arena* arena);
+
+#endif
@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include "mnemonics.h"
+
+/* Indexed by InstId. */
+static const InstDesc INSTS[NUM_INSTS] = {
+    { "addu",  INST_ADDU,  FMT_RTYPE,  0x21 },
+    { "or",    INST_OR,    FMT_RTYPE,  0x25 },
+    { "slt",   INST_SLT,   FMT_RTYPE,  0x2a },
+    { "sltu",  INST_SLTU,  FMT_RTYPE,  0x2b },
+    { "sll",   INST_SLL,   FMT_SHIFT,  0x00 },
+    { "jr",    INST_JR,    FMT_JR,     0x08 },
+    { "addiu", INST_ADDIU, FMT_ADDIU,  0x09 },
+    { "ori",   INST_ORI,   FMT_ORI,    0x0d },
+    { "lui",   INST_LUI,   FMT_LUI,    0x0f },
+    { "lb",    INST_LB,    FMT_LOAD,   0x20 },
+    { "lbu",   INST_LBU,   FMT_LOAD,   0x24 },
+    { "lw",    INST_LW,    FMT_LOAD,   0x23 },
+    { "sb",    INST_SB,    FMT_STORE,  0x28 },
+    { "sw",    INST_SW,    FMT_STORE,  0x2b },
+    { "beq",   INST_BEQ,   FMT_BRANCH, 0x04 },
+    { "bne",   INST_BNE,   FMT_BRANCH, 0x05 },
+    { "j",     INST_J,     FMT_JUMP,   0x02 },
+    { "jal",   INST_JAL,   FMT_JUMP,   0x03 },
+    { "li",    INST_LI,    FMT_PSEUDO, 0x00 },
+    { "blt",   INST_BLT,   FMT_PSEUDO, 0x00 },
+};
+
+/* Picks the only candidate for NAME from its length and first two
+   characters, then confirms it with a single comparison. No mnemonic is
+   longer than 5 characters, so the length is never scanned any further.
+ */
+const InstDesc* lookup_inst(const char* name) {
+    if (!name) {
+        return NULL;
+    }
+
+    size_t len = strnlen(name, 6);
+    int id = -1;
+    char c0 = name[0];
+    char c1 = len > 1 ? name[1] : '\0';
+
+    switch (len) {
+        case 1:
+            if (c0 == 'j') id = INST_J;
+            break;
+        case 2:
+            switch (c0) {
+                case 'j': id = INST_JR; break;
+                case 'o': id = INST_OR; break;
+                case 'l': id = c1 == 'b' ? INST_LB : c1 == 'w' ? INST_LW : INST_LI; break;
+                case 's': id = c1 == 'b' ? INST_SB : INST_SW; break;
+            }
+            break;
+        case 3:
+            switch (c0) {
+                case 'b': id = c1 == 'e' ? INST_BEQ : c1 == 'n' ? INST_BNE : INST_BLT; break;
+                case 'j': id = INST_JAL; break;
+                case 'l': id = c1 == 'b' ? INST_LBU : INST_LUI; break;
+                case 'o': id = INST_ORI; break;
+                case 's': id = name[2] == 't' ? INST_SLT : INST_SLL; break;
+            }
+            break;
+        case 4:
+            if (c0 == 'a') id = INST_ADDU;
+            else if (c0 == 's') id = INST_SLTU;
+            break;
+        case 5:
+            if (c0 == 'a') id = INST_ADDIU;
+            break;
+    }
+
+    if (id < 0 || memcmp(name, INSTS[id].name, len + 1) != 0) {
+        return NULL;
+    }
+    return &INSTS[id];
+}
+
+const InstDesc* get_inst(InstId id) {
+    return &INSTS[id];
+}
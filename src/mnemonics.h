@@ -0,0 +1,49 @@
+#ifndef MNEMONICS_H
+#define MNEMONICS_H
+
+#include <stdint.h>
+
+/* Every mnemonic the assembler understands. */
+typedef enum {
+    INST_ADDU, INST_OR, INST_SLT, INST_SLTU, INST_SLL, INST_JR,
+    INST_ADDIU, INST_ORI, INST_LUI,
+    INST_LB, INST_LBU, INST_LW, INST_SB, INST_SW,
+    INST_BEQ, INST_BNE, INST_J, INST_JAL,
+    INST_LI, INST_BLT,
+    NUM_INSTS,
+    INST_INVALID = NUM_INSTS
+} InstId;
+
+/* How the arguments of an instruction are laid out, which decides the
+   encoder used in pass two. Pseudoinstructions only exist in pass one.
+ */
+typedef enum {
+    FMT_RTYPE,      // rd, rs, rt
+    FMT_SHIFT,      // rd, rt, shamt
+    FMT_JR,         // rs
+    FMT_ADDIU,      // rt, rs, imm
+    FMT_ORI,        // rt, rs, imm
+    FMT_LUI,        // rt, imm
+    FMT_LOAD,       // rt, offset(rs)
+    FMT_STORE,      // rt, offset(rs)
+    FMT_BRANCH,     // rs, rt, label
+    FMT_JUMP,       // label
+    FMT_PSEUDO
+} InstFormat;
+
+typedef struct {
+    const char* name;
+    InstId id;
+    InstFormat format;
+    uint8_t code;   // funct for R-type instructions, opcode otherwise
+} InstDesc;
+
+/* Returns the descriptor for the mnemonic NAME, or NULL if NAME is not an
+   instruction.
+ */
+const InstDesc* lookup_inst(const char* name);
+
+/* Returns the descriptor for the instruction ID. */
+const InstDesc* get_inst(InstId id);
+
+#endif
@@ -0,0 +1,389 @@
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tables.h"
+#include "translate_utils.h"
+#include "trace.h"
+#include "object.h"
+
+/*******************************
+ * Byte Buffer
+ *******************************/
+
+/* The object file is built in memory so that section offsets are known by
+   the time the headers pointing at them are written.
+ */
+typedef struct {
+    uint8_t* data;
+    size_t len, cap;
+    int little_endian;
+} ByteBuf;
+
+static void reserve(ByteBuf* buf, size_t n) {
+    if (buf->len + n <= buf->cap) return;
+    while (buf->len + n > buf->cap) {
+        buf->cap = buf->cap ? buf->cap * 2 : 1024;
+    }
+    buf->data = (uint8_t*) realloc(buf->data, buf->cap);
+    if (buf->data == NULL) allocation_failed();
+}
+
+static void put_bytes(ByteBuf* buf, const void* bytes, size_t n) {
+    if (n == 0) return;
+    reserve(buf, n);
+    memcpy(buf->data + buf->len, bytes, n);
+    buf->len += n;
+}
+
+static void put8(ByteBuf* buf, uint8_t value) {
+    put_bytes(buf, &value, 1);
+}
+
+static void put16(ByteBuf* buf, uint16_t value) {
+    uint8_t b[2];
+    if (buf->little_endian) {
+        b[0] = value; b[1] = value >> 8;
+    } else {
+        b[0] = value >> 8; b[1] = value;
+    }
+    put_bytes(buf, b, 2);
+}
+
+static void put32(ByteBuf* buf, uint32_t value) {
+    uint8_t b[4];
+    if (buf->little_endian) {
+        b[0] = value; b[1] = value >> 8; b[2] = value >> 16; b[3] = value >> 24;
+    } else {
+        b[0] = value >> 24; b[1] = value >> 16; b[2] = value >> 8; b[3] = value;
+    }
+    put_bytes(buf, b, 4);
+}
+
+static void align4(ByteBuf* buf) {
+    while (buf->len % 4) put8(buf, 0);
+}
+
+/* Appends NAME to the string table BUF and returns its offset. */
+static uint32_t put_string(ByteBuf* buf, const char* name) {
+    uint32_t offset = buf->len;
+    put_bytes(buf, name, strlen(name) + 1);
+    return offset;
+}
+
+/*******************************
+ * ELF Object
+ *******************************/
+
+enum { SEC_NULL, SEC_TEXT, SEC_REL_TEXT, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, NUM_SECTIONS };
+
+/* Symbols before the labels: the null symbol and the .text section symbol. */
+#define NUM_LOCAL_SYMBOLS 2
+
+typedef struct {
+    uint32_t name, type, flags, offset, size, link, info, align, entsize;
+} SectionInfo;
+
+static void put_symbol(ByteBuf* buf, uint32_t name, uint32_t value, uint8_t info,
+    uint16_t shndx) {
+    put32(buf, name);
+    put32(buf, value);
+    put32(buf, 0);          // st_size
+    put8(buf, info);
+    put8(buf, 0);           // st_other
+    put16(buf, shndx);
+}
+
+/* Writes a relocatable object with a .text section holding WORDS, a .symtab
+   with every label of SYMTBL (as global symbols defined in .text) followed by
+   the undefined symbols named in RELTBL, and a .rel.text with an R_MIPS_26
+   relocation for every entry of RELTBL.
+ */
+static void write_elf(ObjectWriter* obj, SymbolTable* symtbl, SymbolTable* reltbl) {
+    ByteBuf out = { NULL, 0, 0, obj->little_endian };
+    ByteBuf rel = { NULL, 0, 0, obj->little_endian };
+    ByteBuf syms = { NULL, 0, 0, obj->little_endian };
+    ByteBuf strs = { NULL, 0, 0, obj->little_endian };
+    ByteBuf shstrs = { NULL, 0, 0, obj->little_endian };
+    SectionInfo sec[NUM_SECTIONS];
+    memset(sec, 0, sizeof(sec));
+
+    put_string(&shstrs, "");
+    sec[SEC_TEXT].name = put_string(&shstrs, ".text");
+    sec[SEC_REL_TEXT].name = put_string(&shstrs, ".rel.text");
+    sec[SEC_SYMTAB].name = put_string(&shstrs, ".symtab");
+    sec[SEC_STRTAB].name = put_string(&shstrs, ".strtab");
+    sec[SEC_SHSTRTAB].name = put_string(&shstrs, ".shstrtab");
+
+    //symbols: labels first, then every relocated name that is not a label
+    SymbolTable* externs = create_table(SYMTBL_UNIQUE_NAME);
+    put_string(&strs, "");
+    put_symbol(&syms, 0, 0, 0, SHN_UNDEF);
+    put_symbol(&syms, 0, 0, ELF32_ST_INFO(STB_LOCAL, STT_SECTION), SEC_TEXT);
+    for (uint32_t i = 0; i < symtbl->len; i++) {
+        put_symbol(&syms, put_string(&strs, symtbl->tbl[i].name), symtbl->tbl[i].addr,
+            ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE), SEC_TEXT);
+    }
+    for (uint32_t i = 0; i < reltbl->len; i++) {
+        const char* name = reltbl->tbl[i].name;
+        if (get_index_for_symbol(symtbl, name) == -1
+            && get_index_for_symbol(externs, name) == -1) {
+            add_to_table(externs, name, 0);
+            put_symbol(&syms, put_string(&strs, name), 0,
+                ELF32_ST_INFO(STB_GLOBAL, STT_NOTYPE), SHN_UNDEF);
+        }
+    }
+
+    for (uint32_t i = 0; i < reltbl->len; i++) {
+        const char* name = reltbl->tbl[i].name;
+        int64_t index = get_index_for_symbol(symtbl, name);
+        if (index == -1) {
+            index = symtbl->len + get_index_for_symbol(externs, name);
+        }
+        put32(&rel, reltbl->tbl[i].addr);
+        put32(&rel, ELF32_R_INFO(NUM_LOCAL_SYMBOLS + index, R_MIPS_26));
+    }
+    free_table(externs);
+
+    //file layout: header, section contents, section header table
+    uint8_t header[sizeof(Elf32_Ehdr)] = { 0 };
+    put_bytes(&out, header, sizeof(header));
+
+    sec[SEC_TEXT].type = SHT_PROGBITS;
+    sec[SEC_TEXT].flags = SHF_ALLOC | SHF_EXECINSTR;
+    sec[SEC_TEXT].offset = out.len;
+    sec[SEC_TEXT].size = 4 * obj->len;
+    sec[SEC_TEXT].align = 4;
+    for (uint32_t i = 0; i < obj->len; i++) {
+        put32(&out, obj->words[i]);
+    }
+
+    sec[SEC_REL_TEXT].type = SHT_REL;
+    sec[SEC_REL_TEXT].offset = out.len;
+    sec[SEC_REL_TEXT].size = rel.len;
+    sec[SEC_REL_TEXT].link = SEC_SYMTAB;
+    sec[SEC_REL_TEXT].info = SEC_TEXT;
+    sec[SEC_REL_TEXT].align = 4;
+    sec[SEC_REL_TEXT].entsize = sizeof(Elf32_Rel);
+    put_bytes(&out, rel.data, rel.len);
+
+    sec[SEC_SYMTAB].type = SHT_SYMTAB;
+    sec[SEC_SYMTAB].offset = out.len;
+    sec[SEC_SYMTAB].size = syms.len;
+    sec[SEC_SYMTAB].link = SEC_STRTAB;
+    sec[SEC_SYMTAB].info = NUM_LOCAL_SYMBOLS;
+    sec[SEC_SYMTAB].align = 4;
+    sec[SEC_SYMTAB].entsize = sizeof(Elf32_Sym);
+    put_bytes(&out, syms.data, syms.len);
+
+    sec[SEC_STRTAB].type = SHT_STRTAB;
+    sec[SEC_STRTAB].offset = out.len;
+    sec[SEC_STRTAB].size = strs.len;
+    sec[SEC_STRTAB].align = 1;
+    put_bytes(&out, strs.data, strs.len);
+
+    sec[SEC_SHSTRTAB].type = SHT_STRTAB;
+    sec[SEC_SHSTRTAB].offset = out.len;
+    sec[SEC_SHSTRTAB].size = shstrs.len;
+    sec[SEC_SHSTRTAB].align = 1;
+    put_bytes(&out, shstrs.data, shstrs.len);
+
+    align4(&out);
+    uint32_t shoff = out.len;
+    for (int i = 0; i < NUM_SECTIONS; i++) {
+        put32(&out, sec[i].name);
+        put32(&out, sec[i].type);
+        put32(&out, sec[i].flags);
+        put32(&out, 0);     // sh_addr
+        put32(&out, sec[i].offset);
+        put32(&out, sec[i].size);
+        put32(&out, sec[i].link);
+        put32(&out, sec[i].info);
+        put32(&out, sec[i].align);
+        put32(&out, sec[i].entsize);
+    }
+
+    //now that everything is placed, fill in the header
+    size_t end = out.len;
+    out.len = 0;
+    uint8_t ident[EI_NIDENT] = { ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS32,
+        obj->little_endian ? ELFDATA2LSB : ELFDATA2MSB, EV_CURRENT, ELFOSABI_SYSV };
+    put_bytes(&out, ident, EI_NIDENT);
+    put16(&out, ET_REL);
+    put16(&out, EM_MIPS);
+    put32(&out, EV_CURRENT);
+    put32(&out, 0);         // e_entry
+    put32(&out, 0);         // e_phoff
+    put32(&out, shoff);
+    put32(&out, EF_MIPS_ARCH_32 | EF_MIPS_NOREORDER);
+    put16(&out, sizeof(Elf32_Ehdr));
+    put16(&out, 0);         // e_phentsize
+    put16(&out, 0);         // e_phnum
+    put16(&out, sizeof(Elf32_Shdr));
+    put16(&out, NUM_SECTIONS);
+    put16(&out, SEC_SHSTRTAB);
+    out.len = end;
+
+    outbuf_write(&obj->out, (const char*) out.data, out.len);
+    free(out.data);
+    free(rel.data);
+    free(syms.data);
+    free(strs.data);
+    free(shstrs.data);
+}
+
+/*******************************
+ * Object Writer
+ *******************************/
+
+/* Sets up OBJ, whose output buffer is already open. */
+static void start_object(ObjectWriter* obj, OutputFormat format, int little_endian) {
+    obj->format = format;
+    obj->little_endian = little_endian;
+    obj->words = NULL;
+    obj->len = 0;
+    obj->cap = 0;
+    obj->num_words = 0;
+    if (format == OUTPUT_TEXT) {
+        outbuf_puts(&obj->out, ".text\n");
+    }
+}
+
+/* Starts writing an assembled program to OUTPUT in the given FORMAT. The byte
+   order of words only matters for the binary formats. OUTPUT must not be
+   written to through stdio until object_finish() returns.
+ */
+void object_begin(ObjectWriter* obj, FILE* output, OutputFormat format, int little_endian) {
+    outbuf_open_file(&obj->out, output);
+    start_object(obj, format, little_endian);
+}
+
+/* Same as object_begin(), but the output is collected in memory, where
+   object_finish() leaves it for object_take_memory().
+ */
+void object_begin_memory(ObjectWriter* obj, OutputFormat format, int little_endian) {
+    outbuf_open_memory(&obj->out);
+    start_object(obj, format, little_endian);
+}
+
+/* Makes room in OBJ for N more words. */
+static void reserve_words(ObjectWriter* obj, uint32_t n) {
+    if (obj->len + n <= obj->cap) {
+        return;
+    }
+    while (obj->len + n > obj->cap) {
+        obj->cap = obj->cap ? obj->cap * 2 : 1024;
+    }
+    obj->words = (uint32_t*) realloc(obj->words, obj->cap * sizeof(uint32_t));
+    if (obj->words == NULL) allocation_failed();
+}
+
+/* Writes the words held back in text format. */
+static void flush_text_words(ObjectWriter* obj) {
+    write_inst_hex_n(&obj->out, obj->words, obj->len);
+    obj->len = 0;
+}
+
+/* Appends WORD to the text section. In text format, words are held back
+   until TEXT_BATCH of them can be formatted together.
+ */
+void object_add_word(ObjectWriter* obj, uint32_t word) {
+    obj->num_words += 1;
+    if (obj->format == OUTPUT_TEXT && obj->len == TEXT_BATCH) {
+        flush_text_words(obj);
+    }
+    reserve_words(obj, 1);
+    obj->words[obj->len++] = word;
+}
+
+/* Appends the N words at WORDS to the text section, such as a whole chunk of
+   it that was encoded separately.
+ */
+void object_add_words(ObjectWriter* obj, const uint32_t* words, uint32_t n) {
+    if (n == 0) {
+        return;
+    }
+    obj->num_words += n;
+    if (obj->format == OUTPUT_TEXT) {
+        flush_text_words(obj);
+        write_inst_hex_n(&obj->out, words, n);
+        return;
+    }
+    reserve_words(obj, n);
+    memcpy(obj->words + obj->len, words, n * sizeof(uint32_t));
+    obj->len += n;
+}
+
+/* Writes whatever the format still needs once the text section is complete:
+   the symbol and relocation tables for text output, the whole image for the
+   binary formats. Raw binary output has no room for either table. Returns -1
+   if the output could not be written, 0 otherwise.
+ */
+int object_finish(ObjectWriter* obj, SymbolTable* symtbl, SymbolTable* reltbl) {
+    if (obj->format == OUTPUT_TEXT) {
+        flush_text_words(obj);
+
+        trace_begin("write_table symbols", NULL);
+        outbuf_puts(&obj->out, "\n.symbol\n");
+        write_table(symtbl, &obj->out);
+        trace_end("write_table symbols");
+
+        trace_begin("write_table relocations", NULL);
+        outbuf_puts(&obj->out, "\n.relocation\n");
+        write_table(reltbl, &obj->out);
+        trace_end("write_table relocations");
+    } else if (obj->format == OUTPUT_BIN) {
+        trace_begin("write_image", NULL);
+        ByteBuf image = { NULL, 0, 0, obj->little_endian };
+        for (uint32_t i = 0; i < obj->len; i++) {
+            put32(&image, obj->words[i]);
+        }
+        outbuf_write(&obj->out, (const char*) image.data, image.len);
+        free(image.data);
+        trace_end("write_image");
+    } else {
+        trace_begin("write_elf", NULL);
+        write_elf(obj, symtbl, reltbl);
+        trace_end("write_elf");
+    }
+
+    int err = 0;
+    if (obj->out.fd >= 0) {
+        trace_begin("flush output", NULL);
+        err = outbuf_close(&obj->out);
+        trace_end("flush output");
+    }
+    free(obj->words);
+    obj->words = NULL;
+    obj->len = obj->cap = 0;
+    return err;
+}
+
+/* Returns the output of OBJ, started with object_begin_memory(), once
+   object_finish() has returned. Its length is stored in LEN and the caller
+   frees it.
+ */
+char* object_take_memory(ObjectWriter* obj, size_t* len) {
+    char* data = obj->out.data;
+    *len = obj->out.len;
+    obj->out.data = NULL;
+    obj->out.len = obj->out.cap = 0;
+    return data;
+}
+
+/* Reads the name of an output format ("text", "bin" or "elf") into FORMAT.
+   Returns 0 on success and -1 if NAME is not a format.
+ */
+int parse_output_format(OutputFormat* format, const char* name) {
+    if (strcmp(name, "text") == 0) {
+        *format = OUTPUT_TEXT;
+    } else if (strcmp(name, "bin") == 0) {
+        *format = OUTPUT_BIN;
+    } else if (strcmp(name, "elf") == 0) {
+        *format = OUTPUT_ELF;
+    } else {
+        return -1;
+    }
+    return 0;
+}
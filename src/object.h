@@ -0,0 +1,49 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "outbuf.h"
+#include "tables.h"
+
+/* How the assembled program is written to the output file. */
+typedef enum {
+    OUTPUT_TEXT,        // .text/.symbol/.relocation listing, one hex word per line
+    OUTPUT_BIN,         // raw image of the text section
+    OUTPUT_ELF          // ELF32 MIPS relocatable object
+} OutputFormat;
+
+/* Words held back by object_add_word() in text format, so that they are
+   formatted in batches.
+ */
+#define TEXT_BATCH 1024
+
+/* Receives the words of the text section as they are encoded. In text format
+   they are written to OUT in batches of up to TEXT_BATCH; the other formats
+   need the whole section and write it in object_finish().
+ */
+typedef struct {
+    OutBuf out;
+    OutputFormat format;
+    int little_endian;
+    uint32_t* words;
+    uint32_t len, cap;
+    uint64_t num_words;     // words added so far, in any format
+} ObjectWriter;
+
+void object_begin(ObjectWriter* obj, FILE* output, OutputFormat format, int little_endian);
+
+void object_begin_memory(ObjectWriter* obj, OutputFormat format, int little_endian);
+
+void object_add_word(ObjectWriter* obj, uint32_t word);
+
+void object_add_words(ObjectWriter* obj, const uint32_t* words, uint32_t n);
+
+int object_finish(ObjectWriter* obj, SymbolTable* symtbl, SymbolTable* reltbl);
+
+char* object_take_memory(ObjectWriter* obj, size_t* len);
+
+int parse_output_format(OutputFormat* format, const char* name);
+
+#endif
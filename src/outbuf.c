@@ -0,0 +1,315 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#include "tables.h"
+#include "outbuf.h"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/* Starts buffering output for the file descriptor FD. */
+void outbuf_open(OutBuf* buf, int fd) {
+    buf->fd = fd;
+    buf->len = 0;
+    buf->cap = OUTBUF_SIZE;
+    buf->failed = 0;
+    buf->data = (char*) malloc(buf->cap);
+    if (buf->data == NULL) allocation_failed();
+}
+
+/* Starts collecting output in memory, where it stays until the buffer is
+   closed.
+ */
+void outbuf_open_memory(OutBuf* buf) {
+    buf->fd = -1;
+    buf->len = 0;
+    buf->cap = 4096;
+    buf->failed = 0;
+    buf->data = (char*) malloc(buf->cap);
+    if (buf->data == NULL) allocation_failed();
+}
+
+/* Starts buffering output for FILE. Anything already written to FILE through
+   stdio is flushed first, and FILE should not be written to again until the
+   buffer is closed.
+ */
+void outbuf_open_file(OutBuf* buf, FILE* file) {
+    fflush(file);
+    outbuf_open(buf, fileno(file));
+}
+
+/* Writes LEN bytes of DATA to FD, retrying after partial writes. */
+static int write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Writes out everything in BUF. Returns -1 if this or any earlier write
+   failed, 0 otherwise.
+ */
+int outbuf_flush(OutBuf* buf) {
+    if (buf->fd < 0) {
+        return 0;
+    }
+    if (buf->len > 0 && !buf->failed) {
+        if (write_all(buf->fd, buf->data, buf->len) != 0) {
+            buf->failed = 1;
+        }
+    }
+    buf->len = 0;
+    return buf->failed ? -1 : 0;
+}
+
+/* Flushes BUF and frees its memory. The file descriptor is left open. Returns
+   -1 if any write failed, 0 otherwise.
+ */
+int outbuf_close(OutBuf* buf) {
+    int err = outbuf_flush(buf);
+    free(buf->data);
+    buf->data = NULL;
+    return err;
+}
+
+/* Makes room for LEN more bytes. */
+static void reserve(OutBuf* buf, size_t len) {
+    if (buf->len + len <= buf->cap) {
+        return;
+    }
+    if (buf->fd >= 0) {
+        outbuf_flush(buf);
+        return;
+    }
+    while (buf->len + len > buf->cap) {
+        buf->cap *= 2;
+    }
+    buf->data = (char*) realloc(buf->data, buf->cap);
+    if (buf->data == NULL) allocation_failed();
+}
+
+void outbuf_write(OutBuf* buf, const char* str, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    if (len > buf->cap && buf->fd >= 0) {
+        //too big to be worth copying
+        outbuf_flush(buf);
+        if (!buf->failed && write_all(buf->fd, str, len) != 0) {
+            buf->failed = 1;
+        }
+        return;
+    }
+    reserve(buf, len);
+    memcpy(buf->data + buf->len, str, len);
+    buf->len += len;
+}
+
+void outbuf_puts(OutBuf* buf, const char* str) {
+    outbuf_write(buf, str, strlen(str));
+}
+
+void outbuf_putc(OutBuf* buf, char c) {
+    reserve(buf, 1);
+    buf->data[buf->len++] = c;
+}
+
+/* Writes VALUE as 8 lowercase hexadecimal digits, like "%08x". */
+void outbuf_hex32(OutBuf* buf, uint32_t value) {
+    reserve(buf, 8);
+    char* out = buf->data + buf->len;
+    for (int i = 7; i >= 0; i--) {
+        out[i] = HEX_DIGITS[value & 0xf];
+        value >>= 4;
+    }
+    buf->len += 8;
+}
+
+/* Words formatted by outbuf_hex32_lines() between checks for room. */
+#define HEX_BATCH 4096
+
+/* Bytes of a word formatted as "%08x\n". */
+#define HEX_LINE 9
+
+/* Formats the N words at VALUES into OUT, one at a time. */
+static void hex_lines_scalar(char* out, const uint32_t* values, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        uint32_t value = values[i];
+        for (int j = 7; j >= 0; j--) {
+            out[j] = HEX_DIGITS[value & 0xf];
+            value >>= 4;
+        }
+        out[8] = '\n';
+        out += HEX_LINE;
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+/* Formats four words at a time: their bytes are put in big-endian order,
+   split into nibbles, and each nibble is looked up in HEX_DIGITS with a
+   byte shuffle. Returns how many words were formatted.
+ */
+__attribute__((target("ssse3")))
+static size_t hex_lines_ssse3(char* out, const uint32_t* values, size_t n) {
+    const __m128i digits = _mm_loadu_si128((const __m128i*) HEX_DIGITS);
+    const __m128i swap = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i nibble = _mm_set1_epi8(0xf);
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (values + i)), swap);
+        __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+        __m128i lo = _mm_and_si128(v, nibble);
+        __m128i first = _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(hi, lo));
+        __m128i second = _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(hi, lo));
+
+        char* p = out + i * HEX_LINE;
+        _mm_storel_epi64((__m128i*) p, first);
+        _mm_storel_epi64((__m128i*) (p + 9), _mm_unpackhi_epi64(first, first));
+        _mm_storel_epi64((__m128i*) (p + 18), second);
+        _mm_storel_epi64((__m128i*) (p + 27), _mm_unpackhi_epi64(second, second));
+        p[8] = p[17] = p[26] = p[35] = '\n';
+    }
+    return i;
+}
+
+/* Same as hex_lines_ssse3(), eight words at a time. The shuffles work within
+   each 128-bit lane, so the two lanes hold words 0-3 and 4-7.
+ */
+__attribute__((target("avx2")))
+static size_t hex_lines_avx2(char* out, const uint32_t* values, size_t n) {
+    const __m256i digits = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128((const __m128i*) HEX_DIGITS));
+    const __m256i swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i nibble = _mm256_set1_epi8(0xf);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i*) (values + i)), swap);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+        __m256i lo = _mm256_and_si256(v, nibble);
+        __m256i first = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(hi, lo));
+        __m256i second = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(hi, lo));
+
+        __m128i words[4] = {
+            _mm256_castsi256_si128(first),          // words 0 and 1
+            _mm256_castsi256_si128(second),         // words 2 and 3
+            _mm256_extracti128_si256(first, 1),     // words 4 and 5
+            _mm256_extracti128_si256(second, 1),    // words 6 and 7
+        };
+        char* p = out + i * HEX_LINE;
+        for (int j = 0; j < 4; j++) {
+            _mm_storel_epi64((__m128i*) p, words[j]);
+            _mm_storel_epi64((__m128i*) (p + 9), _mm_unpackhi_epi64(words[j], words[j]));
+            p[8] = p[17] = '\n';
+            p += 18;
+        }
+    }
+    return i;
+}
+#endif
+
+/* The implementation outbuf_hex32_lines() uses, chosen on first use. Only
+   ever set to the same value by different threads, so relaxed atomics
+   suffice.
+ */
+static int hex_level = -1;
+
+/* Returns 1 if the CPU running the program can use LEVEL. */
+static int hex_supported(HexLevel level) {
+    switch (level) {
+        case HEX_SCALAR:
+            return 1;
+#ifdef HAVE_X86_SIMD
+        case HEX_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+        case HEX_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+/* Returns the implementation outbuf_hex32_lines() uses: the fastest one the
+   CPU supports, unless set_hex_level() picked another.
+ */
+HexLevel get_hex_level() {
+    int level = __atomic_load_n(&hex_level, __ATOMIC_RELAXED);
+    if (level == -1) {
+        level = HEX_AVX2;
+        while (!hex_supported(level)) {
+            level -= 1;
+        }
+        __atomic_store_n(&hex_level, level, __ATOMIC_RELAXED);
+    }
+    return (HexLevel) level;
+}
+
+/* Makes outbuf_hex32_lines() use LEVEL, for tests and benchmarks. Returns 0
+   on success and -1 if the CPU does not support it.
+ */
+int set_hex_level(HexLevel level) {
+    if (!hex_supported(level)) {
+        return -1;
+    }
+    __atomic_store_n(&hex_level, level, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Writes each of the N words at VALUES like outbuf_hex32() followed by a
+   newline, several words at a time where the CPU allows it.
+ */
+void outbuf_hex32_lines(OutBuf* buf, const uint32_t* values, size_t n) {
+    HexLevel level = get_hex_level();
+
+    while (n > 0) {
+        size_t batch = n < HEX_BATCH ? n : HEX_BATCH;
+        reserve(buf, batch * HEX_LINE);
+        char* out = buf->data + buf->len;
+        size_t done = 0;
+#ifdef HAVE_X86_SIMD
+        if (level == HEX_AVX2) {
+            done = hex_lines_avx2(out, values, batch);
+        }
+        if (level >= HEX_SSSE3) {
+            done += hex_lines_ssse3(out + done * HEX_LINE, values + done, batch - done);
+        }
+#endif
+        hex_lines_scalar(out + done * HEX_LINE, values + done, batch - done);
+        buf->len += batch * HEX_LINE;
+        values += batch;
+        n -= batch;
+    }
+}
+
+/* Writes VALUE in decimal, like "%u". */
+void outbuf_dec32(OutBuf* buf, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    reserve(buf, n);
+    char* out = buf->data + buf->len;
+    for (int i = 0; i < n; i++) {
+        out[i] = digits[n - 1 - i];
+    }
+    buf->len += n;
+}
@@ -0,0 +1,56 @@
+#ifndef OUTBUF_H
+#define OUTBUF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Size of the buffer, which is flushed with one write(2) when it fills up. */
+#define OUTBUF_SIZE (256 * 1024)
+
+/* Implementations of outbuf_hex32_lines(). */
+typedef enum {
+    HEX_SCALAR,
+    HEX_SSSE3,
+    HEX_AVX2
+} HexLevel;
+
+/* Output collected in memory and written to a file descriptor in large
+   pieces, without going through stdio. A buffer without a file descriptor
+   keeps growing instead, and its contents are read from DATA.
+ */
+typedef struct {
+    int fd;         // -1 for a memory buffer
+    char* data;
+    size_t len;
+    size_t cap;
+    int failed;     // a write failed; everything after it is dropped
+} OutBuf;
+
+void outbuf_open(OutBuf* buf, int fd);
+
+void outbuf_open_memory(OutBuf* buf);
+
+void outbuf_open_file(OutBuf* buf, FILE* file);
+
+int outbuf_flush(OutBuf* buf);
+
+int outbuf_close(OutBuf* buf);
+
+void outbuf_write(OutBuf* buf, const char* str, size_t len);
+
+void outbuf_puts(OutBuf* buf, const char* str);
+
+void outbuf_putc(OutBuf* buf, char c);
+
+void outbuf_hex32(OutBuf* buf, uint32_t value);
+
+void outbuf_hex32_lines(OutBuf* buf, const uint32_t* values, size_t n);
+
+int set_hex_level(HexLevel level);
+
+HexLevel get_hex_level();
+
+void outbuf_dec32(OutBuf* buf, uint32_t value);
+
+#endif
@@ -0,0 +1,167 @@
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "tables.h"
+#include "pool.h"
+
+typedef struct {
+    TaskFunc fn;
+    void* arg;
+    uint32_t num_tasks;
+    uint32_t next;          // next task to hand out, taken atomically
+} TaskQueue;
+
+static void* worker(void* data) {
+    TaskQueue* queue = (TaskQueue*) data;
+    uint32_t task;
+    while ((task = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED)) < queue->num_tasks) {
+        queue->fn(queue->arg, task);
+    }
+    return NULL;
+}
+
+/* Calls FN(ARG, i) for every i below NUM_TASKS, using up to NUM_THREADS
+   threads including the calling one, and returns once every task is done.
+   Tasks are handed out in order to whichever thread is free, so they may
+   finish in any order. If threads cannot be created, the remaining ones do
+   all of the work.
+ */
+void run_tasks(uint32_t num_threads, uint32_t num_tasks, TaskFunc fn, void* arg) {
+    TaskQueue queue = { fn, arg, num_tasks, 0 };
+
+    if (num_threads > num_tasks) num_threads = num_tasks;
+    if (num_threads <= 1) {
+        worker(&queue);
+        return;
+    }
+
+    pthread_t* threads = (pthread_t*) malloc((num_threads - 1) * sizeof(pthread_t));
+    if (threads == NULL) allocation_failed();
+
+    uint32_t started = 0;
+    while (started < num_threads - 1
+        && pthread_create(&threads[started], NULL, worker, &queue) == 0) {
+        started += 1;
+    }
+    worker(&queue);
+    for (uint32_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+}
+
+/* The tasks a worker of run_worker_tasks() has left: NEXT up to END. */
+typedef struct {
+    pthread_mutex_t lock;
+    uint32_t next;
+    uint32_t end;
+} TaskRange;
+
+typedef struct {
+    WorkerTaskFunc fn;
+    void* arg;
+    uint32_t num_workers;
+    TaskRange* ranges;
+} StealPool;
+
+typedef struct {
+    StealPool* pool;
+    uint32_t id;
+} StealWorker;
+
+/* Takes the next task of RANGE into TASK. Returns 0 if RANGE is empty. */
+static int pop_task(TaskRange* range, uint32_t* task) {
+    pthread_mutex_lock(&range->lock);
+    int found = range->next < range->end;
+    if (found) {
+        *task = range->next++;
+    }
+    pthread_mutex_unlock(&range->lock);
+    return found;
+}
+
+/* Takes the upper half of the tasks left to another worker, runs the first
+   of them straight away and keeps the rest in the range of SELF. Returns 0 if
+   every other worker has run out too.
+ */
+static int steal_tasks(StealWorker* self, uint32_t* task) {
+    StealPool* pool = self->pool;
+    for (uint32_t i = 1; i < pool->num_workers; i++) {
+        TaskRange* victim = &pool->ranges[(self->id + i) % pool->num_workers];
+        uint32_t start = 0, end = 0;
+
+        pthread_mutex_lock(&victim->lock);
+        if (victim->next < victim->end) {
+            start = victim->next + (victim->end - victim->next) / 2;
+            end = victim->end;
+            victim->end = start;
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (start < end) {
+            TaskRange* own = &pool->ranges[self->id];
+            pthread_mutex_lock(&own->lock);
+            own->next = start + 1;
+            own->end = end;
+            pthread_mutex_unlock(&own->lock);
+            *task = start;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void* steal_worker(void* data) {
+    StealWorker* self = (StealWorker*) data;
+    StealPool* pool = self->pool;
+    uint32_t task;
+    while (pop_task(&pool->ranges[self->id], &task) || steal_tasks(self, &task)) {
+        pool->fn(pool->arg, self->id, task);
+    }
+    return NULL;
+}
+
+/* Calls FN(ARG, w, i) for every i below NUM_TASKS, where w is the thread
+   running the task, using up to NUM_THREADS threads including the calling
+   one, which is always thread 0. Returns once every task is done.
+
+   Each thread starts with an equal run of consecutive tasks, and a thread
+   that runs out takes half of what another has left, so a few slow tasks do
+   not hold the others up. If threads cannot be created, the tasks given to
+   them are taken by the threads that were.
+ */
+void run_worker_tasks(uint32_t num_threads, uint32_t num_tasks, WorkerTaskFunc fn, void* arg) {
+    if (num_threads > num_tasks) num_threads = num_tasks;
+    if (num_threads < 1) num_threads = 1;
+
+    StealPool pool = { fn, arg, num_threads, NULL };
+    pool.ranges = (TaskRange*) malloc(num_threads * sizeof(TaskRange));
+    StealWorker* workers = (StealWorker*) malloc(num_threads * sizeof(StealWorker));
+    pthread_t* threads = (pthread_t*) malloc(num_threads * sizeof(pthread_t));
+    if (pool.ranges == NULL || workers == NULL || threads == NULL) allocation_failed();
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool.ranges[i].lock, NULL);
+        pool.ranges[i].next = (uint64_t) num_tasks * i / num_threads;
+        pool.ranges[i].end = (uint64_t) num_tasks * (i + 1) / num_threads;
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+
+    uint32_t started = 1;
+    while (started < num_threads
+        && pthread_create(&threads[started], NULL, steal_worker, &workers[started]) == 0) {
+        started += 1;
+    }
+    steal_worker(&workers[0]);
+    for (uint32_t i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        pthread_mutex_destroy(&pool.ranges[i].lock);
+    }
+    free(threads);
+    free(workers);
+    free(pool.ranges);
+}
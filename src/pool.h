@@ -0,0 +1,18 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+
+/* One task of run_tasks(). ARG is shared by every task. */
+typedef void (*TaskFunc)(void* arg, uint32_t task);
+
+void run_tasks(uint32_t num_threads, uint32_t num_tasks, TaskFunc fn, void* arg);
+
+/* One task of run_worker_tasks(). WORKER identifies the thread running it, and
+   is below the number of threads.
+ */
+typedef void (*WorkerTaskFunc)(void* arg, uint32_t worker, uint32_t task);
+
+void run_worker_tasks(uint32_t num_threads, uint32_t num_tasks, WorkerTaskFunc fn, void* arg);
+
+#endif
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#include "tables.h"
+#include "reader.h"
+
+/* Blocks of input may be classified past its end, so the vector loads are
+   not checked by AddressSanitizer.
+ */
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef NO_SANITIZE_ADDRESS
+#define NO_SANITIZE_ADDRESS
+#endif
+
+/* Classes of a character, as bits of CHAR_CLASS. */
+enum {
+    CHAR_NEWLINE = 1,
+    CHAR_COMMENT = 2,
+    CHAR_DELIM = 4,         // separates tokens: " \f\n\r\t\v,()"
+    CHAR_COLON = 8
+};
+
+static const unsigned char CHAR_CLASS[256] = {
+    [' '] = CHAR_DELIM, ['\f'] = CHAR_DELIM, ['\n'] = CHAR_NEWLINE | CHAR_DELIM,
+    ['\r'] = CHAR_DELIM, ['\t'] = CHAR_DELIM, ['\v'] = CHAR_DELIM,
+    [','] = CHAR_DELIM, ['('] = CHAR_DELIM, [')'] = CHAR_DELIM,
+    ['#'] = CHAR_COMMENT, [':'] = CHAR_COLON,
+};
+
+#define IS_DELIM(c) (CHAR_CLASS[(unsigned char) (c)] & CHAR_DELIM)
+
+/* Makes the contents of INPUT available through READER. Regular files are
+   mapped into memory; anything else (pipes, terminals) is read into a buffer.
+   Returns 0 on success and -1 if INPUT could not be read.
+ */
+int reader_open(SourceReader* reader, FILE* input) {
+    struct stat st;
+    int fd = fileno(input);
+
+    reader->pos = 0;
+    reader->has_masks = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+            reader->data = (const char*) data;
+            reader->size = st.st_size;
+            reader->mapped = 1;
+            return 0;
+        }
+    }
+
+    size_t cap = 4096, size = 0, n;
+    char* data = (char*) malloc(cap);
+    if (data == NULL) allocation_failed();
+    while ((n = fread(data + size, 1, cap - size, input)) > 0) {
+        size += n;
+        if (size == cap) {
+            cap *= 2;
+            data = (char*) realloc(data, cap);
+            if (data == NULL) allocation_failed();
+        }
+    }
+    reader->data = data;
+    reader->size = size;
+    reader->mapped = 0;
+    return ferror(input) ? -1 : 0;
+}
+
+void reader_close(SourceReader* reader) {
+    if (reader->mapped) {
+        munmap((void*) reader->data, reader->size);
+    } else {
+        free((void*) reader->data);
+    }
+    reader->data = NULL;
+    reader->size = 0;
+}
+
+/* Stores the next line of the input in LINE, without its newline. A last line
+   that does not end in a newline still counts. Returns 0 once the input is
+   exhausted and 1 otherwise.
+
+   Newlines are found with classify_chars(), a block at a time, and the masks
+   of the last block are kept for the lines that follow in it, and for
+   reader_line_masks().
+ */
+int reader_next_line(SourceReader* reader, Slice* line) {
+    if (reader->pos >= reader->size) {
+        return 0;
+    }
+    size_t at = reader->pos;
+    size_t end = reader->size;
+
+    while (at < reader->size) {
+        if (!reader->has_masks || at < reader->mask_start
+            || at >= reader->mask_start + CLASSIFY_BLOCK) {
+            size_t left = reader->size - at;
+            classify_chars(reader->data + at, left < CLASSIFY_BLOCK ? left : CLASSIFY_BLOCK,
+                &reader->masks);
+            reader->mask_start = at;
+            reader->has_masks = 1;
+        }
+        uint64_t newlines = reader->masks.newline >> (at - reader->mask_start);
+        if (newlines) {
+            end = at + __builtin_ctzll(newlines);
+            break;
+        }
+        at = reader->mask_start + CLASSIFY_BLOCK;
+    }
+
+    line->ptr = reader->data + reader->pos;
+    line->len = end - reader->pos;
+    reader->pos = end < reader->size ? end + 1 : end;
+    return 1;
+}
+
+/* Stores in MASKS the classes of the bytes of LINE, the line last returned
+   by reader_next_line(), if they are already known because the line lies in
+   the last block it classified. Returns MASKS if they are, and NULL if the
+   line has to be classified again.
+ */
+const CharMasks* reader_line_masks(const SourceReader* reader, Slice line,
+    CharMasks* masks) {
+    size_t start = line.ptr - reader->data;
+    if (!reader->has_masks || start < reader->mask_start
+        || start + line.len > reader->mask_start + CLASSIFY_BLOCK) {
+        return NULL;
+    }
+    unsigned shift = start - reader->mask_start;
+    uint64_t valid = line.len == CLASSIFY_BLOCK ? ~(uint64_t) 0 : ((uint64_t) 1 << line.len) - 1;
+    masks->newline = (reader->masks.newline >> shift) & valid;
+    masks->comment = (reader->masks.comment >> shift) & valid;
+    masks->delim = (reader->masks.delim >> shift) & valid;
+    masks->colon = (reader->masks.colon >> shift) & valid;
+    return masks;
+}
+
+/* Stores the next token of REST in TOK and advances REST past it. Tokens are
+   separated by any run of whitespace, commas and parentheses. Returns 0 if no
+   token is left.
+ */
+int next_token(Slice* rest, Slice* tok) {
+    const char* p = rest->ptr;
+    const char* end = p + rest->len;
+
+    while (p < end && IS_DELIM(*p)) p++;
+    if (p == end) {
+        rest->ptr = end;
+        rest->len = 0;
+        return 0;
+    }
+
+    tok->ptr = p;
+    while (p < end && !IS_DELIM(*p)) p++;
+    tok->len = p - tok->ptr;
+
+    rest->ptr = p;
+    rest->len = end - p;
+    return 1;
+}
+
+/* Sets the bits of MASKS for the LEN bytes at STR, one byte at a time. */
+static void classify_scalar(const char* str, size_t len, CharMasks* masks) {
+    uint64_t newline = 0, comment = 0, delim = 0, colon = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        uint64_t bit = (uint64_t) 1 << i;
+        unsigned char cls = CHAR_CLASS[(unsigned char) str[i]];
+        if (cls & CHAR_NEWLINE) newline |= bit;
+        if (cls & CHAR_COMMENT) comment |= bit;
+        if (cls & CHAR_DELIM) delim |= bit;
+        if (cls & CHAR_COLON) colon |= bit;
+    }
+    masks->newline = newline;
+    masks->comment = comment;
+    masks->delim = delim;
+    masks->colon = colon;
+}
+
+#ifdef HAVE_X86_SIMD
+/* Smallest page size; a block that stays inside one can always be loaded. */
+#define CLASSIFY_PAGE 4096
+
+/* Classifies the LEN bytes at STR, 16 at a time. */
+__attribute__((target("sse2"))) NO_SANITIZE_ADDRESS
+static void classify_sse2(const char* str, size_t len, CharMasks* masks) {
+    masks->newline = masks->comment = masks->delim = masks->colon = 0;
+
+    for (size_t i = 0; i < len; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*) (str + i));
+        //\t, \n, \v, \f and \r are the five characters from 9 up
+        __m128i from_tab = _mm_sub_epi8(c, _mm_set1_epi8('\t'));
+        __m128i space = _mm_cmpeq_epi8(_mm_min_epu8(from_tab, _mm_set1_epi8(4)), from_tab);
+        __m128i delim = _mm_or_si128(
+            _mm_or_si128(space, _mm_cmpeq_epi8(c, _mm_set1_epi8(' '))),
+            _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(',')),
+                _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('(')),
+                    _mm_cmpeq_epi8(c, _mm_set1_epi8(')')))));
+
+        masks->newline |= (uint64_t) (uint16_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'))) << i;
+        masks->comment |= (uint64_t) (uint16_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(c, _mm_set1_epi8('#'))) << i;
+        masks->delim |= (uint64_t) (uint16_t) _mm_movemask_epi8(delim) << i;
+        masks->colon |= (uint64_t) (uint16_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(c, _mm_set1_epi8(':'))) << i;
+    }
+}
+
+/* Classifies the LEN bytes at STR, 32 at a time. */
+__attribute__((target("avx2"))) NO_SANITIZE_ADDRESS
+static void classify_avx2(const char* str, size_t len, CharMasks* masks) {
+    masks->newline = masks->comment = masks->delim = masks->colon = 0;
+
+    for (size_t i = 0; i < len; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*) (str + i));
+        __m256i from_tab = _mm256_sub_epi8(c, _mm256_set1_epi8('\t'));
+        __m256i space = _mm256_cmpeq_epi8(_mm256_min_epu8(from_tab, _mm256_set1_epi8(4)),
+            from_tab);
+        __m256i delim = _mm256_or_si256(
+            _mm256_or_si256(space, _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(',')),
+                _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8('(')),
+                    _mm256_cmpeq_epi8(c, _mm256_set1_epi8(')')))));
+
+        masks->newline |= (uint64_t) (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'))) << i;
+        masks->comment |= (uint64_t) (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(c, _mm256_set1_epi8('#'))) << i;
+        masks->delim |= (uint64_t) (uint32_t) _mm256_movemask_epi8(delim) << i;
+        masks->colon |= (uint64_t) (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(c, _mm256_set1_epi8(':'))) << i;
+    }
+}
+#endif
+
+/* The implementation classify_chars() uses, chosen on first use. Only ever
+   set to the same value by different threads, so relaxed atomics suffice.
+ */
+static int classify_level = -1;
+
+/* Returns 1 if the CPU running the program can use LEVEL. */
+static int classify_supported(ClassifyLevel level) {
+    switch (level) {
+        case CLASSIFY_SCALAR:
+            return 1;
+#ifdef HAVE_X86_SIMD
+        case CLASSIFY_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case CLASSIFY_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return 0;
+    }
+}
+
+/* Returns the implementation classify_chars() uses: the fastest one the CPU
+   supports, unless set_classify_level() picked another.
+ */
+ClassifyLevel get_classify_level() {
+    int level = __atomic_load_n(&classify_level, __ATOMIC_RELAXED);
+    if (level == -1) {
+        level = CLASSIFY_AVX2;
+        while (!classify_supported(level)) {
+            level -= 1;
+        }
+        __atomic_store_n(&classify_level, level, __ATOMIC_RELAXED);
+    }
+    return (ClassifyLevel) level;
+}
+
+/* Makes classify_chars() use LEVEL, for tests and benchmarks. Returns 0 on
+   success and -1 if the CPU does not support it.
+ */
+int set_classify_level(ClassifyLevel level) {
+    if (!classify_supported(level)) {
+        return -1;
+    }
+    __atomic_store_n(&classify_level, level, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* Sets MASKS to describe the LEN bytes at STR, where LEN is at most
+   CLASSIFY_BLOCK. Bits from LEN up are clear.
+ */
+NO_SANITIZE_ADDRESS
+void classify_chars(const char* str, size_t len, CharMasks* masks) {
+    ClassifyLevel level = get_classify_level();
+
+#ifdef HAVE_X86_SIMD
+    if (level != CLASSIFY_SCALAR) {
+        //reading past the end of the input is harmless as long as the block
+        //does not reach into the next page, which may not be mapped
+        char tail[CLASSIFY_BLOCK];
+        if (len < CLASSIFY_BLOCK
+            && ((uintptr_t) str & (CLASSIFY_PAGE - 1)) > CLASSIFY_PAGE - CLASSIFY_BLOCK) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, str, len);
+            str = tail;
+        }
+        if (level == CLASSIFY_AVX2) {
+            classify_avx2(str, len, masks);
+        } else {
+            classify_sse2(str, len, masks);
+        }
+        if (len < CLASSIFY_BLOCK) {
+            uint64_t valid = ((uint64_t) 1 << len) - 1;
+            masks->newline &= valid;
+            masks->comment &= valid;
+            masks->delim &= valid;
+            masks->colon &= valid;
+        }
+        return;
+    }
+#endif
+    classify_scalar(str, len, masks);
+}
+
+/* Splits LINE into tokens like next_token() does, stopping at the first '#'.
+   The first MAX_TOKS tokens are stored in TOKS, and bit i of COLONS is set if
+   token i ends in ':' (for i below 32). Returns the number of tokens stored.
+
+   The line is classified a block at a time, unless MASKS already describes
+   it (from reader_line_masks()), and tokens are found from where the
+   delimiter mask changes, rather than by looking at every byte.
+ */
+int scan_tokens(Slice line, const CharMasks* masks, Slice* toks, int max_toks,
+    uint32_t* colons) {
+    int n = 0;
+    uint64_t in_token = 0;          // the last block ended inside a token
+    uint64_t last_colon = 0;        // the last byte of the last block is ':'
+    size_t start = 0;
+
+    *colons = 0;
+    for (size_t off = 0; off < line.len; off += CLASSIFY_BLOCK) {
+        size_t len = line.len - off < CLASSIFY_BLOCK ? line.len - off : CLASSIFY_BLOCK;
+        CharMasks block;
+        if (masks && off == 0) {
+            block = *masks;
+        } else {
+            classify_chars(line.ptr + off, len, &block);
+        }
+
+        uint64_t valid = len == CLASSIFY_BLOCK ? ~(uint64_t) 0 : ((uint64_t) 1 << len) - 1;
+        uint64_t comment = block.comment & valid;
+        if (comment) {
+            valid &= (comment & -comment) - 1;
+        }
+
+        //a token starts where a token byte follows a delimiter, and ends where
+        //a delimiter (or the end of the line) follows a token byte
+        uint64_t word = ~block.delim & valid;
+        uint64_t prev = (word << 1) | in_token;
+        uint64_t edges = (word & ~prev) | (~word & prev);
+
+        while (edges) {
+            int i = __builtin_ctzll(edges);
+            edges &= edges - 1;
+            if (!in_token) {
+                start = off + i;
+                in_token = 1;
+                continue;
+            }
+            toks[n].ptr = line.ptr + start;
+            toks[n].len = off + i - start;
+            uint64_t colon = i > 0 ? (block.colon >> (i - 1)) & 1 : last_colon;
+            if (colon && n < 32) {
+                *colons |= (uint32_t) 1 << n;
+            }
+            in_token = 0;
+            if (++n == max_toks) {
+                return n;
+            }
+        }
+        if (comment) {
+            return n;
+        }
+        in_token = (word >> (CLASSIFY_BLOCK - 1)) & 1;
+        last_colon = (block.colon >> (CLASSIFY_BLOCK - 1)) & 1;
+    }
+
+    //only a token that runs up to the end of a full block is still open
+    if (in_token) {
+        toks[n].ptr = line.ptr + start;
+        toks[n].len = line.len - start;
+        if (last_colon && n < 32) {
+            *colons |= (uint32_t) 1 << n;
+        }
+        n++;
+    }
+    return n;
+}
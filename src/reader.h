@@ -0,0 +1,67 @@
+#ifndef READER_H
+#define READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* A piece of the input, which is NOT NUL-terminated. */
+typedef struct {
+    const char* ptr;
+    size_t len;
+} Slice;
+
+/* Bytes classified at a time by classify_chars(). */
+#define CLASSIFY_BLOCK 64
+
+/* The characters the tokenizer cares about in a block of input, as masks
+   where bit i stands for byte i.
+ */
+typedef struct {
+    uint64_t newline;
+    uint64_t comment;       // '#'
+    uint64_t delim;         // whitespace, ',', '(' and ')'
+    uint64_t colon;
+} CharMasks;
+
+/* Gives out the lines of an input file, which is memory-mapped whenever
+   possible so that no line is ever copied.
+ */
+typedef struct {
+    const char* data;
+    size_t size;
+    size_t pos;     // start of the next line
+    int mapped;     // DATA is a mapping rather than a malloc'd copy
+    int has_masks;  // MASKS describes the block at MASK_START
+    size_t mask_start;
+    CharMasks masks;
+} SourceReader;
+
+/* Implementations of classify_chars(). */
+typedef enum {
+    CLASSIFY_SCALAR,
+    CLASSIFY_SSE2,
+    CLASSIFY_AVX2
+} ClassifyLevel;
+
+int reader_open(SourceReader* reader, FILE* input);
+
+void reader_close(SourceReader* reader);
+
+int reader_next_line(SourceReader* reader, Slice* line);
+
+const CharMasks* reader_line_masks(const SourceReader* reader, Slice line,
+    CharMasks* masks);
+
+int next_token(Slice* rest, Slice* tok);
+
+void classify_chars(const char* str, size_t len, CharMasks* masks);
+
+int set_classify_level(ClassifyLevel level);
+
+ClassifyLevel get_classify_level();
+
+int scan_tokens(Slice line, const CharMasks* masks, Slice* toks, int max_toks,
+    uint32_t* colons);
+
+#endif
@@ -0,0 +1,448 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils.h"
+#include "tables.h"
+#include "reader.h"
+#include "sim.h"
+
+/* What a SimOp does, one per handler in sim_run(). */
+enum {
+    K_ADDU, K_OR, K_SLT, K_SLTU, K_SLL, K_JR,
+    K_ADDIU, K_ORI, K_LUI,
+    K_LB, K_LBU, K_LW, K_SB, K_SW,
+    K_BEQ, K_BNE, K_J, K_JAL,
+    K_ILLEGAL, K_HALT,
+    NUM_KINDS
+};
+
+/* Register that takes the writes to $zero, so that no handler has to check
+   for it. It is never read.
+ */
+#define SINK_REG 32
+
+static const char* const REG_NAMES[32] = {
+    "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+    "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+    "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+    "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra"
+};
+
+static uint32_t load32(const uint8_t* p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static void store32(uint8_t* p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/* Reads the LEN characters at STR as an unsigned number in BASE (10 or 16)
+   into VALUE. Returns -1 unless all of them are digits and VALUE fits in 32
+   bits.
+ */
+static int parse_uint(const char* str, size_t len, int base, uint32_t* value) {
+    uint64_t v = 0;
+    if (len == 0 || len > 10) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = str[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else return -1;
+        v = v * base + digit;
+    }
+    if (v > UINT32_MAX) {
+        return -1;
+    }
+    *value = (uint32_t) v;
+    return 0;
+}
+
+/* Adds a line of the .symbol or .relocation section, "<address>\t<name>",
+   to TABLE. Returns -1 if LINE is not one.
+ */
+static int parse_entry(Slice line, SymbolTable* table) {
+    const char* tab = (const char*) memchr(line.ptr, '\t', line.len);
+    uint32_t addr;
+    if (!tab || parse_uint(line.ptr, tab - line.ptr, 10, &addr) != 0) {
+        return -1;
+    }
+    size_t name_len = line.len - (tab + 1 - line.ptr);
+    return add_to_table_n(table, tab + 1, name_len, addr);
+}
+
+/* Reads the text output of the assembler from INPUT into WORDS, SYMTBL and
+   RELTBL. Returns the number of words, or -1 if INPUT is not such a file.
+ */
+static int64_t read_object(FILE* input, uint32_t** words, SymbolTable* symtbl,
+    SymbolTable* reltbl) {
+    enum { SEC_NONE, SEC_TEXT, SEC_SYMBOL, SEC_RELOCATION } section = SEC_NONE;
+    SourceReader reader;
+    Slice line;
+    uint32_t len = 0, cap = 0;
+    int line_num = 0;
+
+    *words = NULL;
+    if (reader_open(&reader, input) != 0) {
+        write_to_log("Error: unable to read object file\n");
+        return -1;
+    }
+    while (reader_next_line(&reader, &line)) {
+        line_num++;
+        if (line.len > 0 && line.ptr[line.len - 1] == '\r') {
+            line.len--;
+        }
+        if (line.len == 0) {
+            continue;
+        }
+
+        int err = 0;
+        if (line.len == 5 && memcmp(line.ptr, ".text", 5) == 0) {
+            err = section != SEC_NONE;
+            section = SEC_TEXT;
+        } else if (line.len == 7 && memcmp(line.ptr, ".symbol", 7) == 0) {
+            err = section != SEC_TEXT;
+            section = SEC_SYMBOL;
+        } else if (line.len == 11 && memcmp(line.ptr, ".relocation", 11) == 0) {
+            err = section != SEC_SYMBOL;
+            section = SEC_RELOCATION;
+        } else if (section == SEC_TEXT) {
+            if (len == cap) {
+                cap = cap ? cap * 2 : 1024;
+                *words = (uint32_t*) realloc(*words, cap * sizeof(uint32_t));
+                if (*words == NULL) allocation_failed();
+            }
+            err = line.len != 8 || parse_uint(line.ptr, 8, 16, &(*words)[len]) != 0;
+            len++;
+        } else if (section == SEC_SYMBOL) {
+            err = parse_entry(line, symtbl) != 0;
+        } else if (section == SEC_RELOCATION) {
+            err = parse_entry(line, reltbl) != 0;
+        } else {
+            err = 1;
+        }
+
+        if (err) {
+            write_to_log("Error: invalid object file at line %d\n", line_num);
+            reader_close(&reader);
+            free(*words);
+            *words = NULL;
+            return -1;
+        }
+    }
+    reader_close(&reader);
+
+    if (section != SEC_RELOCATION) {
+        write_to_log("Error: invalid object file: missing sections\n");
+        free(*words);
+        *words = NULL;
+        return -1;
+    }
+    return len;
+}
+
+/* Decodes the words at the start of memory into the ops of M, once and for
+   all. Branch and jump targets become indexes into the ops; a target past
+   the end of the text is rejected here, since no assembled program has one,
+   rather than checked every time it is taken. Words that are not an
+   instruction the assembler emits only fault if they are run.
+
+   Returns -1 if a branch or jump leaves the program, 0 otherwise.
+ */
+static int predecode(Machine* m) {
+    uint32_t n = m->num_words;
+    m->ops = (SimOp*) calloc(n + 1, sizeof(SimOp));
+    if (m->ops == NULL) allocation_failed();
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t word = load32(m->mem + 4 * i);
+        SimOp* op = &m->ops[i];
+        uint32_t rd = (word >> 11) & 0x1f;
+        uint32_t rt = (word >> 16) & 0x1f;
+        uint32_t imm = word & 0xffff;
+        int64_t target = -1;
+        uint32_t zero_fields = 0;   // bits the instruction requires to be 0
+
+        op->rs = (word >> 21) & 0x1f;
+        op->rt = rt;
+        op->rd = rd ? rd : SINK_REG;
+        op->kind = K_ILLEGAL;
+
+        switch (word >> 26) {
+            case 0x00:
+                zero_fields = 0x7c0;        //shamt
+                switch (word & 0x3f) {
+                    case 0x21: op->kind = K_ADDU; break;
+                    case 0x25: op->kind = K_OR; break;
+                    case 0x2a: op->kind = K_SLT; break;
+                    case 0x2b: op->kind = K_SLTU; break;
+                    case 0x00:
+                        op->kind = K_SLL;
+                        op->imm = (word >> 6) & 0x1f;
+                        zero_fields = 0x03e00000;   //rs
+                        break;
+                    case 0x08: op->kind = K_JR; zero_fields = 0x1fffc0; break;    //rt, rd, shamt
+                }
+                break;
+            //the I-type instructions write RT, so it takes the place of RD
+            case 0x09: op->kind = K_ADDIU; op->imm = (int16_t) imm; break;
+            case 0x0d: op->kind = K_ORI; op->imm = imm; break;
+            case 0x0f: op->kind = K_LUI; op->imm = imm << 16; zero_fields = 0x03e00000; break;
+            case 0x20: op->kind = K_LB; op->imm = (int16_t) imm; break;
+            case 0x24: op->kind = K_LBU; op->imm = (int16_t) imm; break;
+            case 0x23: op->kind = K_LW; op->imm = (int16_t) imm; break;
+            case 0x28: op->kind = K_SB; op->imm = (int16_t) imm; break;
+            case 0x2b: op->kind = K_SW; op->imm = (int16_t) imm; break;
+            case 0x04:
+            case 0x05:
+                op->kind = (word >> 26) == 0x04 ? K_BEQ : K_BNE;
+                target = (int64_t) i + 1 + (int16_t) imm;
+                break;
+            case 0x02:
+            case 0x03:
+                op->kind = (word >> 26) == 0x02 ? K_J : K_JAL;
+                target = ((((uint64_t) i + 1) * 4 & 0xf0000000) | ((word & 0x3ffffff) << 2)) / 4;
+                break;
+        }
+        if (word & zero_fields) {
+            op->kind = K_ILLEGAL;
+        }
+        if (op->kind >= K_ADDIU && op->kind <= K_LW) {
+            op->rd = rt ? rt : SINK_REG;
+        }
+        if (op->kind >= K_BEQ && op->kind <= K_JAL) {
+            if (target < 0 || target > n) {
+                write_to_log("Error: instruction at 0x%08x jumps outside the program\n", 4 * i);
+                return -1;
+            }
+            op->imm = (uint32_t) target;
+        }
+    }
+    m->ops[n].kind = K_HALT;
+    return 0;
+}
+
+/* Loads the text output of the assembler from INPUT into M, with MEM_SIZE
+   bytes of memory. Every relocation is resolved against the symbols of the
+   program, then the program is decoded for sim_run(). Execution starts at
+   address 0 with $sp at the top of memory and $ra at the end of the text,
+   so that a program which returns halts the machine.
+
+   Returns 0 on success and -1 if INPUT cannot be run, which is logged.
+ */
+int sim_load(Machine* m, FILE* input, uint32_t mem_size) {
+    memset(m, 0, sizeof(Machine));
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    uint32_t* words;
+    int err = 0;
+
+    int64_t n = read_object(input, &words, symtbl, reltbl);
+    if (n < 0) {
+        err = -1;
+    } else if ((uint64_t) n * 4 > mem_size || mem_size < 4) {
+        write_to_log("Error: program does not fit in %u bytes of memory\n", mem_size);
+        err = -1;
+    }
+
+    for (uint32_t i = 0; err == 0 && i < reltbl->len; i++) {
+        Symbol* rel = &reltbl->tbl[i];
+        int64_t addr = get_addr_for_symbol(symtbl, rel->name);
+        if (rel->addr % 4 != 0 || rel->addr / 4 >= n) {
+            write_to_log("Error: relocation outside the program at 0x%08x\n", rel->addr);
+            err = -1;
+        } else if (addr < 0) {
+            write_to_log("Error: undefined symbol %s at 0x%08x\n", rel->name, rel->addr);
+            err = -1;
+        } else {
+            uint32_t* word = &words[rel->addr / 4];
+            *word = (*word & 0xfc000000) | (((uint32_t) addr >> 2) & 0x3ffffff);
+        }
+    }
+
+    if (err == 0) {
+        m->mem = (uint8_t*) calloc(mem_size, 1);
+        if (m->mem == NULL) allocation_failed();
+        m->mem_size = mem_size;
+        m->num_words = (uint32_t) n;
+        for (uint32_t i = 0; i < m->num_words; i++) {
+            store32(m->mem + 4 * i, words[i]);
+        }
+        m->regs[29] = mem_size;
+        m->regs[31] = 4 * m->num_words;
+        err = predecode(m);
+    }
+
+    free(words);
+    free_table(symtbl);
+    free_table(reltbl);
+    if (err) {
+        sim_free(m);
+    }
+    return err;
+}
+
+void sim_free(Machine* m) {
+    free(m->mem);
+    free(m->ops);
+    m->mem = NULL;
+    m->ops = NULL;
+}
+
+/* Runs M from its pc until the program halts or faults, or until it has
+   run MAX_STEPS more instructions (no limit if 0). The limit is checked at
+   taken branches and jumps, which every loop goes through, so a run may end
+   a few instructions after it. There are no delay slots, as the assembler
+   lays out branches without them. Stores into the text section fault, so
+   the decoded ops never go stale.
+
+   Each handler ends in a jump to the handler of the next op, so that every
+   instruction is dispatched from its own indirect branch.
+ */
+SimStatus sim_run(Machine* m, uint64_t max_steps) {
+    static const void* const HANDLERS[NUM_KINDS] = {
+        [K_ADDU] = &&op_addu, [K_OR] = &&op_or, [K_SLT] = &&op_slt, [K_SLTU] = &&op_sltu,
+        [K_SLL] = &&op_sll, [K_JR] = &&op_jr, [K_ADDIU] = &&op_addiu, [K_ORI] = &&op_ori,
+        [K_LUI] = &&op_lui, [K_LB] = &&op_lb, [K_LBU] = &&op_lbu, [K_LW] = &&op_lw,
+        [K_SB] = &&op_sb, [K_SW] = &&op_sw, [K_BEQ] = &&op_beq, [K_BNE] = &&op_bne,
+        [K_J] = &&op_j, [K_JAL] = &&op_jal, [K_ILLEGAL] = &&op_illegal, [K_HALT] = &&op_halt
+    };
+
+    SimOp* ops = m->ops;
+    if (ops[m->num_words].handler == NULL) {
+        for (uint32_t i = 0; i <= m->num_words; i++) {
+            ops[i].handler = HANDLERS[ops[i].kind];
+        }
+    }
+    if (m->pc % 4 != 0 || m->pc / 4 > m->num_words) {
+        write_to_log("Error: pc outside the program: 0x%08x\n", m->pc);
+        return SIM_FAULT;
+    }
+
+    uint32_t r[33];
+    memcpy(r, m->regs, sizeof(m->regs));
+    uint8_t* mem = m->mem;
+    uint32_t mem_size = m->mem_size;
+    uint32_t text_size = 4 * m->num_words;
+    const SimOp* op = ops + m->pc / 4;
+    uint64_t steps = m->steps;
+    uint64_t limit = max_steps ? steps + max_steps : UINT64_MAX;
+    uint32_t addr;
+    SimStatus status;
+
+#define NEXT() do { op++; steps++; goto *op->handler; } while (0)
+#define JUMP(index) do { op = ops + (index); if (++steps >= limit) goto out_of_steps; \
+                         goto *op->handler; } while (0)
+#define CHECK_ADDR(size, what) do { \
+        if (addr > mem_size - (size) || addr % (size) != 0) goto bad_##what; \
+    } while (0)
+
+    goto *op->handler;
+
+op_addu:  r[op->rd] = r[op->rs] + r[op->rt]; NEXT();
+op_or:    r[op->rd] = r[op->rs] | r[op->rt]; NEXT();
+op_slt:   r[op->rd] = (int32_t) r[op->rs] < (int32_t) r[op->rt]; NEXT();
+op_sltu:  r[op->rd] = r[op->rs] < r[op->rt]; NEXT();
+op_sll:   r[op->rd] = r[op->rt] << op->imm; NEXT();
+op_addiu: r[op->rd] = r[op->rs] + op->imm; NEXT();
+op_ori:   r[op->rd] = r[op->rs] | op->imm; NEXT();
+op_lui:   r[op->rd] = op->imm; NEXT();
+
+op_lb:
+    addr = r[op->rs] + op->imm;
+    CHECK_ADDR(1, load);
+    r[op->rd] = (uint32_t) (int32_t) (int8_t) mem[addr];
+    NEXT();
+op_lbu:
+    addr = r[op->rs] + op->imm;
+    CHECK_ADDR(1, load);
+    r[op->rd] = mem[addr];
+    NEXT();
+op_lw:
+    addr = r[op->rs] + op->imm;
+    CHECK_ADDR(4, load);
+    r[op->rd] = load32(mem + addr);
+    NEXT();
+op_sb:
+    addr = r[op->rs] + op->imm;
+    CHECK_ADDR(1, store);
+    if (addr < text_size) goto bad_store;
+    mem[addr] = (uint8_t) r[op->rt];
+    NEXT();
+op_sw:
+    addr = r[op->rs] + op->imm;
+    CHECK_ADDR(4, store);
+    if (addr < text_size) goto bad_store;
+    store32(mem + addr, r[op->rt]);
+    NEXT();
+
+op_beq:
+    if (r[op->rs] == r[op->rt]) JUMP(op->imm);
+    NEXT();
+op_bne:
+    if (r[op->rs] != r[op->rt]) JUMP(op->imm);
+    NEXT();
+op_j:
+    JUMP(op->imm);
+op_jal:
+    r[31] = 4 * (uint32_t) (op - ops + 1);
+    JUMP(op->imm);
+op_jr:
+    addr = r[op->rs];
+    if (addr % 4 != 0 || addr > text_size) goto bad_jump;
+    JUMP(addr / 4);
+
+op_halt:
+    status = SIM_HALTED;
+    goto done;
+out_of_steps:
+    status = op->kind == K_HALT ? SIM_HALTED : SIM_STEP_LIMIT;
+    goto done;
+op_illegal:
+    write_to_log("Error: invalid instruction 0x%08x at 0x%08x\n",
+        load32(mem + 4 * (op - ops)), (uint32_t) (4 * (op - ops)));
+    status = SIM_FAULT;
+    goto done;
+bad_load:
+    write_to_log("Error: load from invalid address 0x%08x at 0x%08x\n",
+        addr, (uint32_t) (4 * (op - ops)));
+    status = SIM_FAULT;
+    goto done;
+bad_store:
+    write_to_log("Error: store to invalid address 0x%08x at 0x%08x\n",
+        addr, (uint32_t) (4 * (op - ops)));
+    status = SIM_FAULT;
+    goto done;
+bad_jump:
+    write_to_log("Error: jump to invalid address 0x%08x at 0x%08x\n",
+        addr, (uint32_t) (4 * (op - ops)));
+    status = SIM_FAULT;
+
+#undef NEXT
+#undef JUMP
+#undef CHECK_ADDR
+
+done:
+    memcpy(m->regs, r, sizeof(m->regs));
+    m->regs[0] = 0;
+    m->pc = 4 * (uint32_t) (op - ops);
+    m->steps = steps;
+    return status;
+}
+
+/* Prints the pc and every register of M that is not zero. */
+void sim_print_registers(FILE* output, const Machine* m) {
+    fprintf(output, "pc    = 0x%08x\n", m->pc);
+    for (int i = 1; i < 32; i++) {
+        if (m->regs[i] != 0) {
+            fprintf(output, "$%-4s = 0x%08x (%d)\n", REG_NAMES[i], m->regs[i],
+                (int32_t) m->regs[i]);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Memory of a simulated machine unless the caller asks for another size. */
+#define SIM_MEMORY_SIZE (1 << 20)
+
+/* A word of the program decoded once at load time: what to run and the
+   operands it runs on, already pulled out of their bit fields.
+ */
+typedef struct {
+    const void* handler;    // label of the handler in sim_run(), set on its first call
+    uint8_t kind;           // which handler, from the decoder
+    uint8_t rd, rs, rt;
+    uint32_t imm;           // sign- or zero-extended immediate, shift amount,
+                            // or index of the target of a branch or jump
+} SimOp;
+
+/* A program loaded from the text output of the assembler, and the machine it
+   runs on. The text section is also the start of memory, which is big-endian
+   like the default output of the assembler, and read-only.
+ */
+typedef struct {
+    uint32_t regs[32];
+    uint32_t pc;            // address of the next instruction
+    uint8_t* mem;
+    uint32_t mem_size;
+    SimOp* ops;             // one per word, then the op that halts the machine
+    uint32_t num_words;
+    uint64_t steps;         // instructions executed so far
+} Machine;
+
+/* How sim_run() stopped. */
+typedef enum {
+    SIM_HALTED,         // the program returned, or ran off the end of its text
+    SIM_FAULT,          // the program did something it cannot, which was logged
+    SIM_STEP_LIMIT      // it ran the number of instructions it was allowed
+} SimStatus;
+
+int sim_load(Machine* m, FILE* input, uint32_t mem_size);
+
+void sim_free(Machine* m);
+
+SimStatus sim_run(Machine* m, uint64_t max_steps);
+
+void sim_print_registers(FILE* output, const Machine* m);
+
+#endif
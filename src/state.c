@@ -0,0 +1,231 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tables.h"
+#include "state.h"
+
+/* Hashes a line of the source, eight bytes at a time. Lines with the same
+   hash are taken to be the same line, so the hash has 64 bits to make a
+   collision between an edited line and the line it replaced unlikely.
+ */
+uint64_t hash_line(const char* str, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ len;
+    uint64_t chunk;
+
+    while (len >= 8) {
+        memcpy(&chunk, str, 8);
+        hash = (hash ^ chunk) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+        str += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        chunk = 0;
+        memcpy(&chunk, str, len);
+        hash = (hash ^ chunk) * 0x9e3779b97f4a7c15ULL;
+        hash ^= hash >> 32;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static void clear_state(BuildState* state) {
+    memset(state, 0, sizeof(*state));
+}
+
+/* Maps the state file FILENAME into memory as STATE. Returns 0 on success
+   and -1 if the file is missing or is not a state file of this version, in
+   which case STATE is empty.
+ */
+int state_load(BuildState* state, const char* filename) {
+    struct stat st;
+
+    clear_state(state);
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)
+        || (uint64_t) st.st_size < sizeof(StateHeader)) {
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    const StateHeader* header = (const StateHeader*) map;
+    uint64_t size = sizeof(StateHeader)
+        + (uint64_t) header->num_lines * sizeof(StateLine)
+        + (uint64_t) header->num_recs * sizeof(StateRec)
+        + header->strings_len;
+    if (memcmp(header->magic, STATE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != STATE_VERSION || size != (uint64_t) st.st_size) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    const char* data = (const char*) map + sizeof(StateHeader);
+    state->lines = (const StateLine*) data;
+    data += (size_t) header->num_lines * sizeof(StateLine);
+    state->recs = (const StateRec*) data;
+    data += (size_t) header->num_recs * sizeof(StateRec);
+    state->strings = data;
+
+    //every name must end inside the file
+    if (header->strings_len > 0 && state->strings[header->strings_len - 1] != '\0') {
+        munmap(map, st.st_size);
+        clear_state(state);
+        return -1;
+    }
+
+    state->num_lines = header->num_lines;
+    state->num_recs = header->num_recs;
+    state->strings_len = header->strings_len;
+    state->map = map;
+    state->map_size = st.st_size;
+    return 0;
+}
+
+void state_unload(BuildState* state) {
+    if (state->map) {
+        munmap(state->map, state->map_size);
+    }
+    clear_state(state);
+}
+
+/* Returns the name at OFFSET in the strings of STATE, or NULL if OFFSET is
+   STATE_NONE or does not point into them.
+ */
+const char* state_string(const BuildState* state, uint32_t offset) {
+    if (offset >= state->strings_len) {
+        return NULL;
+    }
+    return state->strings + offset;
+}
+
+void state_builder_init(StateBuilder* builder) {
+    memset(builder, 0, sizeof(*builder));
+}
+
+void state_builder_free(StateBuilder* builder) {
+    free(builder->lines);
+    free(builder->recs);
+    free(builder->strings);
+    state_builder_init(builder);
+}
+
+/* Copies the LEN bytes of NAME into the strings of BUILDER and returns
+   their offset.
+ */
+static uint32_t add_string(StateBuilder* builder, const char* name, size_t len) {
+    if (builder->strings_len + len + 1 > builder->strings_cap) {
+        while (builder->strings_len + len + 1 > builder->strings_cap) {
+            builder->strings_cap = builder->strings_cap ? builder->strings_cap * 2 : 4096;
+        }
+        builder->strings = (char*) realloc(builder->strings, builder->strings_cap);
+        if (builder->strings == NULL) allocation_failed();
+    }
+    uint32_t offset = builder->strings_len;
+    memcpy(builder->strings + offset, name, len);
+    builder->strings[offset + len] = '\0';
+    builder->strings_len += len + 1;
+    return offset;
+}
+
+/* Appends a line to BUILDER. LABEL may be NULL. The caller fills in the
+   records of the line once they are known.
+ */
+StateLine* state_add_line(StateBuilder* builder, uint64_t hash, const char* label,
+    size_t label_len, uint32_t size) {
+    if (builder->num_lines == builder->line_cap) {
+        builder->line_cap = builder->line_cap ? builder->line_cap * 2 : 1024;
+        builder->lines = (StateLine*) realloc(builder->lines,
+            builder->line_cap * sizeof(StateLine));
+        if (builder->lines == NULL) allocation_failed();
+    }
+    StateLine* line = &builder->lines[builder->num_lines++];
+    line->hash = hash;
+    line->first_rec = 0;
+    line->num_recs = 0;
+    line->label = label ? add_string(builder, label, label_len) : STATE_NONE;
+    line->size = size;
+    return line;
+}
+
+/* Appends an encoded word to BUILDER. SYM may be NULL. */
+StateRec* state_add_rec(StateBuilder* builder, uint32_t word, uint32_t kind, const char* sym) {
+    if (builder->num_recs == builder->rec_cap) {
+        builder->rec_cap = builder->rec_cap ? builder->rec_cap * 2 : 1024;
+        builder->recs = (StateRec*) realloc(builder->recs,
+            builder->rec_cap * sizeof(StateRec));
+        if (builder->recs == NULL) allocation_failed();
+    }
+    StateRec* rec = &builder->recs[builder->num_recs++];
+    rec->word = word;
+    rec->kind = kind;
+    rec->sym = sym ? add_string(builder, sym, strlen(sym)) : STATE_NONE;
+    return rec;
+}
+
+static int write_all(const void* data, size_t size, size_t n, FILE* output) {
+    if (n == 0) {
+        return 0;
+    }
+    return fwrite(data, size, n, output) == n ? 0 : -1;
+}
+
+/* Writes BUILDER to the state file FILENAME. The file is written under a
+   temporary name and renamed over the old one, so that a build that is
+   interrupted never leaves half a state file behind. Returns 0 on success
+   and -1 on failure.
+ */
+int state_save(StateBuilder* builder, const char* filename) {
+    StateHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+    header.version = STATE_VERSION;
+    header.num_lines = builder->num_lines;
+    header.num_recs = builder->num_recs;
+    header.strings_len = builder->strings_len;
+
+    size_t len = strlen(filename);
+    char* tmp_name = (char*) malloc(len + 5);
+    if (tmp_name == NULL) allocation_failed();
+    memcpy(tmp_name, filename, len);
+    memcpy(tmp_name + len, ".tmp", 5);
+
+    int err = 0;
+    FILE* output = fopen(tmp_name, "wb");
+    if (!output) {
+        free(tmp_name);
+        return -1;
+    }
+    if (write_all(&header, sizeof(header), 1, output) != 0
+        || write_all(builder->lines, sizeof(StateLine), builder->num_lines, output) != 0
+        || write_all(builder->recs, sizeof(StateRec), builder->num_recs, output) != 0
+        || write_all(builder->strings, 1, builder->strings_len, output) != 0) {
+        err = -1;
+    }
+    if (fclose(output) != 0) {
+        err = -1;
+    }
+    if (err == 0 && rename(tmp_name, filename) != 0) {
+        err = -1;
+    }
+    if (err != 0) {
+        remove(tmp_name);
+    }
+    free(tmp_name);
+    return err;
+}
@@ -0,0 +1,94 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The state file of an incremental build remembers, for every line of the
+   source, a hash of its text, the label it defines, how far it moves the
+   byte offset of later labels and the words it was encoded into. The symbol
+   table of the build is not stored separately: replaying the labels and
+   sizes of the lines rebuilds it.
+
+   The file is laid out so that it can be used straight from a mapping: a
+   StateHeader, NUM_LINES StateLines, NUM_RECS StateRecs and then STRINGS_LEN
+   bytes of NUL-terminated names, which the lines and records point into.
+ */
+
+#define STATE_MAGIC "MIPSINC"
+#define STATE_VERSION 1
+
+/* Offset of a name that is not there. */
+#define STATE_NONE UINT32_MAX
+
+/* How a stored word depends on the symbol table. */
+enum {
+    STATE_PLAIN,        // not at all
+    STATE_BRANCH,       // its offset is the distance to SYM
+    STATE_JUMP          // it needs a relocation entry for SYM
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_lines;
+    uint32_t num_recs;
+    uint32_t strings_len;
+} StateHeader;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t first_rec;
+    uint32_t num_recs;
+    uint32_t label;         // offset of the label of the line, or STATE_NONE
+    uint32_t size;          // bytes the line adds to the byte offset
+} StateLine;
+
+typedef struct {
+    uint32_t word;
+    uint32_t kind;
+    uint32_t sym;           // offset of the label of a branch or jump, or STATE_NONE
+} StateRec;
+
+/* A state file mapped into memory. */
+typedef struct {
+    const StateLine* lines;
+    const StateRec* recs;
+    const char* strings;
+    uint32_t num_lines;
+    uint32_t num_recs;
+    uint32_t strings_len;
+    void* map;
+    size_t map_size;
+} BuildState;
+
+/* The state of a build in progress, written out by state_save(). */
+typedef struct {
+    StateLine* lines;
+    StateRec* recs;
+    char* strings;
+    uint32_t num_lines, line_cap;
+    uint32_t num_recs, rec_cap;
+    uint32_t strings_len, strings_cap;
+} StateBuilder;
+
+uint64_t hash_line(const char* str, size_t len);
+
+int state_load(BuildState* state, const char* filename);
+
+void state_unload(BuildState* state);
+
+const char* state_string(const BuildState* state, uint32_t offset);
+
+void state_builder_init(StateBuilder* builder);
+
+void state_builder_free(StateBuilder* builder);
+
+StateLine* state_add_line(StateBuilder* builder, uint64_t hash, const char* label,
+    size_t label_len, uint32_t size);
+
+StateRec* state_add_rec(StateBuilder* builder, uint32_t word, uint32_t kind, const char* sym);
+
+int state_save(StateBuilder* builder, const char* filename);
+
+#endif
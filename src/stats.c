@@ -0,0 +1,98 @@
+#include <time.h>
+#include <sys/resource.h>
+
+#include "stats.h"
+
+static const char* STAGE_NAMES[STATS_NUM_STAGES] = { "pass_one", "pass_two", "single_pass" };
+
+static double clock_seconds(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Notes the wall and CPU time at the start of a stage. */
+void stats_begin(StatsTimer* timer) {
+    timer->wall = clock_seconds(CLOCK_MONOTONIC);
+    timer->cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/* Adds the time since stats_begin() to STAGE of STATS, which may be NULL. */
+void stats_end(AsmStats* stats, StatsStage stage, const StatsTimer* timer) {
+    if (!stats) {
+        return;
+    }
+    stats->ran[stage] = 1;
+    stats->wall[stage] += clock_seconds(CLOCK_MONOTONIC) - timer->wall;
+    stats->cpu[stage] += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - timer->cpu;
+}
+
+/* Adds the counters of OTHER, as collected by one thread, to STATS. Times
+   and table sizes are left alone, as they belong to the whole run.
+ */
+void stats_add(AsmStats* stats, const AsmStats* other) {
+    for (int i = 0; i < STATS_NUM_STAGES; i++) {
+        stats->lines_read[i] += other->lines_read[i];
+    }
+    stats->li_short += other->li_short;
+    stats->li_long += other->li_long;
+    stats->blt += other->blt;
+    stats->lookups += other->lookups;
+}
+
+/* Records the peak memory use of the process. */
+void stats_finish(AsmStats* stats) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats->peak_rss_kb = usage.ru_maxrss;
+    }
+}
+
+void print_stats(FILE* output, const AsmStats* stats) {
+    fprintf(output, "Statistics:\n");
+    for (int i = 0; i < STATS_NUM_STAGES; i++) {
+        if (stats->ran[i]) {
+            fprintf(output, "  %-13s %10.3f ms wall %10.3f ms cpu %12llu lines read\n",
+                STAGE_NAMES[i], stats->wall[i] * 1e3, stats->cpu[i] * 1e3,
+                (unsigned long long) stats->lines_read[i]);
+        }
+    }
+    if (stats->lines_reused > 0) {
+        fprintf(output, "  reused        %llu lines of the previous build\n",
+            (unsigned long long) stats->lines_reused);
+    }
+    fprintf(output, "  expansions    %llu li (addiu), %llu li (lui, ori), %llu blt\n",
+        (unsigned long long) stats->li_short, (unsigned long long) stats->li_long,
+        (unsigned long long) stats->blt);
+    fprintf(output, "  instructions  %llu emitted\n", (unsigned long long) stats->insts_emitted);
+    fprintf(output, "  symbols       %llu, looked up %llu times\n",
+        (unsigned long long) stats->symbols, (unsigned long long) stats->lookups);
+    fprintf(output, "  relocations   %llu\n", (unsigned long long) stats->relocations);
+    fprintf(output, "  written       %llu bytes\n", (unsigned long long) stats->bytes_written);
+    fprintf(output, "  peak memory   %llu KB\n", (unsigned long long) stats->peak_rss_kb);
+}
+
+void write_stats_json(FILE* output, const AsmStats* stats) {
+    fprintf(output, "{\n  \"stages\": {");
+    const char* sep = "";
+    for (int i = 0; i < STATS_NUM_STAGES; i++) {
+        if (stats->ran[i]) {
+            fprintf(output, "%s\n    \"%s\": {\"wall_s\": %.6f, \"cpu_s\": %.6f, "
+                "\"lines_read\": %llu}", sep, STAGE_NAMES[i], stats->wall[i], stats->cpu[i],
+                (unsigned long long) stats->lines_read[i]);
+            sep = ",";
+        }
+    }
+    fprintf(output, "\n  },\n");
+    fprintf(output, "  \"lines_reused\": %llu,\n", (unsigned long long) stats->lines_reused);
+    fprintf(output, "  \"expansions\": {\"li_addiu\": %llu, \"li_lui_ori\": %llu, \"blt\": %llu},\n",
+        (unsigned long long) stats->li_short, (unsigned long long) stats->li_long,
+        (unsigned long long) stats->blt);
+    fprintf(output, "  \"instructions_emitted\": %llu,\n",
+        (unsigned long long) stats->insts_emitted);
+    fprintf(output, "  \"symbols\": %llu,\n", (unsigned long long) stats->symbols);
+    fprintf(output, "  \"symbol_lookups\": %llu,\n", (unsigned long long) stats->lookups);
+    fprintf(output, "  \"relocations\": %llu,\n", (unsigned long long) stats->relocations);
+    fprintf(output, "  \"bytes_written\": %llu,\n", (unsigned long long) stats->bytes_written);
+    fprintf(output, "  \"peak_rss_kb\": %llu\n}\n", (unsigned long long) stats->peak_rss_kb);
+}
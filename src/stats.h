@@ -0,0 +1,54 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The stages of an assembly run that are timed separately. */
+typedef enum {
+    STATS_PASS_ONE,
+    STATS_PASS_TWO,
+    STATS_SINGLE_PASS,
+    STATS_NUM_STAGES
+} StatsStage;
+
+/* Counters collected while assembling, for -stats. Every pass takes an
+   AsmStats* that may be NULL, and only adds to the counters it knows about,
+   so the same struct can collect a whole run.
+ */
+typedef struct {
+    int ran[STATS_NUM_STAGES];
+    double wall[STATS_NUM_STAGES];      // seconds
+    double cpu[STATS_NUM_STAGES];       // seconds of every thread of the process
+    uint64_t lines_read[STATS_NUM_STAGES];
+    uint64_t lines_reused;              // lines an incremental build took from its state
+    uint64_t li_short;                  // li expanded into addiu
+    uint64_t li_long;                   // li expanded into lui and ori
+    uint64_t blt;                       // blt expanded into slt and bne
+    uint64_t lookups;                   // symbol table lookups
+    uint64_t insts_emitted;             // words of the text section
+    uint64_t symbols;
+    uint64_t relocations;
+    uint64_t bytes_written;             // intermediate and output files
+    uint64_t peak_rss_kb;
+} AsmStats;
+
+/* Start of a stage being timed by stats_begin() and stats_end(). */
+typedef struct {
+    double wall;
+    double cpu;
+} StatsTimer;
+
+void stats_begin(StatsTimer* timer);
+
+void stats_end(AsmStats* stats, StatsStage stage, const StatsTimer* timer);
+
+void stats_add(AsmStats* stats, const AsmStats* other);
+
+void stats_finish(AsmStats* stats);
+
+void print_stats(FILE* output, const AsmStats* stats);
+
+void write_stats_json(FILE* output, const AsmStats* stats);
+
+#endif
@@ -1,144 +1,273 @@
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-
-#include "utils.h"
-#include "tables.h"
-
-const int SYMTBL_NON_UNIQUE = 0;
-const int SYMTBL_UNIQUE_NAME = 1;
-
-/*******************************
- * Helper Functions
- *******************************/
-
-void allocation_failed() {
-    write_to_log("Error: allocation failed\n");
-    exit(1);
-}
-
-void addr_alignment_incorrect() {
-    write_to_log("Error: address is not a multiple of 4.\n");
-}
-
-void name_already_exists(const char* name) {
-    write_to_log("Error: name '%s' already exists in table.\n", name);
-}
-
-void write_symbol(FILE* output, uint32_t addr, const char* name) {
-    fprintf(output, "%u\t%s\n", addr, name);
-}
-
-/*******************************
- * Symbol Table Functions
- *******************************/
-
-/* Creates a new SymbolTable containg 0 elements and returns a pointer to that
-   table. 
-   Multiple SymbolTables may exist at the same time. 
-  
-   If memory allocation fails, you should call allocation_failed(). 
-   Mode will be either SYMTBL_NON_UNIQUE or SYMTBL_UNIQUE_NAME. 
-   You will need to store this value for use during add_to_table().
- */
-SymbolTable* create_table(int mode) {
-    SymbolTable *table;
-    table = (SymbolTable*) malloc(sizeof(SymbolTable));
-
-    if (table == NULL) allocation_failed();
-    
-    table->mode = mode;
-    table->len = 0;
-    table->cap = 10; //initially, stores 10 symbols allowed
-    table->tbl = (Symbol*) malloc((table->cap) * sizeof(Symbol));
-    if (table->tbl == NULL) allocation_failed();
-    return table;
-}
-
-/* Frees the given SymbolTable and all associated memory. */
-void free_table(SymbolTable *table) {
-    for(unsigned int i = 0; i < table->len; i++) {
-         Symbol sym = table->tbl[i];
-         free(sym.name);             
-    }
-    table->len = 0;
-    free(table->tbl);
-    free(table);
-}
-
-/* Adds a new symbol and its address to the SymbolTable pointed to by TABLE. 
-   ADDR is given as the byte offset from the first instruction.
-   The SymbolTable must be able to resize itself as more elements are added. 
-   Note that NAME may point to a temporary array, so it is not safe to simply
-   store the NAME pointer. You must store a copy of the given string.
-   If ADDR is not word-aligned, you should call addr_alignment_incorrect() and
-   return -1. 
-   If the table's mode is SYMTBL_UNIQUE_NAME and NAME already exists 
-   in the table, you should call name_already_exists() and return -1. If memory
-   allocation fails, you should call allocation_failed(). 
-   Otherwise, you should store the symbol name and address and return 0.
- */
-int add_to_table(SymbolTable* table, const char* name, uint32_t addr) {
-   
-    //resize if needed 
-    if ((table->len) >= (table->cap)) {
-        table->cap *= 2;
-        table->tbl = (Symbol*) realloc(table->tbl, ((table->cap) * sizeof(Symbol)));
-        if (table->tbl == NULL) allocation_failed();
-    }
-
-    //word alignment check
-    if ((addr % 4) != 0) {
-        addr_alignment_incorrect();
-        return -1;
-    }
-    
-    //unique table check
-    if (table->mode == SYMTBL_UNIQUE_NAME) {
-        for (unsigned int i = 0; i < (table->len); i++) {
-            Symbol sym = table->tbl[i];
-            if (strcmp(name, sym.name) == 0) {
-                name_already_exists(name);
-                return -1;  
-            }
-        }
-    }
-
-    char* namecopy = (char*) malloc((strlen(name) * sizeof(char)) + 1);
-    if (namecopy == NULL) { 
-      allocation_failed();
-    } else {
-      strcpy(namecopy, name);
-    }
-     
-    // add symbol to array 
-    table->tbl[table->len].name = namecopy; 
-    table->tbl[table->len].addr = addr;
-    table->len += 1;
-
-    return 0;
-}
-
-/* Returns the address (byte offset) of the given symbol. If a symbol with name
-   NAME is not present in TABLE, return -1.
-   Address look up.
- */
-int64_t get_addr_for_symbol(SymbolTable* table, const char* name) {
-    for (unsigned int i = 0; i < table->len; i++) {
-        Symbol sym = table->tbl[i];
-        if (strcmp(name, sym.name) == 0) {
-            return sym.addr;
-        }
-    }
-    return -1;
-}
-
-/* Writes the SymbolTable TABLE to OUTPUT. You should use write_symbol() to
-   perform the write. Do not print any additional whitespace or characters.
- */
-void write_table(SymbolTable* table, FILE* output) {
-    for(unsigned int i = 0; i < table->len; i++) {
-        Symbol sym = table->tbl[i];
-        write_symbol(output, sym.addr, sym.name);       
-    }
-}
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "utils.h"
+#include "tables.h"
+
+const int SYMTBL_NON_UNIQUE = 0;
+const int SYMTBL_UNIQUE_NAME = 1;
+
+/*******************************
+ * Helper Functions
+ *******************************/
+
+void allocation_failed() {
+    write_to_log("Error: allocation failed\n");
+    flush_log();
+    exit(1);
+}
+
+void addr_alignment_incorrect() {
+    write_to_log("Error: address is not a multiple of 4.\n");
+}
+
+void name_already_exists(const char* name) {
+    name_already_exists_n(name, strlen(name));
+}
+
+void name_already_exists_n(const char* name, size_t len) {
+    write_to_log("Error: name '%.*s' already exists in table.\n", (int) len, name);
+}
+
+void write_symbol(OutBuf* output, uint32_t addr, const char* name) {
+    outbuf_dec32(output, addr);
+    outbuf_putc(output, '\t');
+    outbuf_puts(output, name);
+    outbuf_putc(output, '\n');
+}
+
+/*******************************
+ * Hash Index
+ *******************************/
+
+/* FNV-1a hash of the LEN characters of NAME. */
+static uint32_t hash_name(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the index slot holding NAME, or the empty slot where it would be
+   inserted. Since the index is never more than half full, probing always
+   terminates.
+ */
+static uint32_t find_slot(SymbolTable* table, const char* name, size_t len,
+    uint32_t hash) {
+    uint32_t mask = table->index_cap - 1;
+    uint32_t slot = hash & mask;
+    while (table->index[slot] != 0) {
+        Symbol* sym = &table->tbl[table->index[slot] - 1];
+        if (sym->hash == hash && strncmp(sym->name, name, len) == 0
+            && sym->name[len] == '\0') {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* Doubles the number of index slots and reinserts every indexed symbol. Only
+   the first occurrence of a name is indexed, so lookups keep returning it.
+ */
+static void grow_index(SymbolTable* table) {
+    uint32_t* old_index = table->index;
+    uint32_t old_cap = table->index_cap;
+
+    table->index_cap *= 2;
+    table->index = (uint32_t*) calloc(table->index_cap, sizeof(uint32_t));
+    if (table->index == NULL) allocation_failed();
+
+    uint32_t mask = table->index_cap - 1;
+    for (uint32_t i = 0; i < old_cap; i++) {
+        if (old_index[i] != 0) {
+            uint32_t slot = table->tbl[old_index[i] - 1].hash & mask;
+            while (table->index[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            table->index[slot] = old_index[i];
+        }
+    }
+    free(old_index);
+}
+
+/*******************************
+ * Symbol Table Functions
+ *******************************/
+
+/* Creates a new SymbolTable containg 0 elements and returns a pointer to that
+   table. 
+   Multiple SymbolTables may exist at the same time. 
+  
+   If memory allocation fails, you should call allocation_failed(). 
+   Mode will be either SYMTBL_NON_UNIQUE or SYMTBL_UNIQUE_NAME. 
+   You will need to store this value for use during add_to_table().
+ */
+SymbolTable* create_table(int mode) {
+    return create_table_with_hint(mode, 10); //initially, stores 10 symbols allowed
+}
+
+/* Creates a new SymbolTable like create_table(), but with room for HINT
+   symbols, so that filling it with up to HINT names never reallocates.
+ */
+SymbolTable* create_table_with_hint(int mode, uint32_t hint) {
+    SymbolTable *table;
+    table = (SymbolTable*) malloc(sizeof(SymbolTable));
+
+    if (table == NULL) allocation_failed();
+    if (hint == 0) hint = 1;
+    
+    table->mode = mode;
+    table->len = 0;
+    table->cap = hint;
+    table->tbl = (Symbol*) malloc((table->cap) * sizeof(Symbol));
+    if (table->tbl == NULL) allocation_failed();
+
+    //keeps the index at most half full
+    table->index_cap = 32;
+    while (table->index_cap < 2 * hint) {
+        table->index_cap *= 2;
+    }
+    table->index = (uint32_t*) calloc(table->index_cap, sizeof(uint32_t));
+    if (table->index == NULL) allocation_failed();
+
+    //names average well under 16 bytes
+    arena_init(&table->names, 16 * (size_t) hint > 4096 ? 16 * (size_t) hint : 4096);
+    return table;
+}
+
+/* Frees the given SymbolTable and all associated memory. */
+void free_table(SymbolTable *table) {
+    table->len = 0;
+    arena_free(&table->names);
+    free(table->tbl);
+    free(table->index);
+    free(table);
+}
+
+/* Empties TABLE so it can be filled again, keeping the memory it already has
+   for its symbols, index and names.
+ */
+void reset_table(SymbolTable* table) {
+    table->len = 0;
+    memset(table->index, 0, table->index_cap * sizeof(uint32_t));
+    arena_reset(&table->names);
+}
+
+/* Adds a new symbol and its address to the SymbolTable pointed to by TABLE. 
+   ADDR is given as the byte offset from the first instruction.
+   The SymbolTable must be able to resize itself as more elements are added. 
+   Note that NAME may point to a temporary array, so it is not safe to simply
+   store the NAME pointer. You must store a copy of the given string.
+   If ADDR is not word-aligned, you should call addr_alignment_incorrect() and
+   return -1. 
+   If the table's mode is SYMTBL_UNIQUE_NAME and NAME already exists 
+   in the table, you should call name_already_exists() and return -1. If memory
+   allocation fails, you should call allocation_failed(). 
+   Otherwise, you should store the symbol name and address and return 0.
+ */
+int add_to_table(SymbolTable* table, const char* name, uint32_t addr) {
+    return add_to_table_n(table, name, strlen(name), addr);
+}
+
+/* Does the same as add_to_table(), but NAME is given as its first LEN
+   characters and does not need to be NUL-terminated.
+ */
+int add_to_table_n(SymbolTable* table, const char* name, size_t len, uint32_t addr) {
+   
+    //resize if needed 
+    if ((table->len) >= (table->cap)) {
+        table->cap *= 2;
+        table->tbl = (Symbol*) realloc(table->tbl, ((table->cap) * sizeof(Symbol)));
+        if (table->tbl == NULL) allocation_failed();
+    }
+
+    //word alignment check
+    if ((addr % 4) != 0) {
+        addr_alignment_incorrect();
+        return -1;
+    }
+    
+    //unique table check
+    uint32_t hash = hash_name(name, len);
+    uint32_t slot = find_slot(table, name, len, hash);
+    if (table->index[slot] != 0 && table->mode == SYMTBL_UNIQUE_NAME) {
+        name_already_exists_n(name, len);
+        return -1;
+    }
+
+    //intern the name: a name already in the table shares its copy
+    char* namecopy;
+    if (table->index[slot] != 0) {
+        namecopy = table->tbl[table->index[slot] - 1].name;
+    } else {
+        namecopy = arena_strndup(&table->names, name, len);
+    }
+
+    // add symbol to array 
+    table->tbl[table->len].name = namecopy; 
+    table->tbl[table->len].addr = addr;
+    table->tbl[table->len].hash = hash;
+    table->len += 1;
+
+    //index only the first occurrence of a name
+    if (table->index[slot] == 0) {
+        table->index[slot] = table->len;
+        if (2 * table->len > table->index_cap) {
+            grow_index(table);
+        }
+    }
+
+    return 0;
+}
+
+/* Number of calls to get_addr_for_symbol() made by this thread. It is kept
+   per thread so that counting stays free of contention.
+ */
+static __thread uint64_t lookup_count = 0;
+
+uint64_t get_lookup_count() {
+    return lookup_count;
+}
+
+/* Returns the address (byte offset) of the given symbol. If a symbol with name
+   NAME is not present in TABLE, return -1.
+   Address look up.
+ */
+int64_t get_addr_for_symbol(SymbolTable* table, const char* name) {
+    lookup_count += 1;
+    if (!name) {
+        return -1;
+    }
+    size_t len = strlen(name);
+    uint32_t slot = find_slot(table, name, len, hash_name(name, len));
+    if (table->index[slot] == 0) {
+        return -1;
+    }
+    return table->tbl[table->index[slot] - 1].addr;
+}
+
+/* Returns the position in TABLE of the first symbol with name NAME, or -1 if
+   there is none. Symbols keep the position they were added at.
+ */
+int64_t get_index_for_symbol(SymbolTable* table, const char* name) {
+    if (!name) {
+        return -1;
+    }
+    size_t len = strlen(name);
+    uint32_t slot = find_slot(table, name, len, hash_name(name, len));
+    return (int64_t) table->index[slot] - 1;
+}
+
+/* Writes the SymbolTable TABLE to OUTPUT. You should use write_symbol() to
+   perform the write. Do not print any additional whitespace or characters.
+ */
+void write_table(SymbolTable* table, OutBuf* output) {
+    for(unsigned int i = 0; i < table->len; i++) {
+        Symbol sym = table->tbl[i];
+        write_symbol(output, sym.addr, sym.name);       
+    }
+}
@@ -0,0 +1,176 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "tables.h"
+#include "trace.h"
+
+typedef struct {
+    const char* name;       // a string literal, or a copy in the thread's arena
+    const char* detail;     // NULL if there is none
+    int64_t index;          // -1 if there is none
+    uint64_t ts;            // nanoseconds since trace_start()
+    char phase;             // 'B' or 'E'
+} TraceEvent;
+
+/* Events of one thread, in the order they were recorded. */
+typedef struct TraceBuffer {
+    struct TraceBuffer* next;
+    uint32_t tid;
+    int is_main;
+    TraceEvent* events;
+    uint32_t len, cap;
+    Arena strings;
+} TraceBuffer;
+
+/* Set before any thread is started, and only read afterwards. */
+static int trace_enabled = 0;
+static uint64_t trace_epoch;
+static pthread_t main_thread;
+
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static TraceBuffer* buffers = NULL;
+static uint32_t num_buffers = 0;
+
+static __thread TraceBuffer* thread_buffer = NULL;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Starts recording events. Must be called before any thread is started. */
+void trace_start() {
+    trace_enabled = 1;
+    trace_epoch = now_ns();
+    main_thread = pthread_self();
+}
+
+/* Returns the buffer of the calling thread, creating it on first use. */
+static TraceBuffer* get_buffer() {
+    if (thread_buffer) {
+        return thread_buffer;
+    }
+    TraceBuffer* buf = (TraceBuffer*) calloc(1, sizeof(TraceBuffer));
+    if (buf == NULL) allocation_failed();
+    buf->is_main = pthread_equal(pthread_self(), main_thread);
+    arena_init(&buf->strings, 4096);
+
+    pthread_mutex_lock(&buffers_lock);
+    buf->tid = ++num_buffers;
+    buf->next = buffers;
+    buffers = buf;
+    pthread_mutex_unlock(&buffers_lock);
+
+    thread_buffer = buf;
+    return buf;
+}
+
+static void add_event(char phase, const char* name, const char* detail, int64_t index) {
+    TraceBuffer* buf = get_buffer();
+    if (buf->len == buf->cap) {
+        buf->cap = buf->cap ? buf->cap * 2 : 256;
+        buf->events = (TraceEvent*) realloc(buf->events, buf->cap * sizeof(TraceEvent));
+        if (buf->events == NULL) allocation_failed();
+    }
+    TraceEvent* ev = &buf->events[buf->len++];
+    ev->name = name;
+    ev->detail = detail ? arena_strdup(&buf->strings, detail) : NULL;
+    ev->index = index;
+    ev->ts = now_ns() - trace_epoch;
+    ev->phase = phase;
+}
+
+/* Marks the start of NAME, which must be a string literal, on the calling
+   thread. DETAIL, if not NULL, is copied and shown with the event.
+ */
+void trace_begin(const char* name, const char* detail) {
+    if (trace_enabled) {
+        add_event('B', name, detail, -1);
+    }
+}
+
+/* Same as trace_begin(), for one of a numbered series such as the chunks of
+   a parallel pass.
+ */
+void trace_begin_index(const char* name, uint32_t index) {
+    if (trace_enabled) {
+        add_event('B', name, NULL, index);
+    }
+}
+
+/* Marks the end of the latest NAME begun on the calling thread. */
+void trace_end(const char* name) {
+    if (trace_enabled) {
+        add_event('E', name, NULL, -1);
+    }
+}
+
+static void write_json_string(FILE* output, const char* str) {
+    fputc('"', output);
+    for (const unsigned char* p = (const unsigned char*) str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(output, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(output, "\\u%04x", *p);
+        } else {
+            fputc(*p, output);
+        }
+    }
+    fputc('"', output);
+}
+
+/* Stops recording and writes every event to FILENAME, then frees the
+   buffers. Must be called once every other thread is done. Returns -1 if the
+   file could not be written, 0 otherwise.
+ */
+int trace_finish(const char* filename) {
+    trace_enabled = 0;
+    FILE* output = fopen(filename, "w");
+
+    if (output) {
+        fprintf(output, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+        const char* sep = "\n";
+        for (TraceBuffer* buf = buffers; buf; buf = buf->next) {
+            fprintf(output, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                "\"tid\": %u, \"args\": {\"name\": \"%s %u\"}}", sep, buf->tid,
+                buf->is_main ? "main" : "worker", buf->tid);
+            sep = ",\n";
+            for (uint32_t i = 0; i < buf->len; i++) {
+                TraceEvent* ev = &buf->events[i];
+                fprintf(output, ",\n{\"name\": ");
+                write_json_string(output, ev->name);
+                fprintf(output, ", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %u",
+                    ev->phase, ev->ts / 1000.0, buf->tid);
+                if (ev->detail) {
+                    fprintf(output, ", \"args\": {\"detail\": ");
+                    write_json_string(output, ev->detail);
+                    fprintf(output, "}");
+                } else if (ev->index >= 0) {
+                    fprintf(output, ", \"args\": {\"index\": %lld}", (long long) ev->index);
+                }
+                fprintf(output, "}");
+            }
+        }
+        fprintf(output, "\n]}\n");
+    }
+
+    while (buffers) {
+        TraceBuffer* next = buffers->next;
+        free(buffers->events);
+        arena_free(&buffers->strings);
+        free(buffers);
+        buffers = next;
+    }
+    num_buffers = 0;
+    thread_buffer = NULL;
+
+    if (!output) {
+        return -1;
+    }
+    return fclose(output) == 0 ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Timeline of an assembly run in the Chrome trace event format, which can be
+   loaded into chrome://tracing or Perfetto. Every thread records into its own
+   buffer, so tracing takes no locks once a thread has recorded its first
+   event, and every call returns straight away while tracing is off.
+ */
+
+void trace_start();
+
+int trace_finish(const char* filename);
+
+void trace_begin(const char* name, const char* detail);
+
+void trace_begin_index(const char* name, uint32_t index);
+
+void trace_end(const char* name);
+
+#endif
@@ -4,9 +4,12 @@
 #include <math.h>
 
 #include "tables.h"
+#include "mnemonics.h"
 #include "translate_utils.h"
 #include "translate.h"
 
+static void put_expansion(FILE* output, const Expansion* exp, int i);
+
 /* Writes instructions during the assembler's first pass to OUTPUT. The case
    for general instructions has already been completed, but you need to write
    code to translate the li and blt pseudoinstructions. Your pseudoinstruction 
@@ -34,8 +37,8 @@
    larger than the largest 32 bit number to be loaded with li. You should follow
    the above rules if MARS behaves differently.
 
-   Use fprintf() to write. If writing multiple instructions, make sure that 
-   each instruction is on a different line.
+   Each instruction is written to OUTPUT with a single fwrite(). If writing
+   multiple instructions, make sure that each instruction is on a different line.
 
    Returns the number of instructions written (so 0 if there were any errors).
  */
@@ -55,99 +58,216 @@
 //name = instruction, args = array of args; num_args = number of items in args
 //pseudoinstructions, you must make sure that ARGS contains the correct number
 unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args) {
-    if (strcmp(name, "li") == 0) {
+    Expansion exp;
+    plan_expansion(&exp, name, args, num_args);
+
+    for (int i = 0; i < exp.count; i++) {
+        put_expansion(output, &exp, i);
+    }
+    return exp.count;
+}
+
+/*******************************
+ * Pseudoinstruction Expansion
+ *******************************/
+
+/* Where an operand of an expanded instruction comes from. */
+enum {
+    OPND_ARG0,          // the arguments of the source line
+    OPND_ARG1,
+    OPND_ARG2,
+    OPND_AT,            // $at
+    OPND_ZERO,          // $0
+    OPND_IMM,           // the immediate of the source line
+    OPND_IMM_HI,        // its upper 16 bits
+    OPND_IMM_LO         // its lower 16 bits
+};
+
+/* The field of an InstRecord an operand is stored in. */
+enum { FIELD_RD, FIELD_RS, FIELD_RT, FIELD_IMM, FIELD_SYM };
+
+typedef struct {
+    uint8_t src;
+    uint8_t field;
+} Operand;
+
+/* One instruction of an expansion, with its operands in argument order. */
+typedef struct {
+    InstId id;
+    int num_operands;
+    Operand operands[3];
+} ExpansionStep;
+
+struct ExpansionRule {
+    int count;
+    ExpansionStep steps[MAX_EXPANSION];
+};
+
+enum { RULE_LI_SHORT, RULE_LI_LONG, RULE_BLT };
+
+static const ExpansionRule RULES[] = {
+    //li $rt, imm -> addiu $rt $0 imm
+    [RULE_LI_SHORT] = { 1, {
+        { INST_ADDIU, 3, { { OPND_ARG0, FIELD_RT }, { OPND_ZERO, FIELD_RS },
+            { OPND_IMM, FIELD_IMM } } } } },
+    //li $rt, imm -> lui $at upper, ori $rt $at lower
+    [RULE_LI_LONG] = { 2, {
+        { INST_LUI, 2, { { OPND_AT, FIELD_RT }, { OPND_IMM_HI, FIELD_IMM } } },
+        { INST_ORI, 3, { { OPND_ARG0, FIELD_RT }, { OPND_AT, FIELD_RS },
+            { OPND_IMM_LO, FIELD_IMM } } } } },
+    //blt $rs, $rt, label -> slt $at $rs $rt, bne $at $0 label
+    [RULE_BLT] = { 2, {
+        { INST_SLT, 3, { { OPND_AT, FIELD_RD }, { OPND_ARG0, FIELD_RS },
+            { OPND_ARG1, FIELD_RT } } },
+        { INST_BNE, 3, { { OPND_AT, FIELD_RS }, { OPND_ZERO, FIELD_RT },
+            { OPND_ARG2, FIELD_SYM } } } } },
+};
+
+/* Performs the expansion described above for write_pass_one() without
+   writing anything: picks the rule that expands the line NAME ARGS into EXP,
+   along with the number of instructions it produces and the bytes it takes
+   up. The immediate of li is read here and nowhere else.
+
+   The size does not always match the count. A pseudoinstruction with the
+   wrong number of arguments still takes up 4 bytes, and li with a value
+   that does not fit in 32 bits takes up as many bytes as a valid one of
+   that size would, even though neither produces any instructions.
+ */
+void plan_expansion(Expansion* exp, const char* name, char** args, int num_args) {
+    exp->desc = lookup_inst(name);
+    exp->rule = NULL;
+    exp->name = name;
+    exp->args = args;
+    exp->num_args = num_args;
+    exp->imm = 0;
+    exp->size = 4;
+    exp->count = 1;
+
+    InstId id = exp->desc ? exp->desc->id : NUM_INSTS;
+    if (id == INST_LI) {
         //ex: li $8, 0x3BF20
-        int instructions_written = 0; 
-        long int imm;
-        int i = translate_num(&imm, args[1], -2147483648, 4294967295);
-        if (num_args == 2) {
-          if (i == -1) {
-            //immediate is too large 
-            return 0; 
-          } else if (-32768 <= imm && imm <= 65535) {
-            //addiu case
-            char charImm[20];
-            snprintf(charImm, 16, "%ld", imm);
-            char instructions[50]; //addiu $t3 $0 5
-            strcpy(instructions, "addiu ");
-            strcat(instructions, args[0]);
-            strcat(instructions, " $0 ");
-            strcat(instructions, charImm);
-            instructions_written += 1;
-            fprintf(output, "%s\n", instructions);
-            //printf("\n\n%s\n", instructions); //delete me (for testing)
-          } else {
-            //lui ori
-            long int imm2 = imm;
-            char luiInst[30];
-            char oriInst[30];
-            char luiImm[30];
-            char oriImm[30];
-
-            strcpy(luiInst, "lui ");
-            strcat(luiInst, "$at");
-            strcat(luiInst, " ");
-            //get upper 16 bits
-            imm = imm >> 16;
-            imm = imm & 0x0000ffff;
-            snprintf(luiImm, 16, "%lu", imm);
-            strcat(luiInst, luiImm);
-
-            strcpy(oriInst, "ori ");
-            strcat(oriInst, args[0]);
-            strcat(oriInst, " ");
-            strcat(oriInst, "$at");
-            strcat(oriInst, " ");
-
-            //get the lower 16 bits
-            imm2 = imm2 & 0xffff;
-            snprintf(oriImm, 16, "%lu", imm2);
-            strcat(oriInst, oriImm);
-            
-            instructions_written += 2;
-            fprintf(output, "%s\n", luiInst);
-            fprintf(output, "%s\n", oriInst);
-            //printf("%s\n", luiInst); //delete me (for testing)
-            //printf("%s\n", oriInst); //delete me (for testing)
-          }
+        if (num_args != 2) {
+          exp->count = 0;
+          return;
         }
-        return instructions_written;
-    } else if (strcmp(name, "blt") == 0) {
-        //ex: blt $8, $9, label
-        int instructions_written = 0;
-        if (num_args == 3) {
-          char sltInst[30];
-          char bneInst[30]; 
-
-          strcpy(sltInst, "slt ");
-          strcat(sltInst, "$at "); 
-          strcat(sltInst, args[0]);
-          strcat(sltInst, " ");
-          strcat(sltInst, args[1]);
-
-          strcpy(bneInst, "bne ");
-          strcat(bneInst, "$at ");
-          strcat(bneInst, "$0 ");
-          strcat(bneInst, args[2]);
-
-          fprintf(output, "%s\n", sltInst);
-          fprintf(output, "%s\n", bneInst);
-
-          //printf("\n%s\n", sltInst); //delete me (for testing)
-          //printf("%s\n", bneInst); //delete me (for testing)
-          
-          instructions_written += 2;
+        int err = translate_num(&exp->imm, args[1], -2147483648, 4294967295);
+        if (-32768 <= exp->imm && exp->imm <= 65535) {
+          exp->rule = &RULES[RULE_LI_SHORT];
+        } else {
+          exp->rule = &RULES[RULE_LI_LONG];
         }
-        return instructions_written;
-    } else {
-        /*Writes the instruction as a string to OUTPUT. NAME is the name of the 
-         instruction, and its arguments are in ARGS. NUM_ARGS is the length of
-         the array. */
-        write_inst_string(output, name, args, num_args);
-        return 1;
+        exp->size = 4 * exp->rule->count;
+        //an immediate that is too large is still counted in the size
+        exp->count = err == -1 ? 0 : exp->rule->count;
+    } else if (id == INST_BLT) {
+        if (num_args != 3) {
+          exp->count = 0;
+          return;
+        }
+        exp->rule = &RULES[RULE_BLT];
+        exp->size = 4 * exp->rule->count;
+        exp->count = exp->rule->count;
     }
 }
 
+/* Returns the text of operand OP of EXP. Immediates are formatted into NUM,
+   which must have room for 12 characters.
+ */
+static const char* operand_text(const Expansion* exp, const Operand* op, char* num) {
+    switch (op->src) {
+        case OPND_ARG0:
+        case OPND_ARG1:
+        case OPND_ARG2:   return exp->args[op->src - OPND_ARG0];
+        case OPND_AT:     return "$at";
+        case OPND_ZERO:   return "$0";
+        case OPND_IMM:    sprintf(num, "%ld", exp->imm); return num;
+        case OPND_IMM_HI: sprintf(num, "%lu", (unsigned long) ((exp->imm >> 16) & 0xffff)); return num;
+        default:          sprintf(num, "%lu", (unsigned long) (exp->imm & 0xffff)); return num;
+    }
+}
+
+/* Writes instruction I of EXP to OUTPUT as a line of the intermediate file. */
+void write_expansion(OutBuf* output, const Expansion* exp, int i) {
+    if (!exp->rule) {
+        write_inst_string(output, exp->name, exp->args, exp->num_args);
+        return;
+    }
+
+    const ExpansionStep* step = &exp->rule->steps[i];
+    char num[12];
+    outbuf_puts(output, get_inst(step->id)->name);
+    for (int k = 0; k < step->num_operands; k++) {
+        outbuf_putc(output, ' ');
+        outbuf_puts(output, operand_text(exp, &step->operands[k], num));
+    }
+    outbuf_putc(output, '\n');
+}
+
+/* Writes instruction I of EXP to OUTPUT like write_expansion(), but as a
+   single fwrite() of a line built on the stack, so callers writing one
+   instruction at a time need no OutBuf.
+ */
+static void put_expansion(FILE* output, const Expansion* exp, int i) {
+    const char* name = exp->name;
+    const char* const* args = (const char* const*) exp->args;
+    int num_args = exp->num_args;
+    const char* operands[3];
+    char nums[3][12];
+    if (exp->rule) {
+        const ExpansionStep* step = &exp->rule->steps[i];
+        name = get_inst(step->id)->name;
+        num_args = step->num_operands;
+        for (int k = 0; k < num_args; k++) {
+            operands[k] = operand_text(exp, &step->operands[k], nums[k]);
+        }
+        args = operands;
+    }
+
+    char line[256];
+    size_t len = strlen(name);
+    if (len < sizeof(line)) {
+        memcpy(line, name, len);
+    }
+    for (int k = 0; k < num_args; k++) {
+        size_t n = strlen(args[k]);
+        if (len + 1 + n < sizeof(line)) {
+            line[len] = ' ';
+            memcpy(line + len + 1, args[k], n);
+        }
+        len += 1 + n;
+    }
+    if (len < sizeof(line)) {
+        line[len++] = '\n';
+        fwrite(line, 1, len, output);
+        return;
+    }
+
+    //too long for the stack, which only happens for unreasonable labels
+    fputs(name, output);
+    for (int k = 0; k < num_args; k++) {
+        putc(' ', output);
+        fputs(args[k], output);
+    }
+    putc('\n', output);
+}
+
+/* Returns the text write_expansion() would write for instruction I of EXP,
+   without the trailing newline, as a string allocated from ARENA.
+ */
+char* expansion_to_string(Arena* arena, const Expansion* exp, int i) {
+    if (!exp->rule) {
+        return inst_to_string(arena, exp->name, exp->args, exp->num_args);
+    }
+
+    const ExpansionStep* step = &exp->rule->steps[i];
+    char nums[3][12];
+    char* args[3];
+    for (int k = 0; k < step->num_operands; k++) {
+        args[k] = (char*) operand_text(exp, &step->operands[k], nums[k]);
+    }
+    return inst_to_string(arena, get_inst(step->id)->name, args, step->num_operands);
+}
+
 // translate_inst() should translate instructions to hexadecimal.
 
 // You will find the translate_reg(), translate_num(), and 
@@ -187,269 +307,371 @@ unsigned write_pass_one(FILE* output, const char* name, char** args, int num_arg
 
 int translate_inst(FILE* output, const char* name, char** args, size_t num_args, uint32_t addr,
     SymbolTable* symtbl, SymbolTable* reltbl) {
-    if (strcmp(name, "addu") == 0)       return write_rtype (0x21, output, args, num_args);
-    else if (strcmp(name, "or") == 0)    return write_rtype (0x25, output, args, num_args);
-    else if (strcmp(name, "slt") == 0)   return write_rtype (0x2a, output, args, num_args);
-    else if (strcmp(name, "sltu") == 0)  return write_rtype (0x2b, output, args, num_args);
-    
-    else if (strcmp(name, "sll") == 0)   return write_shift (0x00, output, args, num_args);
-    
-    else if (strcmp (name, "jr") == 0)   return write_jr (0x08, output, args, num_args);
-    
-    else if (strcmp (name, "addiu") == 0)return write_addiu (0x09, output, args, num_args);
-    
-    else if (strcmp (name, "ori") == 0)  return write_ori (0x0d, output, args, num_args);
-    
-    else if (strcmp (name, "lui") == 0)  return write_lui (0x0f, output, args, num_args);
-    
-    else if (strcmp (name, "lb") == 0)   return write_itype (0x20, output, args, num_args);
-    else if (strcmp (name, "lbu") == 0)  return write_itype (0x24, output, args, num_args);
-    else if (strcmp (name, "lw") == 0)   return write_itype (0x23, output, args, num_args);
-    else if (strcmp (name, "sb") == 0)   return write_mem (0x28, output, args, num_args);
-    else if (strcmp (name, "sw") == 0)   return write_mem (0x2b, output, args, num_args);
-
-    // require symbol table
-    else if (strcmp (name, "beq") == 0)  return write_branch (0x04, output, args, num_args, addr, symtbl);
-    else if (strcmp (name, "bne") == 0)  return write_branch (0x05, output, args, num_args, addr, symtbl);
-    else if (strcmp (name, "j") == 0)    return write_jump (0x02, output, args, num_args, addr, reltbl);
-    else if (strcmp (name, "jal") == 0)  return write_jump (0x03, output, args, num_args, addr, reltbl);
-    else                                 return -1;
+    uint32_t instruction;
+    if (encode_inst(&instruction, lookup_inst(name), args, num_args, addr, symtbl, reltbl) == -1) {
+        return -1;
+    }
+    char line[9];
+    for (int i = 7; i >= 0; i--) {
+        line[i] = "0123456789abcdef"[instruction & 0xf];
+        instruction >>= 4;
+    }
+    line[8] = '\n';
+    fwrite(line, 1, sizeof(line), output);
+    return 0;
 }
 
-int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* symtbl) {
-    if (args[0] == '\0') return -1;
+/* Encodes the instruction described by DESC into INST instead of writing it.
+   DESC is the result of lookup_inst() and may be NULL, in which case the
+   instruction is invalid. Otherwise behaves exactly like translate_inst().
+ */
+int encode_inst(uint32_t* inst, const InstDesc* desc, char** args, size_t num_args, uint32_t addr,
+    SymbolTable* symtbl, SymbolTable* reltbl) {
+    InstRecord rec;
+    if (parse_inst(&rec, desc, args, num_args) == -1) {
+        return -1;
+    }
+    return encode_record(inst, &rec, addr, symtbl, reltbl);
+}
 
-    // store into symtbl
-    long int rs = translate_reg(args[0]);
-    long int rt = translate_reg(args[1]);
-    long int imm;
-    if (get_addr_for_symbol(symtbl, args[2]) == -1) return -1;
-    int offset =  (get_addr_for_symbol(symtbl, args[2]) - (addr + 4)) / 4; //label_address - (branch_instruction_address + 4)
-    char buf[17];
-    sprintf(buf, "%d", offset);
+/*******************************
+ * Instruction Records
+ *******************************/
 
-       
-    int err = translate_num(&imm, buf, -32768, 65536);
+/* Validates the arguments of the instruction described by DESC and stores
+   them in REC, so that the instruction can later be encoded by encode_record()
+   without looking at any strings again. REC->SYM points into ARGS. REC->LINE
+   and REC->TEXT are left for the caller to fill in.
 
-    if (rs == -1 || rt == -1 || err == -1) { 
-      return -1;
+   Branch labels can only be checked once the symbol table is complete, so
+   that is left to encode_record().
+
+   Returns 0 on success and -1 if the instruction is invalid.
+ */
+int parse_inst(InstRecord* rec, const InstDesc* desc, char** args, size_t num_args) {
+    if (!desc) return -1;
+
+    rec->id = desc->id;
+    rec->rd = rec->rs = rec->rt = 0;
+    rec->imm = 0;
+    rec->sym = NULL;
+
+    switch (desc->format) {
+        case FMT_RTYPE:  return parse_rtype (rec, args, num_args);
+        case FMT_SHIFT:  return parse_shift (rec, args, num_args);
+        case FMT_JR:     return parse_jr (rec, args, num_args);
+        case FMT_ADDIU:
+        case FMT_ORI:    return parse_itype (rec, args, num_args);
+        case FMT_LUI:    return parse_lui (rec, args, num_args);
+        case FMT_LOAD:
+        case FMT_STORE:  return parse_mem (rec, args, num_args);
+        case FMT_BRANCH: return parse_branch (rec, args, num_args);
+        case FMT_JUMP:   return parse_jump (rec, args, num_args);
+
+        // pseudoinstructions never reach pass two
+        default:         return -1;
     }
+}
 
-    long int op = opcode << 26;
-    rs = rs << 21;
-    rt = rt << 16;
+/* Stores instruction I of EXP in REC, exactly as parse_inst() would store it
+   after reading its text back, but without writing out its operands.
+   Returns 0 on success and -1 if the instruction is invalid.
+ */
+int expansion_record(InstRecord* rec, const Expansion* exp, int i) {
+    if (!exp->rule) {
+        return parse_inst(rec, exp->desc, exp->args, exp->num_args);
+    }
 
-    uint32_t instruction = rs | rt | op | (imm & 0xffff);
-    write_inst_hex(output, instruction);
+    const ExpansionStep* step = &exp->rule->steps[i];
+    rec->id = step->id;
+    rec->rd = rec->rs = rec->rt = 0;
+    rec->imm = 0;
+    rec->sym = NULL;
+
+    for (int k = 0; k < step->num_operands; k++) {
+        const Operand* op = &step->operands[k];
+        long int value;
+        switch (op->src) {
+            case OPND_ARG0:
+            case OPND_ARG1:
+            case OPND_ARG2:
+                if (op->field == FIELD_SYM) {
+                    rec->sym = exp->args[op->src - OPND_ARG0];
+                    continue;
+                }
+                value = translate_reg(exp->args[op->src - OPND_ARG0]);
+                if (value == -1) return -1;
+                break;
+            case OPND_AT:     value = 1; break;
+            case OPND_ZERO:   value = 0; break;
+            case OPND_IMM:    value = exp->imm; break;
+            case OPND_IMM_HI: value = (exp->imm >> 16) & 0xffff; break;
+            default:          value = exp->imm & 0xffff; break;
+        }
+        switch (op->field) {
+            case FIELD_RD:  rec->rd = value; break;
+            case FIELD_RS:  rec->rs = value; break;
+            case FIELD_RT:  rec->rt = value; break;
+            default:        rec->imm = value; break;
+        }
+    }
     return 0;
 }
 
-int write_mem(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-    if (args[0] == '\0') return -1;
-    // for storing
-    // sb = sw: rs + signextimm = rt
-
-    long int rt = translate_reg(args[0]);
-    long int rs = translate_reg(args[2]);
-    long int imm;
-    long int err = translate_num(&imm, args[1], -32768, 65536);
+/* Encodes the record REC into INST. ADDR is the address of the instruction.
+   Branch labels are resolved with SYMTBL, and jumps are added to RELTBL with
+   their fields left as zeros.
 
-    if (rt == -1 || rs == -1 || err == -1) { 
-      return -1;
+   Returns 0 on success and -1 if a branch label is missing or too far away.
+ */
+int encode_record(uint32_t* inst, const InstRecord* rec, uint32_t addr,
+    SymbolTable* symtbl, SymbolTable* reltbl) {
+    const InstDesc* desc = get_inst(rec->id);
+    uint32_t op = (uint32_t) desc->code << 26;
+    uint32_t rs = (uint32_t) rec->rs << 21;
+    uint32_t rt = (uint32_t) rec->rt << 16;
+    uint32_t rd = (uint32_t) rec->rd << 11;
+
+    switch (desc->format) {
+        case FMT_RTYPE:
+            *inst = rs | rt | rd | (desc->code & 0x3f);
+            return 0;
+        case FMT_SHIFT:
+            *inst = rt | rd | (rec->imm << 6) | (desc->code & 0x3f);
+            return 0;
+        case FMT_JR:
+            *inst = rs | (desc->code & 0x3f);
+            return 0;
+        case FMT_ADDIU:
+        case FMT_ORI:
+        case FMT_LUI:
+        case FMT_LOAD:
+        case FMT_STORE:
+            *inst = op | rs | rt | (rec->imm & 0xffff);
+            return 0;
+        case FMT_BRANCH: {
+            int64_t target = get_addr_for_symbol(symtbl, rec->sym);
+            if (target == -1) return -1;
+            //label_address - (branch_instruction_address + 4)
+            int64_t offset = (target - ((int64_t) addr + 4)) / 4;
+            if (check_num_bounds(offset, -32768, 65536) != 0) return -1;
+            *inst = op | rs | rt | (offset & 0xffff);
+            return 0;
+        }
+        case FMT_JUMP:
+            // put relative address in relocation table.
+            add_to_table(reltbl, rec->sym, addr);
+            *inst = op;
+            return 0;
+        default:
+            return -1;
     }
+}
 
-    long int op = opcode << 26;
-    rs = rs << 21;
-    rt = rt << 16;
+/* Sets up an empty list of instruction records. */
+void inst_list_init(InstList* list) {
+    list->recs = NULL;
+    list->len = 0;
+    list->cap = 0;
+    arena_init(&list->strings, 4096);
+}
 
-    uint32_t instruction = op + rs + rt + (imm & 0xFFFF);
-    write_inst_hex(output, instruction);
-    return 0;
+/* Frees the records and strings owned by LIST. */
+void inst_list_free(InstList* list) {
+    free(list->recs);
+    list->recs = NULL;
+    list->len = list->cap = 0;
+    arena_free(&list->strings);
 }
 
+/* Removes every record from LIST, keeping its memory for the next ones. */
+void inst_list_clear(InstList* list) {
+    list->len = 0;
+    arena_reset(&list->strings);
+}
 
-int write_lui(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-    if (args[0] == '\0') return -1;
-    // rt = imm | b
+/* Parses the instruction NAME with arguments ARGS and appends its record to
+   LIST. LINE is the source line it came from. Invalid instructions are kept
+   as INST_INVALID records so that pass two can report them in order.
 
-    long int rt = translate_reg(args[0]);
-    long int imm;
-    long int err = translate_num(&imm, args[1], -32768, 65536);
-    // lower bound = 2^(n-1). upper bound = 2^(n-1) - 1
+   Returns the new record.
+ */
+InstRecord* inst_list_add(InstList* list, const char* name, char** args, int num_args,
+    uint32_t line) {
+    Expansion exp = { lookup_inst(name), NULL, name, args, num_args, 0, 4, 1 };
+    return inst_list_add_expansion(list, &exp, 0, line);
+}
 
-    if (rt == -1 || err == -1) { 
-      return -1;
+/* Same as inst_list_add(), for instruction I of the expansion EXP. */
+InstRecord* inst_list_add_expansion(InstList* list, const Expansion* exp, int i, uint32_t line) {
+    if (list->len == list->cap) {
+        list->cap = list->cap ? list->cap * 2 : 1024;
+        list->recs = (InstRecord*) realloc(list->recs, list->cap * sizeof(InstRecord));
+        if (list->recs == NULL) allocation_failed();
     }
 
-    long int op = opcode << 26;
-    rt = rt << 16;
+    InstRecord* rec = &list->recs[list->len++];
+    if (expansion_record(rec, exp, i) == -1) {
+        rec->id = INST_INVALID;
+        rec->sym = NULL;
+    }
+    rec->line = line;
+    rec->text = NULL;
 
-    uint32_t instruction = rt + op + (imm & 0xffff);
-    write_inst_hex(output, instruction);
-    return 0;  
+    if (rec->sym) {
+        rec->sym = arena_strdup(&list->strings, rec->sym);
+    }
+    //only branches and invalid instructions can fail in pass two
+    if (rec->id == INST_INVALID || get_inst(rec->id)->format == FMT_BRANCH) {
+        rec->text = expansion_to_string(&list->strings, exp, i);
+    }
+    return rec;
+}
+
+/* Appends copies of the N records RECS to LIST, adding LINE_OFFSET to their
+   line numbers. Their strings are not copied, so whatever owns them has to
+   outlive LIST (see arena_adopt()).
+ */
+void inst_list_append(InstList* list, const InstRecord* recs, uint32_t n,
+    uint32_t line_offset) {
+    if (list->len + n > list->cap) {
+        while (list->len + n > list->cap) {
+            list->cap = list->cap ? list->cap * 2 : 1024;
+        }
+        list->recs = (InstRecord*) realloc(list->recs, list->cap * sizeof(InstRecord));
+        if (list->recs == NULL) allocation_failed();
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        list->recs[list->len] = recs[i];
+        list->recs[list->len].line += line_offset;
+        list->len += 1;
+    }
 }
 
-int write_jr(uint8_t funct, FILE* output, char** args, size_t num_args) {
-    if (args[0] == '\0') return -1;
-    // jr. PC = rs 
-    long int rs = translate_reg(args[0]);
+/*******************************
+ * Argument Parsing Helpers
+ *******************************/
+
+/* rd, rs, rt */
+int parse_rtype(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
-    if (rs == -1) { 
+    int rd = translate_reg(args[0]);
+    int rs = translate_reg(args[1]);
+    int rt = translate_reg(args[2]);
+    if (rd == -1 || rs == -1 || rt == -1) {
       return -1;
     }
 
-    rs = rs << 21;
-
-    uint32_t instruction = rs + (funct & 0b111111);
-    write_inst_hex(output, instruction);
+    rec->rd = rd;
+    rec->rs = rs;
+    rec->rt = rt;
     return 0;
 }
 
+/* rd, rt, shamt */
+int parse_shift(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
-int write_ori(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-    if (args[0] == '\0') return -1;
-    // rt = rs | imm
-
-    long int rt = translate_reg(args[0]);
-    long int rs = translate_reg(args[1]);
-    long int imm;
-    long int err = translate_num(&imm, args[2], -32768, 65536);
-
-    if (rs == -1 || rt == -1 || err == -1) { 
+    int rd = translate_reg(args[0]);
+    int rt = translate_reg(args[1]);
+    long int shamt;
+    int err = translate_num(&shamt, args[2], 0, 31); // 2^5 = 32
+    if (rd == -1 || rt == -1 || err == -1) {
       return -1;
     }
 
-    long int op = opcode << 26;
-    rs = rs << 21;
-    rt = rt << 16;
-
-    uint32_t instruction = op + rs + rt + (imm & 0xffff);
-    write_inst_hex(output, instruction);
+    rec->rd = rd;
+    rec->rt = rt;
+    rec->imm = shamt;
     return 0;
 }
 
-int write_itype(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-    if (args[0] == '\0') return -1;
-
-    long int rt = translate_reg(args[0]);
-    long int rs = translate_reg(args[2]);
-    long int imm;
-    long int err = translate_num(&imm, args[1], -32768, 65536);
-    // lower bound = 2^(n-1). upper bound = 2^(n-1) - 1
+/* rs */
+int parse_jr(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
-    if (rs == -1 || rt == -1 || err == -1) { 
+    int rs = translate_reg(args[0]);
+    if (rs == -1) {
       return -1;
     }
 
-    long int op = opcode << 26;
-    rs = rs << 21;
-    rt = rt << 16;
-
-    uint32_t instruction = rs + rt + op + (imm & 0xffff);
-    write_inst_hex(output, instruction);
+    rec->rs = rs;
     return 0;
 }
 
-int write_addiu(uint8_t opcode, FILE* output, char** args, size_t num_args) {
-    if (args[0] == '\0') return -1;
+/* rt, rs, imm (addiu and ori) */
+int parse_itype(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
     int rt = translate_reg(args[0]);
     int rs = translate_reg(args[1]);
     long int imm;
     int err = translate_num(&imm, args[2], -32768, 65536);
-    
-    //error check
-    if (rs == -1 || rt == -1 || err == -1) { 
-      return -1; 
-    }   
-    
-    int op = opcode << 26; 
-    rs = rs << 21; 
-    rt = rt << 16; 
-  
-    uint32_t instruction = op | rs | rt | (imm & 0xFFFF);
-    fprintf(output, "%x\n", instruction);
+    if (rs == -1 || rt == -1 || err == -1) {
+      return -1;
+    }
+
+    rec->rt = rt;
+    rec->rs = rs;
+    rec->imm = imm;
     return 0;
 }
 
-int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* reltbl) {
-    // put relative address in relocation table. 
-    if (args[0] == '\0') return -1;
+/* rt, imm */
+int parse_lui(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
-    add_to_table(reltbl, args[0], addr);
-
-    long int op = opcode << 26;
-
-    uint32_t instruction = op;
-    write_inst_hex(output, instruction);
+    int rt = translate_reg(args[0]);
+    long int imm;
+    int err = translate_num(&imm, args[1], -32768, 65536);
+    if (rt == -1 || err == -1) {
+      return -1;
+    }
 
+    rec->rt = rt;
+    rec->imm = imm;
     return 0;
 }
 
-/* A helper function for writing most R-type instructions. You should use
-   translate_reg() to parse registers and write_inst_hex() to write to 
-   OUTPUT. Both are defined in translate_utils.h.
-
-   This function is INCOMPLETE. Complete the implementation below. You will
-   find bitwise operations to be the cleanest way to complete this function.
- */
-int write_rtype(uint8_t funct, FILE* output, char** args, size_t num_args) {
-    // Perhaps perform some error checking?
-
-    if (args[0] == '\0') return -1;
-
-    //addu = rd = rs + rt
-    //or = rd = rs | rt
-    //slt = rd = rs < rt
-    //sltu = rd = rs < rt
+/* rt, offset(rs) for loads and stores */
+int parse_mem(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
-    long int rd = translate_reg(args[0]);
-    long int rs = translate_reg(args[1]);
-    long int rt = translate_reg(args[2]);
-
-    if (rd == -1 || rs == -1 || rt == -1) { 
+    int rt = translate_reg(args[0]);
+    int rs = translate_reg(args[2]);
+    long int imm;
+    int err = translate_num(&imm, args[1], -32768, 65536);
+    if (rs == -1 || rt == -1 || err == -1) {
       return -1;
     }
 
-    rs = rs << 21;
-    rt = rt << 16;
-    rd = rd << 11;
-
-    uint32_t instruction = rs + rt + rd + (funct & 0b111111);
-    write_inst_hex(output, instruction);
+    rec->rt = rt;
+    rec->rs = rs;
+    rec->imm = imm;
     return 0;
 }
 
-/* A helper function for writing shift instructions. You should use 
-   translate_num() to parse numerical arguments. translate_num() is defined
-   in translate_utils.h.
-
-   This function is INCOMPLETE. Complete the implementation below. You will
-   find bitwise operations to be the cleanest way to complete this function.
- */
-int write_shift(uint8_t funct, FILE* output, char** args, size_t num_args) {
-	// Perhaps perform some error checking?
-
-  // sll: rd = rt << shiftamt
-    if (args[0] == '\0') return -1;
+/* rs, rt, label. The label is resolved by encode_record(). */
+int parse_branch(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
 
-    long int rd = translate_reg(args[0]);
-    long int rt = translate_reg(args[1]);
-    long int shamt;
-    long int err = translate_num(&shamt, args[2], 0, 31); // 2^5 = 32
-
-    if (rd == -1 || rt == -1 || err == -1) {
+    int rs = translate_reg(args[0]);
+    int rt = translate_reg(args[1]);
+    if (rs == -1 || rt == -1 || args[2] == NULL) {
       return -1;
     }
 
-    rt = rt << 16;
-    rd = rd << 11;
-    shamt = shamt << 6;
-
-    uint32_t instruction = rd + rt + shamt + (funct & 0b111111);
-    write_inst_hex(output, instruction);
+    rec->rs = rs;
+    rec->rt = rt;
+    rec->sym = args[2];
     return 0;
 }
 
+/* label. Relocated by encode_record(). */
+int parse_jump(InstRecord* rec, char** args, size_t num_args) {
+    if (args[0] == NULL) return -1;
+
+    rec->sym = args[0];
+    return 0;
+}
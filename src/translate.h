@@ -1,39 +1,100 @@
-#ifndef TRANSLATE_H
-#define TRANSLATE_H
-
-#include <stdint.h>
-
-/* IMPLEMENT ME - see documentation in translate.c */
-unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args);
-
-/* IMPLEMENT ME - see documentation in translate.c */
-int translate_inst(FILE* output, const char* name, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl);
-
-/* Declaring helper functions: */
-
-int write_rtype(uint8_t funct, FILE* output, char** args, size_t num_args);
-
-int write_shift(uint8_t funct, FILE* output, char** args, size_t num_args);
-
-/* SOLUTION CODE BELOW */
-
-int write_itype(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_jr(uint8_t funct, FILE* output, char** args, size_t num_args);
-
-int write_addiu(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_ori(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_lui(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_mem(uint8_t opcode, FILE* output, char** args, size_t num_args);
-
-int write_branch(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* symtbl); //pull addr from symbol table to calculate immediate
-
-int write_jump(uint8_t opcode, FILE* output, char** args, size_t num_args, 
-    uint32_t addr, SymbolTable* reltbl);
-
-#endif
+#ifndef TRANSLATE_H
+#define TRANSLATE_H
+
+#include <stdint.h>
+
+#include "mnemonics.h"
+
+/* Most instructions a single line of input can expand into. */
+#define MAX_EXPANSION 2
+
+/* Fixed expansion of a pseudoinstruction, private to translate.c. */
+typedef struct ExpansionRule ExpansionRule;
+
+/* A line of input with the expansion chosen for it by plan_expansion(). */
+typedef struct {
+    const InstDesc* desc;       // NULL if NAME is not an instruction
+    const ExpansionRule* rule;  // NULL if the line is passed through as it is
+    const char* name;
+    char** args;
+    int num_args;
+    long int imm;               // immediate of li, read once for both size and encoding
+    uint32_t size;              // bytes the line adds to the byte offset of later labels
+    int count;                  // instructions the line expands into, 0 if it is invalid
+} Expansion;
+
+/* IMPLEMENT ME - see documentation in translate.c */
+unsigned write_pass_one(FILE* output, const char* name, char** args, int num_args);
+
+void plan_expansion(Expansion* exp, const char* name, char** args, int num_args);
+
+void write_expansion(OutBuf* output, const Expansion* exp, int i);
+
+char* expansion_to_string(Arena* arena, const Expansion* exp, int i);
+
+/* IMPLEMENT ME - see documentation in translate.c */
+int translate_inst(FILE* output, const char* name, char** args, size_t num_args, 
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl);
+
+int encode_inst(uint32_t* inst, const InstDesc* desc, char** args, size_t num_args,
+    uint32_t addr, SymbolTable* symtbl, SymbolTable* reltbl);
+
+/* A fully parsed instruction, produced by pass one and encoded by pass two
+   without looking at its text again.
+ */
+typedef struct {
+    uint8_t id;             // InstId, or INST_INVALID if the instruction is invalid
+    uint8_t rd, rs, rt;
+    int32_t imm;            // immediate, offset or shift amount
+    uint32_t line;          // source line the instruction came from
+    const char* sym;        // label of a branch or jump
+    const char* text;       // "name arg1 ...", kept for branches and invalid instructions
+} InstRecord;
+
+typedef struct {
+    InstRecord* recs;
+    uint32_t len;
+    uint32_t cap;
+    Arena strings;          // owns every SYM and TEXT of the records
+} InstList;
+
+int parse_inst(InstRecord* rec, const InstDesc* desc, char** args, size_t num_args);
+
+int expansion_record(InstRecord* rec, const Expansion* exp, int i);
+
+int encode_record(uint32_t* inst, const InstRecord* rec, uint32_t addr,
+    SymbolTable* symtbl, SymbolTable* reltbl);
+
+void inst_list_init(InstList* list);
+
+void inst_list_free(InstList* list);
+
+void inst_list_clear(InstList* list);
+
+InstRecord* inst_list_add(InstList* list, const char* name, char** args, int num_args,
+    uint32_t line);
+
+InstRecord* inst_list_add_expansion(InstList* list, const Expansion* exp, int i, uint32_t line);
+
+void inst_list_append(InstList* list, const InstRecord* recs, uint32_t n,
+    uint32_t line_offset);
+
+/* Declaring helper functions: */
+
+int parse_rtype(InstRecord* rec, char** args, size_t num_args);
+
+int parse_shift(InstRecord* rec, char** args, size_t num_args);
+
+int parse_jr(InstRecord* rec, char** args, size_t num_args);
+
+int parse_itype(InstRecord* rec, char** args, size_t num_args);
+
+int parse_lui(InstRecord* rec, char** args, size_t num_args);
+
+int parse_mem(InstRecord* rec, char** args, size_t num_args);
+
+int parse_branch(InstRecord* rec, char** args, size_t num_args);
+
+int parse_jump(InstRecord* rec, char** args, size_t num_args);
+
+#endif
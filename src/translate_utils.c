@@ -1,152 +1,244 @@
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <ctype.h>
-
-#include "translate_utils.h"
-
-void write_inst_string(FILE* output, const char* name, char** args, int num_args) {
-    fprintf(output, "%s", name);
-    for (int i = 0; i < num_args; i++) {
-        fprintf(output, " %s", args[i]);
-    }
-    fprintf(output, "\n");
-}
-
-void write_inst_hex(FILE *output, uint32_t instruction) {
-    fprintf(output, "%08x\n", instruction);
-}
-
-int is_valid_label(const char* str) {
-    if (!str) {
-        return 0;
-    }
-
-    int first = 1;
-    while (*str) {
-        if (first) {
-            if (!isalpha((int) *str) && *str != '_') {
-                return 0;   // does not start with letter or underscore
-            } else {
-                first = 0;
-            }
-        } else if (!isalnum((int) *str) && *str != '_') {
-            return 0;       // subsequent characters not alphanumeric
-        }
-        str++;
-    }
-    return first ? 0 : 1;   // empty string is invalid
-}
-
-/* Helper function to see if a string is a valid number. 
-   Guard against cases of "12345abcde"
-*/
-int is_valid_number(const char *a) {
-  if (a[0] == '-') {
-    for (int i = 1; a[i] != '\0'; i++) {
-      if (!isdigit(a[i])) {
-        return 0;
-      }
-    }
-  } else {
-    for (int i = 0; a[i] != '\0'; i++) {
-      if (!isdigit(a[i])) {
-        return 0;
-      }
-    }
-  }
-  return 1;
-}
-
-/* Helper function to see if it's a hex number. 
-   it is a hex number of it starts with 0x. 
-*/
-int is_hex(const char *a) {
-   if (strncmp("0x", a, 2) == 0) {
-     return 1;
-   } else {
-     return 0;
-   }
-}
-
-
-/* Translate the input string into a signed number. The number is then 
-   checked to be within the correct range (note bounds are INCLUSIVE)
-   ie. NUM is valid if LOWER_BOUND <= NUM <= UPPER_BOUND. 
-   The input may be in either positive or negative, and be in either
-   decimal or hexadecimal format. It is also possible that the input is not
-   a valid number. Fortunately, the library function strtol() can take 
-   care of all that.
-   Please read the documentation for strtol() carefully. 
-   Do not use strtoul() or any other variants. 
-   You should store the result into the location that OUTPUT points to. The 
-   function returns 0 if the conversion proceeded without errors, or -1 if an 
-   error occurred.
- */
-int translate_num(long int* output, const char* str, long int lower_bound, 
-    long int upper_bound) {
-//    long int result;     
-
-    if (!str || !output) {
-        return -1;
-    }
-
-    //check if hex
-    //if not hex, check if it's a valid number
-    char * endptr;
-/*
-    if (is_hex(str)) {
-      result = strtol(str, &endptr, 16); 
-    } else if (is_valid_number(str)) {
-      // printf("*** str is a valid number? %d\n ", is_valid_number(str));
-      result = strtol(str, &endptr, 10);
-    } else {
-      return -1;
-    }
- */  
-    *output = strtol(str, &endptr, 0);
-    // printf("*** Result is and should not be 0 %d\n ", result);
-    // printf("*** the value of string is %d\n", *str);
-
-    //check to see if there's a valid conversion
-    /*
-    if (endptr != '\0') {
-      return -1;
-    }
-   */
-    if (strcmp(endptr, "\0") != 0) return -1;   
-    
-    //check to make sure within bounds
-    if (lower_bound <= *output && *output <= upper_bound) {
-      //*output = result;
-      return 0;
-    } else {
-      return -1;
-    }
-}
-
-/* Translates the register name to the corresponding register number. Please
-   see the MIPS Green Sheet for information about register numbers.
-   Returns the register number of STR or -1 if the register name is invalid.
- */
-int translate_reg(const char* str) {
-    if (strcmp(str, "$zero") == 0)      return 0;
-    else if (strcmp(str, "$0") == 0)    return 0;
-    else if (strcmp(str, "$at") == 0)   return 1;
-    else if (strcmp(str, "$v0") == 0)   return 2;
-    else if (strcmp(str, "$a0") == 0)   return 4;
-    else if (strcmp(str, "$a1") == 0)   return 5;
-    else if (strcmp(str, "$a2") == 0)   return 6;
-    else if (strcmp(str, "$a3") == 0)   return 7;
-    else if (strcmp(str, "$t0") == 0)   return 8;
-    else if (strcmp(str, "$t1") == 0)   return 9;
-    else if (strcmp(str, "$t2") == 0)   return 10;
-    else if (strcmp(str, "$t3") == 0)   return 11;
-    else if (strcmp(str, "$s0") == 0)   return 16;
-    else if (strcmp(str, "$s1") == 0)   return 17;
-    else if (strcmp(str, "$s2") == 0)   return 18;
-    else if (strcmp(str, "$s3") == 0)   return 19;
-    else if (strcmp(str, "$sp") == 0)   return 29;
-    else if (strcmp(str, "$ra") == 0)   return 31;
-    else                                return -1;
-}
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "translate_utils.h"
+
+void write_inst_string(OutBuf* output, const char* name, char** args, int num_args) {
+    outbuf_puts(output, name);
+    for (int i = 0; i < num_args; i++) {
+        outbuf_putc(output, ' ');
+        outbuf_puts(output, args[i]);
+    }
+    outbuf_putc(output, '\n');
+}
+
+char* inst_to_string(Arena* arena, const char* name, char** args, int num_args) {
+    size_t len = strlen(name) + 1;
+    for (int i = 0; i < num_args; i++) {
+        len += strlen(args[i]) + 1;
+    }
+    char* str = (char*) arena_alloc(arena, len);
+    char* end = stpcpy(str, name);
+    for (int i = 0; i < num_args; i++) {
+        *end++ = ' ';
+        end = stpcpy(end, args[i]);
+    }
+    return str;
+}
+
+void write_inst_hex(OutBuf* output, uint32_t instruction) {
+    outbuf_hex32(output, instruction);
+    outbuf_putc(output, '\n');
+}
+
+void write_inst_hex_n(OutBuf* output, const uint32_t* instructions, size_t n) {
+    outbuf_hex32_lines(output, instructions, n);
+}
+
+int is_valid_label(const char* str) {
+    if (!str) {
+        return 0;
+    }
+    return is_valid_label_n(str, strlen(str));
+}
+
+int is_valid_label_n(const char* str, size_t len) {
+    if (len == 0) {
+        return 0;           // empty string is invalid
+    }
+    if (!isalpha((int) str[0]) && str[0] != '_') {
+        return 0;           // does not start with letter or underscore
+    }
+    for (size_t i = 1; i < len; i++) {
+        if (!isalnum((int) str[i]) && str[i] != '_') {
+            return 0;       // subsequent characters not alphanumeric
+        }
+    }
+    return 1;
+}
+
+/* Helper function to see if a string is a valid number. 
+   Guard against cases of "12345abcde"
+*/
+int is_valid_number(const char *a) {
+  if (a[0] == '-') {
+    for (int i = 1; a[i] != '\0'; i++) {
+      if (!isdigit(a[i])) {
+        return 0;
+      }
+    }
+  } else {
+    for (int i = 0; a[i] != '\0'; i++) {
+      if (!isdigit(a[i])) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/* Helper function to see if it's a hex number. 
+   it is a hex number of it starts with 0x. 
+*/
+int is_hex(const char *a) {
+   if (strncmp("0x", a, 2) == 0) {
+     return 1;
+   } else {
+     return 0;
+   }
+}
+
+
+/* Value of each digit character plus one, so that 0 marks a character that
+   is not a digit in any base translate_num() reads.
+ */
+#define DIGIT(c, value) [(unsigned char) (c)] = (value) + 1
+
+static const uint8_t DIGIT_VALUES[256] = {
+    DIGIT('0', 0), DIGIT('1', 1), DIGIT('2', 2), DIGIT('3', 3), DIGIT('4', 4),
+    DIGIT('5', 5), DIGIT('6', 6), DIGIT('7', 7), DIGIT('8', 8), DIGIT('9', 9),
+    DIGIT('a', 10), DIGIT('b', 11), DIGIT('c', 12), DIGIT('d', 13), DIGIT('e', 14),
+    DIGIT('f', 15), DIGIT('A', 10), DIGIT('B', 11), DIGIT('C', 12), DIGIT('D', 13),
+    DIGIT('E', 14), DIGIT('F', 15),
+};
+
+#undef DIGIT
+
+/* Returns the value of digit C in BASE, or BASE if C is not one. */
+static unsigned digit_value(char c, unsigned base) {
+    unsigned value = DIGIT_VALUES[(unsigned char) c];
+    return value == 0 || value > base ? base : value - 1;
+}
+
+/* Returns 0 if LOWER_BOUND <= VALUE <= UPPER_BOUND and -1 otherwise. Used
+   for numbers that are computed rather than read, such as branch offsets.
+ */
+int check_num_bounds(long int value, long int lower_bound, long int upper_bound) {
+    return lower_bound <= value && value <= upper_bound ? 0 : -1;
+}
+
+/* Translate the input string into a signed number. The number is then 
+   checked to be within the correct range (note bounds are INCLUSIVE)
+   ie. NUM is valid if LOWER_BOUND <= NUM <= UPPER_BOUND. 
+   The input may be in either positive or negative, and be in either
+   decimal, hexadecimal (0x) or octal (leading 0) format. It is also possible
+   that the input is not a valid number.
+
+   The number is read in one pass, exactly as strtol() with base 0 reads it:
+   leading whitespace and a sign are skipped, a value that does not fit in a
+   long is clamped, and OUTPUT is set to what was read even when the string
+   does not end after the number. An empty string reads as 0.
+   You should store the result into the location that OUTPUT points to. The 
+   function returns 0 if the conversion proceeded without errors, or -1 if an 
+   error occurred.
+ */
+int translate_num(long int* output, const char* str, long int lower_bound, 
+    long int upper_bound) {
+    if (!str || !output) {
+        return -1;
+    }
+
+    const char* p = str;
+    while (*p == ' ' || (*p >= '\t' && *p <= '\r')) {
+      p++;
+    }
+    int negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+      p++;
+    }
+
+    unsigned base = 10;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X') && digit_value(p[2], 16) < 16) {
+      base = 16;
+      p += 2;
+    } else if (p[0] == '0') {
+      base = 8;
+    }
+
+    const char* digits = p;
+    unsigned long magnitude = 0;
+    int overflow = 0;
+    unsigned digit;
+    while ((digit = digit_value(*p, base)) < base) {
+      if (__builtin_mul_overflow(magnitude, base, &magnitude)
+          || __builtin_add_overflow(magnitude, digit, &magnitude)) {
+        overflow = 1;
+      }
+      p++;
+    }
+
+    if (p == digits) {
+      //no number at all: only the empty string is accepted
+      *output = 0;
+      return *str == '\0' ? check_num_bounds(0, lower_bound, upper_bound) : -1;
+    }
+
+    if (!negative) {
+      *output = overflow || magnitude > LONG_MAX ? LONG_MAX : (long int) magnitude;
+    } else if (overflow || magnitude >= (unsigned long) LONG_MAX + 1) {
+      *output = LONG_MIN;
+    } else {
+      *output = -(long int) magnitude;
+    }
+
+    if (*p != '\0') {
+      return -1;
+    }
+    return check_num_bounds(*output, lower_bound, upper_bound);
+}
+
+/* Register numbers of the two-character names ($t0, $sp, ...), stored plus
+   one so that 0 marks a name that is not a register. Rows are indexed by the
+   first character and columns by the second (digits first, then letters).
+ */
+#define REG_COL(c) ((c) <= '9' ? (c) - '0' : (c) - 'a' + 10)
+#define REG(a, b, num) [(a) - 'a'][REG_COL(b)] = (num) + 1
+
+static const uint8_t REG_NAMES[26][36] = {
+    REG('a', 't', 1),
+    REG('v', '0', 2),  REG('v', '1', 3),
+    REG('a', '0', 4),  REG('a', '1', 5),  REG('a', '2', 6),  REG('a', '3', 7),
+    REG('t', '0', 8),  REG('t', '1', 9),  REG('t', '2', 10), REG('t', '3', 11),
+    REG('t', '4', 12), REG('t', '5', 13), REG('t', '6', 14), REG('t', '7', 15),
+    REG('s', '0', 16), REG('s', '1', 17), REG('s', '2', 18), REG('s', '3', 19),
+    REG('s', '4', 20), REG('s', '5', 21), REG('s', '6', 22), REG('s', '7', 23),
+    REG('t', '8', 24), REG('t', '9', 25),
+    REG('k', '0', 26), REG('k', '1', 27),
+    REG('g', 'p', 28), REG('s', 'p', 29), REG('f', 'p', 30), REG('s', '8', 30),
+    REG('r', 'a', 31),
+};
+
+/* Translates the register name to the corresponding register number. Please
+   see the MIPS Green Sheet for information about register numbers.
+   Accepts $zero, every two-character name, and the numbers $0 to $31 (without
+   leading zeros).
+   Returns the register number of STR or -1 if the register name is invalid.
+ */
+int translate_reg(const char* str) {
+    if (!str || str[0] != '$') {
+        return -1;
+    }
+
+    unsigned char c1 = str[1];
+    unsigned char c2 = c1 ? str[2] : '\0';
+
+    if (c1 >= '0' && c1 <= '9') {
+        int num = c1 - '0';
+        if (c2 == '\0') return num;
+        if (num == 0 || c2 < '0' || c2 > '9' || str[3] != '\0') return -1;
+        num = num * 10 + (c2 - '0');
+        return num < 32 ? num : -1;
+    }
+
+    if (c1 >= 'a' && c1 <= 'z' && c2 != '\0' && str[3] == '\0') {
+        if (c2 >= '0' && c2 <= '9') return REG_NAMES[c1 - 'a'][c2 - '0'] - 1;
+        if (c2 >= 'a' && c2 <= 'z') return REG_NAMES[c1 - 'a'][c2 - 'a' + 10] - 1;
+        return -1;
+    }
+
+    if (strcmp(str, "$zero") == 0)      return 0;
+    else                                return -1;
+}
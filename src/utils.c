@@ -1,61 +1,106 @@
-
-#include <stdio.h>
-#include <stdarg.h>
-#include <unistd.h>
-
-static const char* output_file = NULL;
-
-int is_log_file_set() {
-    return output_file != NULL;
-}
-
-void set_log_file(const char* filename) {
-    if (filename) {
-        output_file = filename;
-        unlink(filename);
-    } else {
-        output_file = NULL;
-    }
-}
-
-void write_to_log(char* fmt, ...) {
-    va_list args;
-
-    if (output_file) {
-        FILE* f = fopen(output_file, "a");
-        if (!f) {
-            return;
-        }
-        
-        va_start(args, fmt);
-        vfprintf(f, fmt, args);
-        va_end(args);
-        fclose(f);
-    } else {
-        va_start(args, fmt);
-        vfprintf(stderr, fmt, args);
-        va_end(args);
-    }
-}
-
-void log_inst(const char* name, char** args, int num_args) {
-    if (output_file) {
-        FILE* f = fopen(output_file, "a");
-        if (!f) {
-            return;
-        }
-        
-        fprintf(f, "%s", name);
-        for (int i = 0; i < num_args; i++) {
-            fprintf(f, " %s", args[i]);
-        }
-        fprintf(f, "\n");
-        fclose(f);
-    } else {
-        fprintf(stderr, "%s", name);
-        for (int i = 0; i < num_args; i++) {
-            fprintf(stderr, " %s", args[i]);
-        }
-        fprintf(stderr, "\n");
-    }
-}
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "outbuf.h"
+#include "utils.h"
+
+/* While set, everything the thread logs goes here instead of to stderr. The
+   buffer belongs to whoever captured it, which also flushes and closes it.
+ */
+static __thread OutBuf* thread_log = NULL;
+
+/* Opens FILENAME, emptying it if it exists, and starts buffering LOG for it.
+   Returns -1 if it cannot be opened, 0 otherwise.
+ */
+int open_log_file(OutBuf* log, const char* filename) {
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    outbuf_open(log, fd);
+    return 0;
+}
+
+/* Flushes LOG and closes its file. Returns -1 if any write failed. */
+int close_log_file(OutBuf* log) {
+    int fd = log->fd;
+    int err = outbuf_close(log);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return err;
+}
+
+/* Writes everything the calling thread has logged so far to its log file. */
+void flush_log() {
+    if (thread_log) {
+        outbuf_flush(thread_log);
+    }
+}
+
+/* Sends everything the calling thread logs to BUF, or to stderr if BUF is
+   NULL. Other threads keep logging as before. Returns the buffer the thread
+   logged to until now, so that it can be restored.
+ */
+OutBuf* capture_log(OutBuf* buf) {
+    OutBuf* previous = thread_log;
+    thread_log = buf;
+    return previous;
+}
+
+void write_to_log(char* fmt, ...) {
+    va_list args;
+    OutBuf* sink = thread_log;
+
+    if (sink) {
+        char buf[512];
+        va_start(args, fmt);
+        int len = vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        if (len < 0) {
+            return;
+        }
+        if ((size_t) len < sizeof(buf)) {
+            outbuf_write(sink, buf, len);
+            return;
+        }
+
+        //too long for the stack buffer
+        char* msg = (char*) malloc(len + 1);
+        if (!msg) {
+            return;
+        }
+        va_start(args, fmt);
+        vsnprintf(msg, len + 1, fmt, args);
+        va_end(args);
+        outbuf_write(sink, msg, len);
+        free(msg);
+    } else {
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+    }
+}
+
+void log_inst(const char* name, char** args, int num_args) {
+    OutBuf* sink = thread_log;
+
+    if (sink) {
+        outbuf_puts(sink, name);
+        for (int i = 0; i < num_args; i++) {
+            outbuf_putc(sink, ' ');
+            outbuf_puts(sink, args[i]);
+        }
+        outbuf_putc(sink, '\n');
+    } else {
+        fprintf(stderr, "%s", name);
+        for (int i = 0; i < num_args; i++) {
+            fprintf(stderr, " %s", args[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
@@ -1,8 +1,13 @@
-
-int is_log_file_set();
-
-void set_log_file(const char* filename);
-
-void write_to_log(char* fmt, ...);
-
+#include "outbuf.h"
+
+int open_log_file(OutBuf* log, const char* filename);
+
+int close_log_file(OutBuf* log);
+
+void flush_log();
+
+OutBuf* capture_log(OutBuf* buf);
+
+void write_to_log(char* fmt, ...);
+
 void log_inst(const char* name, char** args, int num_args);
\ No newline at end of file
@@ -1,519 +1,2351 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-
-#include <CUnit/Basic.h>
-
-#include "src/utils.h"
-#include "src/tables.h"
-#include "src/translate_utils.h"
-#include "src/translate.h"
-
-const char* TMP_FILE = "test_output.txt";
-const int BUF_SIZE = 1024;
-
-/****************************************
- *  Helper functions 
- ****************************************/
-
-int do_nothing() {
-    return 0;
-}
-
-int init_log_file() {
-    set_log_file(TMP_FILE);
-    return 0;
-}
-
-int check_lines_equal(char **arr, int num) {
-    char buf[BUF_SIZE];
-
-    FILE *f = fopen(TMP_FILE, "r");
-    if (!f) {
-        CU_FAIL("Could not open temporary file");
-        return 0;
-    }
-    for (int i = 0; i < num; i++) {
-        if (!fgets(buf, BUF_SIZE, f)) {
-            CU_FAIL("Reached end of file");
-            return 0;
-        }
-        CU_ASSERT(!strncmp(buf, arr[i], strlen(arr[i])));
-    }
-    fclose(f);
-    return 0;
-}
-
-/****************************************
- *  Test cases for translate_utils.c 
- ****************************************/
-
-void test_translate_reg() {
-    CU_ASSERT_EQUAL(translate_reg("$0"), 0);
-    CU_ASSERT_EQUAL(translate_reg("$at"), 1);
-    CU_ASSERT_EQUAL(translate_reg("$v0"), 2);
-    CU_ASSERT_EQUAL(translate_reg("$a0"), 4);
-    CU_ASSERT_EQUAL(translate_reg("$a1"), 5);
-    CU_ASSERT_EQUAL(translate_reg("$a2"), 6);
-    CU_ASSERT_EQUAL(translate_reg("$a3"), 7);
-    CU_ASSERT_EQUAL(translate_reg("$t0"), 8);
-    CU_ASSERT_EQUAL(translate_reg("$t1"), 9);
-    CU_ASSERT_EQUAL(translate_reg("$t2"), 10);
-    CU_ASSERT_EQUAL(translate_reg("$t3"), 11);
-    CU_ASSERT_EQUAL(translate_reg("$s0"), 16);
-    CU_ASSERT_EQUAL(translate_reg("$s1"), 17);
-    CU_ASSERT_EQUAL(translate_reg("$3"), -1);
-    CU_ASSERT_EQUAL(translate_reg("asdf"), -1);
-    CU_ASSERT_EQUAL(translate_reg("hey there"), -1);
-}
-
-void test_translate_num() {
-    long int output;
-    CU_ASSERT_EQUAL(translate_num(&output, "-6000", -2147483648, 4294967295), 0);
-    CU_ASSERT_EQUAL(output, -6000);
-    CU_ASSERT_EQUAL(translate_num(&output, "35", -1000, 1000), 0);
-    CU_ASSERT_EQUAL(output, 35);
-    CU_ASSERT_EQUAL(translate_num(&output, "145634236", 0, 9000000000), 0);
-    CU_ASSERT_EQUAL(output, 145634236);
-    CU_ASSERT_EQUAL(translate_num(&output, "0xC0FFEE", -9000000000, 9000000000), 0);
-    CU_ASSERT_EQUAL(output, 12648430);
-    CU_ASSERT_EQUAL(translate_num(&output, "72", -16, 72), 0);
-    CU_ASSERT_EQUAL(output, 72);
-    CU_ASSERT_EQUAL(translate_num(&output, "72", -16, 71), -1);
-    CU_ASSERT_EQUAL(translate_num(&output, "72", 72, 150), 0);
-    CU_ASSERT_EQUAL(output, 72);
-    CU_ASSERT_EQUAL(translate_num(&output, "72", 73, 150), -1);
-    CU_ASSERT_EQUAL(translate_num(&output, "35x", -100, 100), -1);
-    CU_ASSERT_EQUAL(translate_num(&output, "-10", -15, 5), 0);
-    CU_ASSERT_EQUAL(output, -10);
-    CU_ASSERT_EQUAL(translate_num(&output, "-125", -125, -125), 0);
-    CU_ASSERT_EQUAL(output, -125);
-    CU_ASSERT_EQUAL(translate_num(&output, "-125", -123, -123), -1);
-
-}
-
-/****************************************
- *  Test cases for tables.c 
- ****************************************/
-
-void test_table_1() {
-    int retval;
-
-    SymbolTable* tbl = create_table(SYMTBL_UNIQUE_NAME);
-    CU_ASSERT_PTR_NOT_NULL(tbl);
-
-    retval = add_to_table(tbl, "abc", 8);
-    CU_ASSERT_EQUAL(retval, 0);
-    retval = add_to_table(tbl, "efg", 12);
-    CU_ASSERT_EQUAL(retval, 0);
-    retval = add_to_table(tbl, "q45", 16);
-    CU_ASSERT_EQUAL(retval, 0);
-    retval = add_to_table(tbl, "q45", 24); 
-    CU_ASSERT_EQUAL(retval, -1); 
-    retval = add_to_table(tbl, "bob", 14); 
-    CU_ASSERT_EQUAL(retval, -1); 
-
-    retval = get_addr_for_symbol(tbl, "abc");
-    CU_ASSERT_EQUAL(retval, 8); 
-    retval = get_addr_for_symbol(tbl, "q45");
-    CU_ASSERT_EQUAL(retval, 16); 
-    retval = get_addr_for_symbol(tbl, "ef");
-    CU_ASSERT_EQUAL(retval, -1); 
-    
-    free_table(tbl);
-    
-
-    char* arr[] = { "Error: name 'q45' already exists in table.",
-                    "Error: address is not a multiple of 4." };
-    check_lines_equal(arr, 2);
-
-    SymbolTable* tbl2 = create_table(SYMTBL_NON_UNIQUE);
-    CU_ASSERT_PTR_NOT_NULL(tbl2);
-
-    retval = add_to_table(tbl2, "q45", 16);
-    CU_ASSERT_EQUAL(retval, 0);
-    retval = add_to_table(tbl2, "q45", 24); 
-    CU_ASSERT_EQUAL(retval, 0);
-
-    free_table(tbl2);
-}
-
-void test_table_2() {
-    int retval, max = 100;
-
-    SymbolTable* tbl = create_table(SYMTBL_UNIQUE_NAME);
-    CU_ASSERT_PTR_NOT_NULL(tbl);
-
-    char buf[10];
-    for (int i = 0; i < max; i++) {
-        sprintf(buf, "%d", i);
-        retval = add_to_table(tbl, buf, 4 * i);
-        CU_ASSERT_EQUAL(retval, 0);
-    }
-
-    for (int i = 0; i < max; i++) {
-        sprintf(buf, "%d", i);
-        retval = get_addr_for_symbol(tbl, buf);
-        CU_ASSERT_EQUAL(retval, 4 * i);
-    }
-
-    free_table(tbl);
-}
-
-
-/****************************************
- * Test for step 3
- ****************************************/
-
-void test_translate_inst() {
-    int retval;
-
-    // create args
-    char *args[3]; // array of pointers to char arrays
-    char functReg3[4] = "$a1"; // array of char
-    args[0] = functReg3; // set first element of bad array to $s0
-    char functReg[4] = "$a1";
-    args[1] = functReg;
-    char functReg2[4] = "$a0";
-    args[2] = functReg2;
-
-    uint32_t addr = 0;
-
-    // create symtbl & reltbl
-    SymbolTable* symtbl = create_table(0);
-    SymbolTable* reltbl = create_table(0);
-
-
-    // TEST WRITE_RTYPE, valid args, return 0
-    FILE* testrtype = fopen("testrtype.txt", "w");
-    const char *rtype = "addu"; //create good name
-    retval = translate_inst(testrtype, rtype, args, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(testrtype);
-
-
-
-
-    // TEST WRITE_SHIFT
-    char *testshift[3]; // array of pointers to char arrays
-    char shiftReg3[4] = "$a1"; // array of char
-    testshift[0] = shiftReg3; // set first element of bad array to $s0
-    char shiftReg[4] = "$a1";
-    testshift[1] = shiftReg;
-    char shiftReg2[2] = "1";
-    testshift[2] = shiftReg2;
-    const char *shift = "sll"; //create good name
-
-    // test write_shift, valid args, return 0
-    FILE* goodshift = fopen("goodshift.txt", "w");
-    retval = translate_inst(goodshift, shift, testshift, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(goodshift);
-
-    // test write_shift, invalid shiftamt, return -1
-    char newshiftReg2[2] = "32";
-    testshift[2] = newshiftReg2;
-    FILE* badshift = fopen("badshift.txt", "w");
-    retval = translate_inst(badshift, shift, testshift, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, -1);
-    fclose(badshift);
-
-
-
-    // TEST WRITE_JR
-    char *testjr[1]; // array of pointers to char arrays
-    char jrReg[4] = "$a1"; // array of char
-    testjr[0] = jrReg; // set first element of bad array to $s0
-    const char *jr = "jr"; //create good name
-    FILE* goodjr = fopen("goodjr.txt", "w");
-    retval = translate_inst(goodjr, jr, testjr, 1, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(goodjr);
-
-
-
-    // TEST WRITE_ADDIU & WRITE_ITYPE & WRITE_ORI
-    char *testaddiu[3]; // array of pointers to char arrays
-    char addiuReg[4] = "$a1"; // array of char
-    testaddiu[0] = addiuReg; // set first element of bad array to $s0
-    char addiuReg2[4] = "$a1";
-    testaddiu[1] = addiuReg2;
-    char addiuReg3[6] = "10000";
-    testaddiu[2] = addiuReg3;
-
-    // addiu
-    const char *addiu = "addiu"; //create good name
-    FILE* goodaddiu = fopen("goodaddiu.txt", "w");
-    retval = translate_inst(goodaddiu, addiu, testaddiu, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(goodaddiu);
-
-    // itype
-    // const char *lb = "lb"; //create good name
-    // FILE* goodlb = fopen("goodlb.txt", "w");
-    // retval = translate_inst(goodlb, lb, testaddiu, 3, addr, symtbl, reltbl);
-    // CU_ASSERT_EQUAL(retval, 0);
-    // fclose(goodlb);
-
-    // ori
-    const char *ori = "ori"; //create good name
-    FILE* goodori = fopen("goodori.txt", "w");
-    retval = translate_inst(goodori, ori, testaddiu, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(goodori);
-
-    char addiuReg4[6] = "32768";
-    testaddiu[2] = addiuReg4;
-
-    //test bad itype (overflow)
-    const char *lbu = "lbu"; //create good name
-    FILE* goodlbu = fopen("goodlbu.txt", "w");
-    retval = translate_inst(goodlbu, lbu, testaddiu, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, -1);
-    fclose(goodlbu);
-
-
-    // TEST WRITE_LUI
-    char *testlui[2]; // array of pointers to char arrays
-    char luireg[4] = "$a1"; // array of char
-    testlui[0] = luireg; // set first element of bad array to $s0
-    char luireg2[4] = "-11"; // array of char                      
-    testlui[1] = luireg2; // set first element of bad array to $s0
-    const char *lui = "lui"; //create good name
-    FILE* goodlui = fopen("goodlui.txt", "w");
-    retval = translate_inst(goodlui, lui, testlui, 2, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(goodlui);
-
-
-
-    // TEST WRITE_MEM
-    char *testmem[2]; // array of pointers to char arrays
-    char memreg[4] = "$a1"; // array of char
-    testmem[0] = memreg; // set first element of bad array to $s0
-    char memreg2[3] = "11"; // array of char
-    testmem[1] = memreg2; // set first element of bad array to $s0
-    char memreg3[4] = "$a1"; // array of char
-    testmem[2] = memreg3; // set first element of bad array to $s0
-    const char *sb = "sb"; //create good name
-    FILE* goodmem = fopen("goodmem.txt", "w");
-    retval = translate_inst(goodmem, sb, testmem, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-    fclose(goodmem);
-
-
-    // TEST WRITE_BRANCH
-    /*const char *beq = "beq"; //create good name 
-    char *testbeq[3]; // array of pointers to char arrays                       
-    char beqreg[4] = "$a0"; // array of char
-    testbeq[0] = beqreg; // set first element of bad array to $s0
-    char beqreg2[4] = "$a1";
-    testbeq[1] = beqreg2;
-    char beqreg3[6] = "10000";
-    testbeq[2] = beqreg3;
-
-    FILE* goodbeq = fopen("goodbeq.txt", "w");
-    retval = translate_inst(goodbeq, beq, testbeq, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0); 
-    
-    retval = get_addr_for_symbol(symtbl, beq);
-    CU_ASSERT_EQUAL(retval, 0);              
-    fclose(goodbeq); */
-
-
-    // TEST WRITE_JUMP 
-    /*const char *jal = "jal"; //create good name
-    char *testjump[1]; // array of pointers to char arrays
-    char jumpreg[4] = "$ra"; // array of char
-    testjump[0] = jumpreg; // set first element of bad array to $s0
-
-    FILE* goodjal = fopen("goodjal.txt", "w");
-    retval = translate_inst(goodjal, jal, testjump, 1, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, 0);
-
-    retval = get_addr_for_symbol(reltbl, jal);
-    CU_ASSERT_EQUAL(retval, 0);               
-    fclose(goodjal);*/
-
-
-
-    // TEST BAD REGISTER; should return -1
-    FILE* regs = fopen("regs.txt", "w");
-    char *testReg[3]; // array of pointers to char arrays
-    char badReg[5] = "$100"; // array of char
-    testReg[0] = badReg; // set first element of bad array to $s0
-    char goodReg[4] = "$a1";
-    testReg[1] = goodReg;
-    char goodReg2[4] = "$a0";
-    testReg[2] = goodReg2;
-    retval = translate_inst(regs, shift, testReg, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, -1);
-    fclose(regs);
-
-    // TEST BAD NAME, return -1
-    FILE* bad = fopen("bad.txt", "w");
-    const char *badargname = "auuu"; //create bad name
-    retval = translate_inst(bad, badargname, args, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, -1);
-    fclose(bad);
-
-    // TEST BAD ARG ARRAY, return -1
-    FILE* badargsfile = fopen("badargsfile.txt", "w");
-    char *badArray[1]; // array of pointers to char arrays
-    char badArg[4] = "$s0"; // array of char
-    badArray[0] = badArg; // set first element of bad array to $s0
-    retval = translate_inst(badargsfile, rtype, badArray, 3, addr, symtbl, reltbl);
-    CU_ASSERT_EQUAL(retval, -1);
-    fclose(badargsfile);
-
-}
-
-
-/****************************************
- * Test for step 4
- ****************************************/
-
-void test_li_expansion() {
-    int retval;
-    char li[]  = "li";
-
-    //error case: wrong num of args
-    FILE* asdf = fopen("asdf.txt", "w");
-    CU_ASSERT_PTR_NOT_NULL(asdf);
-    char *badArray[1];
-    char badArg[4] = "$s0";
-    badArray[0] = badArg;
-    retval = write_pass_one(asdf, li, badArray, 1);
-    fclose(asdf);
-    CU_ASSERT_EQUAL(retval, 0);
-
-    //correct case: addiu
-    FILE* asdf1 = fopen("asdf1.txt", "w");
-    CU_ASSERT_PTR_NOT_NULL(asdf1);
-    //create an array of pointers to strings
-    char *array[2];
-    char arg1[4] = "$t0";
-    char arg2[6] = "65535";
-    array[0] = arg1;
-    array[1] = arg2;
-    retval = write_pass_one(asdf1, li, array, 2);
-    fclose(asdf1);
-    CU_ASSERT_EQUAL(retval, 1);
-
-    //correct case: lui ori
-    FILE* asdf2 = fopen("asdf2.txt", "w");
-    CU_ASSERT_PTR_NOT_NULL(asdf2);
-    char *array2[2];
-    char arg3[4] = "$t0";
-    char arg4[8] = "0x3BF20";
-    array2[0] = arg3;
-    array2[1] = arg4;
-    retval = write_pass_one(asdf2, li, array2, 2);
-    fclose(asdf2);
-    CU_ASSERT_EQUAL(retval, 2);
-
-    //correct case: deadbeef
-    FILE* asdf3 = fopen("asdf3.txt", "w");
-    CU_ASSERT_PTR_NOT_NULL(asdf3);
-    char *array3[2];
-    char arg5[4] = "$t0";
-    char arg6[11] = "0xDEADBEEF";
-    array3[0] = arg5;
-    array3[1] = arg6;
-    retval = write_pass_one(asdf3, li, array3, 2);
-    fclose(asdf3);
-    CU_ASSERT_EQUAL(retval, 2); 
-}
-
-void test_blt_expansion() {
-  int retval;
-  char blt[] = "blt";
-
-  //incorrect case: not enough arguments
-  FILE* asdf = fopen("asdf.txt", "w");
-  CU_ASSERT_PTR_NOT_NULL(asdf);
-  char *array[3];
-  char arg1[4] = "$8";
-  char arg2[4] = "$9";
-  array[0] = arg1;
-  array[1] = arg2;
-  array[2] = NULL;
-  retval = write_pass_one(asdf, blt, array, 1);
-  fclose(asdf);
-  CU_ASSERT_EQUAL(retval, 0);
-
-  //correct case
-  FILE* asdf2= fopen("asdf2.txt", "w");
-  CU_ASSERT_PTR_NOT_NULL(asdf2);
-  char *array2[3];
-  char arg3[4] = "$8";
-  char arg4[4] = "$9";
-  char arg5[10] = "label";
-  array2[0] = arg3;
-  array2[1] = arg4;
-  array2[2] = arg5;
-
-  retval = write_pass_one(asdf2, blt, array2, 3); 
-  fclose(asdf2);
-  CU_ASSERT_EQUAL(retval, 2);
-}
-
-int main(int argc, char** argv) {
-    CU_pSuite pSuite1 = NULL, pSuite2 = NULL, pSuite3 = NULL, pSuite4 = NULL;
-
-    if (CUE_SUCCESS != CU_initialize_registry()) {
-        return CU_get_error();
-    }
-
-    /* Suite 1 */
-    pSuite1 = CU_add_suite("Testing translate_utils.c", NULL, NULL);
-    if (!pSuite1) {
-        goto exit;
-    }
-    if (!CU_add_test(pSuite1, "test_translate_reg", test_translate_reg)) {
-        goto exit;
-    }
-    if (!CU_add_test(pSuite1, "test_translate_num", test_translate_num)) {
-        goto exit;
-    }
-
-    /* Suite 2 */
-    pSuite2 = CU_add_suite("Testing tables.c", init_log_file, NULL);
-    if (!pSuite2) {
-        goto exit;
-    }
-    if (!CU_add_test(pSuite2, "test_table_1", test_table_1)) {
-        goto exit;
-    }
-    if (!CU_add_test(pSuite2, "test_table_2", test_table_2)) {
-        goto exit;
-    }
-
-    /* Suite 3 */
-    pSuite3 = CU_add_suite("Testing li and blt expansion", NULL, NULL);
-    if (!pSuite3) {
-      goto exit;
-    }
-    if (!CU_add_test(pSuite3, "test_li_expansion", test_li_expansion)) {
-        goto exit;
-    }   
-    if (!CU_add_test(pSuite3, "test_blt_expansion", test_blt_expansion)) {
-        goto exit;
-    }
-
-    /* Suite 4 */
-    pSuite4 = CU_add_suite("Testing step 3", NULL, NULL);
-    if (!pSuite4) {
-      goto exit;
-    }
-    if (!CU_add_test(pSuite4, "test_translate_inst", test_translate_inst)) {
-        goto exit;
-    }   
-
-    CU_basic_set_mode(CU_BRM_VERBOSE);
-    CU_basic_run_tests();
-
-exit:
-    CU_cleanup_registry();
-    return CU_get_error();;
-}
+#include <ctype.h>
+#include <elf.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <CUnit/Basic.h>
+
+#include "src/utils.h"
+#include "src/tables.h"
+#include "src/mnemonics.h"
+#include "src/translate_utils.h"
+#include "src/reader.h"
+#include "src/translate.h"
+#include "src/pool.h"
+#include "src/state.h"
+#include "src/object.h"
+#include "src/stats.h"
+#include "src/sim.h"
+#include "src/trace.h"
+#include "assembler.h"
+#include "mipsasm.h"
+#include "server.h"
+
+const char* TMP_FILE = "test_output.txt";
+const int BUF_SIZE = 1024;
+
+/****************************************
+ *  Helper functions 
+ ****************************************/
+
+int do_nothing() {
+    return 0;
+}
+
+static OutBuf test_log;
+
+int init_log_file() {
+    if (open_log_file(&test_log, TMP_FILE) != 0) {
+        return -1;
+    }
+    capture_log(&test_log);
+    return 0;
+}
+
+int close_log() {
+    capture_log(NULL);
+    return close_log_file(&test_log);
+}
+
+int check_lines_equal(char **arr, int num) {
+    char buf[BUF_SIZE];
+
+    flush_log();
+    FILE *f = fopen(TMP_FILE, "r");
+    if (!f) {
+        CU_FAIL("Could not open temporary file");
+        return 0;
+    }
+    for (int i = 0; i < num; i++) {
+        if (!fgets(buf, BUF_SIZE, f)) {
+            CU_FAIL("Reached end of file");
+            return 0;
+        }
+        CU_ASSERT(!strncmp(buf, arr[i], strlen(arr[i])));
+    }
+    fclose(f);
+    return 0;
+}
+
+/****************************************
+ *  Test cases for translate_utils.c 
+ ****************************************/
+
+void test_translate_reg() {
+    CU_ASSERT_EQUAL(translate_reg("$0"), 0);
+    CU_ASSERT_EQUAL(translate_reg("$at"), 1);
+    CU_ASSERT_EQUAL(translate_reg("$v0"), 2);
+    CU_ASSERT_EQUAL(translate_reg("$a0"), 4);
+    CU_ASSERT_EQUAL(translate_reg("$a1"), 5);
+    CU_ASSERT_EQUAL(translate_reg("$a2"), 6);
+    CU_ASSERT_EQUAL(translate_reg("$a3"), 7);
+    CU_ASSERT_EQUAL(translate_reg("$t0"), 8);
+    CU_ASSERT_EQUAL(translate_reg("$t1"), 9);
+    CU_ASSERT_EQUAL(translate_reg("$t2"), 10);
+    CU_ASSERT_EQUAL(translate_reg("$t3"), 11);
+    CU_ASSERT_EQUAL(translate_reg("$s0"), 16);
+    CU_ASSERT_EQUAL(translate_reg("$s1"), 17);
+    CU_ASSERT_EQUAL(translate_reg("$zero"), 0);
+    CU_ASSERT_EQUAL(translate_reg("$v1"), 3);
+    CU_ASSERT_EQUAL(translate_reg("$t4"), 12);
+    CU_ASSERT_EQUAL(translate_reg("$t7"), 15);
+    CU_ASSERT_EQUAL(translate_reg("$s4"), 20);
+    CU_ASSERT_EQUAL(translate_reg("$s7"), 23);
+    CU_ASSERT_EQUAL(translate_reg("$t8"), 24);
+    CU_ASSERT_EQUAL(translate_reg("$t9"), 25);
+    CU_ASSERT_EQUAL(translate_reg("$k0"), 26);
+    CU_ASSERT_EQUAL(translate_reg("$k1"), 27);
+    CU_ASSERT_EQUAL(translate_reg("$gp"), 28);
+    CU_ASSERT_EQUAL(translate_reg("$sp"), 29);
+    CU_ASSERT_EQUAL(translate_reg("$fp"), 30);
+    CU_ASSERT_EQUAL(translate_reg("$ra"), 31);
+    CU_ASSERT_EQUAL(translate_reg("$3"), 3);
+    CU_ASSERT_EQUAL(translate_reg("$10"), 10);
+    CU_ASSERT_EQUAL(translate_reg("$31"), 31);
+    CU_ASSERT_EQUAL(translate_reg("$32"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$03"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$100"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$t10"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$x0"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$t"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$T0"), -1);
+    CU_ASSERT_EQUAL(translate_reg("t0"), -1);
+    CU_ASSERT_EQUAL(translate_reg("$zer"), -1);
+    CU_ASSERT_EQUAL(translate_reg("asdf"), -1);
+    CU_ASSERT_EQUAL(translate_reg("hey there"), -1);
+}
+
+void test_translate_num() {
+    long int output;
+    CU_ASSERT_EQUAL(translate_num(&output, "-6000", -2147483648, 4294967295), 0);
+    CU_ASSERT_EQUAL(output, -6000);
+    CU_ASSERT_EQUAL(translate_num(&output, "35", -1000, 1000), 0);
+    CU_ASSERT_EQUAL(output, 35);
+    CU_ASSERT_EQUAL(translate_num(&output, "145634236", 0, 9000000000), 0);
+    CU_ASSERT_EQUAL(output, 145634236);
+    CU_ASSERT_EQUAL(translate_num(&output, "0xC0FFEE", -9000000000, 9000000000), 0);
+    CU_ASSERT_EQUAL(output, 12648430);
+    CU_ASSERT_EQUAL(translate_num(&output, "72", -16, 72), 0);
+    CU_ASSERT_EQUAL(output, 72);
+    CU_ASSERT_EQUAL(translate_num(&output, "72", -16, 71), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "72", 72, 150), 0);
+    CU_ASSERT_EQUAL(output, 72);
+    CU_ASSERT_EQUAL(translate_num(&output, "72", 73, 150), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "35x", -100, 100), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "-10", -15, 5), 0);
+    CU_ASSERT_EQUAL(output, -10);
+    CU_ASSERT_EQUAL(translate_num(&output, "-125", -125, -125), 0);
+    CU_ASSERT_EQUAL(output, -125);
+    CU_ASSERT_EQUAL(translate_num(&output, "-125", -123, -123), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "010", -100, 100), 0);
+    CU_ASSERT_EQUAL(output, 8);
+    CU_ASSERT_EQUAL(translate_num(&output, "09", -100, 100), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "-0x10", -100, 100), 0);
+    CU_ASSERT_EQUAL(output, -16);
+    CU_ASSERT_EQUAL(translate_num(&output, " +7", -100, 100), 0);
+    CU_ASSERT_EQUAL(output, 7);
+    CU_ASSERT_EQUAL(translate_num(&output, "7 ", -100, 100), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "0x", -100, 100), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "-", -100, 100), -1);
+    CU_ASSERT_EQUAL(translate_num(&output, "", -100, 100), 0);
+    CU_ASSERT_EQUAL(output, 0);
+    CU_ASSERT_EQUAL(translate_num(&output, "99999999999999999999", -100, 100), -1);
+    CU_ASSERT_EQUAL(output, LONG_MAX);
+    CU_ASSERT_EQUAL(check_num_bounds(65536, -32768, 65536), 0);
+    CU_ASSERT_EQUAL(check_num_bounds(-32769, -32768, 65536), -1);
+}
+
+void test_reader() {
+    FILE* f = tmpfile();
+    fputs("label: addiu $t0,$t1,4 # c\r\n\nlw $t0 8($sp)", f);
+    rewind(f);
+
+    SourceReader reader;
+    CU_ASSERT_EQUAL(reader_open(&reader, f), 0);
+
+    Slice line, tok;
+    CU_ASSERT_EQUAL(reader_next_line(&reader, &line), 1);
+    CU_ASSERT_EQUAL(line.len, 27);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT(tok.len == 6 && memcmp(tok.ptr, "label:", 6) == 0);
+    CU_ASSERT(is_valid_label_n(tok.ptr, tok.len - 1));
+    CU_ASSERT_FALSE(is_valid_label_n(tok.ptr, tok.len));
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT(tok.len == 5 && memcmp(tok.ptr, "addiu", 5) == 0);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT(tok.len == 1 && tok.ptr[0] == '4');
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 0);
+
+    CU_ASSERT_EQUAL(reader_next_line(&reader, &line), 1);
+    CU_ASSERT_EQUAL(line.len, 0);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 0);
+
+    // the last line has no newline
+    CU_ASSERT_EQUAL(reader_next_line(&reader, &line), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT(tok.len == 1 && tok.ptr[0] == '8');
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 1);
+    CU_ASSERT(tok.len == 3 && memcmp(tok.ptr, "$sp", 3) == 0);
+    CU_ASSERT_EQUAL(next_token(&line, &tok), 0);
+    CU_ASSERT_EQUAL(reader_next_line(&reader, &line), 0);
+
+    reader_close(&reader);
+    fclose(f);
+}
+
+void test_write_inst_hex_n() {
+    uint32_t words[11] = { 0x00000000, 0xffffffff, 0x12345678, 0x9abcdef0, 0x0000000f,
+        0xf0000000, 0x01020304, 0xa0b0c0d0, 0x8d090004, 0x3c011234, 0x00851020 };
+    HexLevel best = get_hex_level();
+
+    for (int level = HEX_SCALAR; level <= HEX_AVX2; level++) {
+        if (set_hex_level(level) != 0) continue;
+
+        OutBuf one, many;
+        outbuf_open_memory(&one);
+        outbuf_open_memory(&many);
+        for (int n = 0; n <= 11; n++) {
+            for (int i = 0; i < n; i++) {
+                write_inst_hex(&one, words[i]);
+            }
+            write_inst_hex_n(&many, words, n);
+        }
+        CU_ASSERT_EQUAL(one.len, many.len);
+        CU_ASSERT(memcmp(one.data, many.data, one.len) == 0);
+        CU_ASSERT(memcmp(many.data, "00000000\n00000000\nffffffff\n", 27) == 0);
+        outbuf_close(&one);
+        outbuf_close(&many);
+    }
+    set_hex_level(best);
+}
+
+void test_outbuf() {
+    OutBuf buf;
+    outbuf_open_memory(&buf);
+    outbuf_write(&buf, "addu", 4);
+    outbuf_write(&buf, "ignored", 0);
+    outbuf_putc(&buf, ' ');
+    outbuf_puts(&buf, "$t0");
+    outbuf_putc(&buf, '\n');
+    CU_ASSERT_EQUAL(buf.len, 9);
+    CU_ASSERT(memcmp(buf.data, "addu $t0\n", 9) == 0);
+    CU_ASSERT_EQUAL(outbuf_flush(&buf), 0);
+    CU_ASSERT_EQUAL(buf.len, 9);        // memory buffers keep their contents
+    outbuf_close(&buf);
+
+    // the formatters agree with printf()
+    uint32_t values[] = { 0, 7, 10, 0xf, 0x10, 99999, 1234567890, 0x7fffffff, 0x80000000,
+        0xdeadbeef, 0xffffffff };
+    char expected[32];
+    outbuf_open_memory(&buf);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        buf.len = 0;
+        outbuf_hex32(&buf, values[i]);
+        sprintf(expected, "%08x", values[i]);
+        CU_ASSERT(buf.len == 8 && memcmp(buf.data, expected, 8) == 0);
+
+        buf.len = 0;
+        outbuf_dec32(&buf, values[i]);
+        int n = sprintf(expected, "%u", values[i]);
+        CU_ASSERT(buf.len == (size_t) n && memcmp(buf.data, expected, n) == 0);
+    }
+
+    // memory buffers grow past their first allocation
+    buf.len = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        outbuf_hex32(&buf, i);
+        outbuf_putc(&buf, '\n');
+    }
+    CU_ASSERT_EQUAL(buf.len, 9000);
+    CU_ASSERT(memcmp(buf.data + 9 * 999, "000003e7\n", 9) == 0);
+    outbuf_close(&buf);
+
+    HexLevel best = get_hex_level();
+    for (int level = HEX_SCALAR; level <= HEX_AVX2; level++) {
+        if (set_hex_level(level) != 0) continue;
+        outbuf_open_memory(&buf);
+        outbuf_hex32_lines(&buf, values, sizeof(values) / sizeof(values[0]));
+        CU_ASSERT_EQUAL(buf.len, 9 * sizeof(values) / sizeof(values[0]));
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            sprintf(expected, "%08x\n", values[i]);
+            CU_ASSERT(memcmp(buf.data + 9 * i, expected, 9) == 0);
+        }
+        outbuf_close(&buf);
+    }
+    set_hex_level(best);
+
+    // a file buffer writes out what stdio already had, then its own output
+    FILE* f = tmpfile();
+    fputs("li $t0 1\n", f);
+    outbuf_open_file(&buf, f);
+    outbuf_puts(&buf, "addiu $t0 $0 1\n");
+    CU_ASSERT_EQUAL(outbuf_flush(&buf), 0);
+    CU_ASSERT_EQUAL(buf.len, 0);
+    char* big = (char*) malloc(OUTBUF_SIZE + 1);
+    memset(big, 'x', OUTBUF_SIZE + 1);
+    outbuf_putc(&buf, '[');
+    outbuf_write(&buf, big, OUTBUF_SIZE + 1);     // written around the buffer
+    outbuf_putc(&buf, ']');
+    CU_ASSERT_EQUAL(outbuf_close(&buf), 0);
+    CU_ASSERT(buf.data == NULL);
+
+    char* text = (char*) malloc(OUTBUF_SIZE + 64);
+    rewind(f);
+    size_t len = fread(text, 1, OUTBUF_SIZE + 64, f);
+    CU_ASSERT_EQUAL(len, 9 + 15 + OUTBUF_SIZE + 3);
+    CU_ASSERT(memcmp(text, "li $t0 1\naddiu $t0 $0 1\n[x", 26) == 0);
+    CU_ASSERT(memcmp(text + len - 2, "x]", 2) == 0);
+    fclose(f);
+    free(text);
+    free(big);
+
+    // a failed write is reported, and everything after it is dropped
+    f = fopen("/dev/null", "r");
+    outbuf_open_file(&buf, f);
+    outbuf_puts(&buf, "jr $ra\n");
+    CU_ASSERT_EQUAL(outbuf_flush(&buf), -1);
+    outbuf_puts(&buf, "jr $ra\n");
+    CU_ASSERT_EQUAL(outbuf_close(&buf), -1);
+    fclose(f);
+}
+
+/* Checks scan_tokens() against next_token() on LINE. */
+static void check_scan_tokens(const char* str) {
+    Slice line = { str, strlen(str) };
+    Slice toks[16], rest = line, tok;
+    uint32_t colons;
+    int n = scan_tokens(line, NULL, toks, 16, &colons);
+
+    const char* comment = memchr(str, '#', line.len);
+    if (comment) rest.len = comment - str;
+    for (int i = 0; i < n; i++) {
+        CU_ASSERT_EQUAL(next_token(&rest, &tok), 1);
+        CU_ASSERT(toks[i].ptr == tok.ptr && toks[i].len == tok.len);
+        CU_ASSERT_EQUAL((colons >> i) & 1, tok.ptr[tok.len - 1] == ':');
+    }
+    CU_ASSERT_EQUAL(next_token(&rest, &tok), 0);
+}
+
+void test_scan_tokens() {
+    ClassifyLevel best = get_classify_level();
+
+    for (int level = CLASSIFY_SCALAR; level <= CLASSIFY_AVX2; level++) {
+        if (set_classify_level(level) != 0) continue;
+
+        CharMasks masks;
+        classify_chars("a:\t#,(b)\n", 9, &masks);
+        CU_ASSERT_EQUAL(masks.newline, 0x100);
+        CU_ASSERT_EQUAL(masks.comment, 0x8);
+        CU_ASSERT_EQUAL(masks.delim, 0x1b4);
+        CU_ASSERT_EQUAL(masks.colon, 0x2);
+
+        check_scan_tokens("");
+        check_scan_tokens("label: addiu $t0,$t1,4 # c\r");
+        check_scan_tokens("  lw $t0 8($sp)");
+        check_scan_tokens("#addu $t0 $t1 $t2");
+        check_scan_tokens("a: b: c:");
+        // tokens that cross the 64-byte blocks
+        check_scan_tokens("a_label_that_is_long_enough_to_cross_the_first_block_boundary: j x");
+        check_scan_tokens("addu $t0, $t1, $t2                                             :x, y");
+        check_scan_tokens("123456789012345678901234567890123456789012345678901234567890123: "
+            "another_token_to_end_exactly_at_the_second_block_boundary_here:");
+
+        Slice toks[2];
+        uint32_t colons;
+        Slice line = { "a b c d", 7 };
+        CU_ASSERT_EQUAL(scan_tokens(line, NULL, toks, 2, &colons), 2);
+        CU_ASSERT(toks[1].len == 1 && toks[1].ptr[0] == 'b');
+    }
+    set_classify_level(best);
+}
+
+/****************************************
+ *  Test cases for tables.c 
+ ****************************************/
+
+void test_table_1() {
+    int retval;
+
+    SymbolTable* tbl = create_table(SYMTBL_UNIQUE_NAME);
+    CU_ASSERT_PTR_NOT_NULL(tbl);
+
+    retval = add_to_table(tbl, "abc", 8);
+    CU_ASSERT_EQUAL(retval, 0);
+    retval = add_to_table(tbl, "efg", 12);
+    CU_ASSERT_EQUAL(retval, 0);
+    retval = add_to_table(tbl, "q45", 16);
+    CU_ASSERT_EQUAL(retval, 0);
+    retval = add_to_table(tbl, "q45", 24); 
+    CU_ASSERT_EQUAL(retval, -1); 
+    retval = add_to_table(tbl, "bob", 14); 
+    CU_ASSERT_EQUAL(retval, -1); 
+
+    retval = get_addr_for_symbol(tbl, "abc");
+    CU_ASSERT_EQUAL(retval, 8); 
+    retval = get_addr_for_symbol(tbl, "q45");
+    CU_ASSERT_EQUAL(retval, 16); 
+    retval = get_addr_for_symbol(tbl, "ef");
+    CU_ASSERT_EQUAL(retval, -1); 
+    
+    free_table(tbl);
+    
+
+    char* arr[] = { "Error: name 'q45' already exists in table.",
+                    "Error: address is not a multiple of 4." };
+    check_lines_equal(arr, 2);
+
+    SymbolTable* tbl2 = create_table(SYMTBL_NON_UNIQUE);
+    CU_ASSERT_PTR_NOT_NULL(tbl2);
+
+    retval = add_to_table(tbl2, "q45", 16);
+    CU_ASSERT_EQUAL(retval, 0);
+    retval = add_to_table(tbl2, "q45", 24); 
+    CU_ASSERT_EQUAL(retval, 0);
+
+    free_table(tbl2);
+}
+
+void test_table_2() {
+    int retval, max = 100;
+
+    SymbolTable* tbl = create_table(SYMTBL_UNIQUE_NAME);
+    CU_ASSERT_PTR_NOT_NULL(tbl);
+
+    char buf[10];
+    for (int i = 0; i < max; i++) {
+        sprintf(buf, "%d", i);
+        retval = add_to_table(tbl, buf, 4 * i);
+        CU_ASSERT_EQUAL(retval, 0);
+    }
+
+    for (int i = 0; i < max; i++) {
+        sprintf(buf, "%d", i);
+        retval = get_addr_for_symbol(tbl, buf);
+        CU_ASSERT_EQUAL(retval, 4 * i);
+    }
+
+    free_table(tbl);
+}
+
+void test_table_3() {
+    int retval, max = 5000;
+
+    SymbolTable* tbl = create_table(SYMTBL_NON_UNIQUE);
+    CU_ASSERT_PTR_NOT_NULL(tbl);
+
+    char buf[16];
+    for (int i = 0; i < max; i++) {
+        sprintf(buf, "L%d", i % 1000);
+        retval = add_to_table(tbl, buf, 4 * i);
+        CU_ASSERT_EQUAL(retval, 0);
+    }
+    CU_ASSERT_EQUAL(tbl->len, max);
+
+    // lookups return the first occurrence of a duplicated name
+    for (int i = 0; i < 1000; i++) {
+        sprintf(buf, "L%d", i);
+        CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, buf), 4 * i);
+    }
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "L1000"), -1);
+
+    // insertion order is kept for write_table()
+    CU_ASSERT_EQUAL(tbl->tbl[1001].addr, 4 * 1001);
+    CU_ASSERT_EQUAL(strcmp(tbl->tbl[1001].name, "L1"), 0);
+
+    // repeated names share one copy
+    CU_ASSERT_PTR_EQUAL(tbl->tbl[1001].name, tbl->tbl[1].name);
+
+    free_table(tbl);
+
+    // a presized table does not grow while filling up to its hint
+    tbl = create_table_with_hint(SYMTBL_UNIQUE_NAME, max);
+    Symbol* first = tbl->tbl;
+    for (int i = 0; i < max; i++) {
+        sprintf(buf, "L%d", i);
+        CU_ASSERT_EQUAL(add_to_table(tbl, buf, 4 * i), 0);
+    }
+    CU_ASSERT_PTR_EQUAL(tbl->tbl, first);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "L4321"), 4 * 4321);
+    free_table(tbl);
+}
+
+void test_reset_table() {
+    int retval, max = 100;
+    char buf[10];
+
+    SymbolTable* tbl = create_table(SYMTBL_UNIQUE_NAME);
+    for (int round = 0; round < 3; round++) {
+        // a reset table is empty, and names can be added again
+        for (int i = 0; i < max; i++) {
+            sprintf(buf, "%d", i);
+            retval = add_to_table(tbl, buf, 4 * (i + round));
+            CU_ASSERT_EQUAL(retval, 0);
+        }
+        CU_ASSERT_EQUAL(tbl->len, max);
+        retval = get_addr_for_symbol(tbl, "7");
+        CU_ASSERT_EQUAL(retval, 4 * (7 + round));
+
+        reset_table(tbl);
+        CU_ASSERT_EQUAL(tbl->len, 0);
+        retval = get_addr_for_symbol(tbl, "7");
+        CU_ASSERT_EQUAL(retval, -1);
+    }
+    retval = add_to_table(tbl, "7", 40);
+    CU_ASSERT_EQUAL(retval, 0);
+    retval = add_to_table(tbl, "7", 44);
+    CU_ASSERT_EQUAL(retval, -1);
+    free_table(tbl);
+
+    // duplicates are dropped along with everything else
+    tbl = create_table(SYMTBL_NON_UNIQUE);
+    add_to_table(tbl, "loop", 0);
+    add_to_table(tbl, "loop", 8);
+    reset_table(tbl);
+    CU_ASSERT_EQUAL(tbl->len, 0);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "loop"), -1);
+    add_to_table(tbl, "loop", 12);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(tbl, "loop"), 12);
+    free_table(tbl);
+}
+
+void test_index_for_symbol() {
+    SymbolTable* tbl = create_table(SYMTBL_NON_UNIQUE);
+    char buf[16];
+
+    for (int i = 0; i < 2000; i++) {
+        sprintf(buf, "L%d", i % 1000);
+        CU_ASSERT_EQUAL(add_to_table(tbl, buf, 4 * i), 0);
+    }
+    // the position of the first occurrence, whatever its address
+    CU_ASSERT_EQUAL(get_index_for_symbol(tbl, "L7"), 7);
+    CU_ASSERT_EQUAL(get_index_for_symbol(tbl, "L999"), 999);
+    CU_ASSERT_EQUAL(get_index_for_symbol(tbl, "L1000"), -1);
+    CU_ASSERT_EQUAL(get_index_for_symbol(tbl, ""), -1);
+    free_table(tbl);
+}
+
+
+/****************************************
+ * Test for step 3
+ ****************************************/
+
+void test_lookup_inst() {
+    const char* names[] = { "addu", "or", "slt", "sltu", "sll", "jr", "addiu",
+        "ori", "lui", "lb", "lbu", "lw", "sb", "sw", "beq", "bne", "j", "jal",
+        "li", "blt" };
+    for (int i = 0; i < NUM_INSTS; i++) {
+        const InstDesc* desc = lookup_inst(names[i]);
+        CU_ASSERT_PTR_NOT_NULL(desc);
+        if (desc) {
+            CU_ASSERT_EQUAL(desc->id, i);
+        }
+    }
+    CU_ASSERT_EQUAL(lookup_inst("sltu")->code, 0x2b);
+    CU_ASSERT_EQUAL(lookup_inst("jal")->format, FMT_JUMP);
+    CU_ASSERT_EQUAL(lookup_inst("li")->format, FMT_PSEUDO);
+
+    CU_ASSERT_PTR_NULL(lookup_inst(""));
+    CU_ASSERT_PTR_NULL(lookup_inst("a"));
+    CU_ASSERT_PTR_NULL(lookup_inst("lx"));
+    CU_ASSERT_PTR_NULL(lookup_inst("sltiu"));
+    CU_ASSERT_PTR_NULL(lookup_inst("addiux"));
+    CU_ASSERT_PTR_NULL(lookup_inst("auuu"));
+    CU_ASSERT_PTR_NULL(lookup_inst(NULL));
+}
+
+void test_translate_inst() {
+    int retval;
+
+    // create args
+    char *args[3]; // array of pointers to char arrays
+    char functReg3[4] = "$a1"; // array of char
+    args[0] = functReg3; // set first element of bad array to $s0
+    char functReg[4] = "$a1";
+    args[1] = functReg;
+    char functReg2[4] = "$a0";
+    args[2] = functReg2;
+
+    uint32_t addr = 0;
+
+    // create symtbl & reltbl
+    SymbolTable* symtbl = create_table(0);
+    SymbolTable* reltbl = create_table(0);
+
+
+    // TEST WRITE_RTYPE, valid args, return 0
+    FILE* testrtype = fopen("testrtype.txt", "w");
+    const char *rtype = "addu"; //create good name
+    retval = translate_inst(testrtype, rtype, args, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(testrtype);
+
+
+
+
+    // TEST WRITE_SHIFT
+    char *testshift[3]; // array of pointers to char arrays
+    char shiftReg3[4] = "$a1"; // array of char
+    testshift[0] = shiftReg3; // set first element of bad array to $s0
+    char shiftReg[4] = "$a1";
+    testshift[1] = shiftReg;
+    char shiftReg2[2] = "1";
+    testshift[2] = shiftReg2;
+    const char *shift = "sll"; //create good name
+
+    // test write_shift, valid args, return 0
+    FILE* goodshift = fopen("goodshift.txt", "w");
+    retval = translate_inst(goodshift, shift, testshift, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(goodshift);
+
+    // test write_shift, invalid shiftamt, return -1
+    char newshiftReg2[2] = "32";
+    testshift[2] = newshiftReg2;
+    FILE* badshift = fopen("badshift.txt", "w");
+    retval = translate_inst(badshift, shift, testshift, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, -1);
+    fclose(badshift);
+
+
+
+    // TEST WRITE_JR
+    char *testjr[1]; // array of pointers to char arrays
+    char jrReg[4] = "$a1"; // array of char
+    testjr[0] = jrReg; // set first element of bad array to $s0
+    const char *jr = "jr"; //create good name
+    FILE* goodjr = fopen("goodjr.txt", "w");
+    retval = translate_inst(goodjr, jr, testjr, 1, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(goodjr);
+
+
+
+    // TEST WRITE_ADDIU & WRITE_ITYPE & WRITE_ORI
+    char *testaddiu[3]; // array of pointers to char arrays
+    char addiuReg[4] = "$a1"; // array of char
+    testaddiu[0] = addiuReg; // set first element of bad array to $s0
+    char addiuReg2[4] = "$a1";
+    testaddiu[1] = addiuReg2;
+    char addiuReg3[6] = "10000";
+    testaddiu[2] = addiuReg3;
+
+    // addiu
+    const char *addiu = "addiu"; //create good name
+    FILE* goodaddiu = fopen("goodaddiu.txt", "w");
+    retval = translate_inst(goodaddiu, addiu, testaddiu, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(goodaddiu);
+
+    // itype
+    // const char *lb = "lb"; //create good name
+    // FILE* goodlb = fopen("goodlb.txt", "w");
+    // retval = translate_inst(goodlb, lb, testaddiu, 3, addr, symtbl, reltbl);
+    // CU_ASSERT_EQUAL(retval, 0);
+    // fclose(goodlb);
+
+    // ori
+    const char *ori = "ori"; //create good name
+    FILE* goodori = fopen("goodori.txt", "w");
+    retval = translate_inst(goodori, ori, testaddiu, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(goodori);
+
+    char addiuReg4[6] = "32768";
+    testaddiu[2] = addiuReg4;
+
+    //test bad itype (overflow)
+    const char *lbu = "lbu"; //create good name
+    FILE* goodlbu = fopen("goodlbu.txt", "w");
+    retval = translate_inst(goodlbu, lbu, testaddiu, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, -1);
+    fclose(goodlbu);
+
+
+    // TEST WRITE_LUI
+    char *testlui[2]; // array of pointers to char arrays
+    char luireg[4] = "$a1"; // array of char
+    testlui[0] = luireg; // set first element of bad array to $s0
+    char luireg2[4] = "-11"; // array of char                      
+    testlui[1] = luireg2; // set first element of bad array to $s0
+    const char *lui = "lui"; //create good name
+    FILE* goodlui = fopen("goodlui.txt", "w");
+    retval = translate_inst(goodlui, lui, testlui, 2, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(goodlui);
+
+
+
+    // TEST WRITE_MEM
+    char *testmem[2]; // array of pointers to char arrays
+    char memreg[4] = "$a1"; // array of char
+    testmem[0] = memreg; // set first element of bad array to $s0
+    char memreg2[3] = "11"; // array of char
+    testmem[1] = memreg2; // set first element of bad array to $s0
+    char memreg3[4] = "$a1"; // array of char
+    testmem[2] = memreg3; // set first element of bad array to $s0
+    const char *sb = "sb"; //create good name
+    FILE* goodmem = fopen("goodmem.txt", "w");
+    retval = translate_inst(goodmem, sb, testmem, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+    fclose(goodmem);
+
+
+    // TEST WRITE_BRANCH
+    /*const char *beq = "beq"; //create good name 
+    char *testbeq[3]; // array of pointers to char arrays                       
+    char beqreg[4] = "$a0"; // array of char
+    testbeq[0] = beqreg; // set first element of bad array to $s0
+    char beqreg2[4] = "$a1";
+    testbeq[1] = beqreg2;
+    char beqreg3[6] = "10000";
+    testbeq[2] = beqreg3;
+
+    FILE* goodbeq = fopen("goodbeq.txt", "w");
+    retval = translate_inst(goodbeq, beq, testbeq, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0); 
+    
+    retval = get_addr_for_symbol(symtbl, beq);
+    CU_ASSERT_EQUAL(retval, 0);              
+    fclose(goodbeq); */
+
+
+    // TEST WRITE_JUMP 
+    /*const char *jal = "jal"; //create good name
+    char *testjump[1]; // array of pointers to char arrays
+    char jumpreg[4] = "$ra"; // array of char
+    testjump[0] = jumpreg; // set first element of bad array to $s0
+
+    FILE* goodjal = fopen("goodjal.txt", "w");
+    retval = translate_inst(goodjal, jal, testjump, 1, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, 0);
+
+    retval = get_addr_for_symbol(reltbl, jal);
+    CU_ASSERT_EQUAL(retval, 0);               
+    fclose(goodjal);*/
+
+
+
+    // TEST BAD REGISTER; should return -1
+    FILE* regs = fopen("regs.txt", "w");
+    char *testReg[3]; // array of pointers to char arrays
+    char badReg[5] = "$100"; // array of char
+    testReg[0] = badReg; // set first element of bad array to $s0
+    char goodReg[4] = "$a1";
+    testReg[1] = goodReg;
+    char goodReg2[4] = "$a0";
+    testReg[2] = goodReg2;
+    retval = translate_inst(regs, shift, testReg, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, -1);
+    fclose(regs);
+
+    // TEST BAD NAME, return -1
+    FILE* bad = fopen("bad.txt", "w");
+    const char *badargname = "auuu"; //create bad name
+    retval = translate_inst(bad, badargname, args, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, -1);
+    fclose(bad);
+
+    // TEST BAD ARG ARRAY, return -1
+    FILE* badargsfile = fopen("badargsfile.txt", "w");
+    char *badArray[1]; // array of pointers to char arrays
+    char badArg[4] = "$s0"; // array of char
+    badArray[0] = badArg; // set first element of bad array to $s0
+    retval = translate_inst(badargsfile, rtype, badArray, 3, addr, symtbl, reltbl);
+    CU_ASSERT_EQUAL(retval, -1);
+    fclose(badargsfile);
+
+}
+
+
+void test_inst_records() {
+    InstList insts;
+    inst_list_init(&insts);
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    uint32_t inst;
+
+    char* addu[] = { "$t0", "$t1", "$t2" };
+    InstRecord* rec = inst_list_add(&insts, "addu", addu, 3, 7);
+    CU_ASSERT_EQUAL(rec->id, INST_ADDU);
+    CU_ASSERT_EQUAL(rec->line, 7);
+    CU_ASSERT_PTR_NULL(rec->text);
+    CU_ASSERT_EQUAL(encode_record(&inst, rec, 0, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(inst, 0x012a4021);
+
+    char* lw[] = { "$t3", "-4", "$sp" };
+    rec = inst_list_add(&insts, "lw", lw, 3, 8);
+    CU_ASSERT_EQUAL(encode_record(&inst, rec, 4, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(inst, 0x8fabfffc);
+
+    // invalid instructions keep their text for the error message
+    char* bad[] = { "$t0", "$t1", "$t40" };
+    rec = inst_list_add(&insts, "or", bad, 3, 9);
+    CU_ASSERT_EQUAL(rec->id, INST_INVALID);
+    CU_ASSERT_STRING_EQUAL(rec->text, "or $t0 $t1 $t40");
+
+    // branches are resolved when encoded, once the label is known
+    char* beq[] = { "$t0", "$0", "done" };
+    rec = inst_list_add(&insts, "beq", beq, 3, 10);
+    CU_ASSERT_STRING_EQUAL(rec->sym, "done");
+    CU_ASSERT_EQUAL(encode_record(&inst, rec, 12, symtbl, reltbl), -1);
+    add_to_table(symtbl, "done", 32);
+    CU_ASSERT_EQUAL(encode_record(&inst, rec, 12, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(inst, 0x11000004);
+
+    char* jal[] = { "done" };
+    rec = inst_list_add(&insts, "jal", jal, 1, 11);
+    CU_ASSERT_EQUAL(encode_record(&inst, rec, 16, symtbl, reltbl), 0);
+    CU_ASSERT_EQUAL(inst, 0x0c000000);
+    CU_ASSERT_EQUAL(get_addr_for_symbol(reltbl, "done"), 16);
+
+    CU_ASSERT_EQUAL(insts.len, 5);
+
+    inst_list_free(&insts);
+    free_table(symtbl);
+    free_table(reltbl);
+}
+
+/****************************************
+ * Test for step 4
+ ****************************************/
+
+void test_li_expansion() {
+    int retval;
+    char li[]  = "li";
+
+    //error case: wrong num of args
+    FILE* asdf = fopen("asdf.txt", "w");
+    CU_ASSERT_PTR_NOT_NULL(asdf);
+    char *badArray[1];
+    char badArg[4] = "$s0";
+    badArray[0] = badArg;
+    retval = write_pass_one(asdf, li, badArray, 1);
+    fclose(asdf);
+    CU_ASSERT_EQUAL(retval, 0);
+
+    //correct case: addiu
+    FILE* asdf1 = fopen("asdf1.txt", "w");
+    CU_ASSERT_PTR_NOT_NULL(asdf1);
+    //create an array of pointers to strings
+    char *array[2];
+    char arg1[4] = "$t0";
+    char arg2[6] = "65535";
+    array[0] = arg1;
+    array[1] = arg2;
+    retval = write_pass_one(asdf1, li, array, 2);
+    fclose(asdf1);
+    CU_ASSERT_EQUAL(retval, 1);
+
+    //correct case: lui ori
+    FILE* asdf2 = fopen("asdf2.txt", "w");
+    CU_ASSERT_PTR_NOT_NULL(asdf2);
+    char *array2[2];
+    char arg3[4] = "$t0";
+    char arg4[8] = "0x3BF20";
+    array2[0] = arg3;
+    array2[1] = arg4;
+    retval = write_pass_one(asdf2, li, array2, 2);
+    fclose(asdf2);
+    CU_ASSERT_EQUAL(retval, 2);
+
+    //correct case: deadbeef
+    FILE* asdf3 = fopen("asdf3.txt", "w");
+    CU_ASSERT_PTR_NOT_NULL(asdf3);
+    char *array3[2];
+    char arg5[4] = "$t0";
+    char arg6[11] = "0xDEADBEEF";
+    array3[0] = arg5;
+    array3[1] = arg6;
+    retval = write_pass_one(asdf3, li, array3, 2);
+    fclose(asdf3);
+    CU_ASSERT_EQUAL(retval, 2); 
+}
+
+void test_blt_expansion() {
+  int retval;
+  char blt[] = "blt";
+
+  //incorrect case: not enough arguments
+  FILE* asdf = fopen("asdf.txt", "w");
+  CU_ASSERT_PTR_NOT_NULL(asdf);
+  char *array[3];
+  char arg1[4] = "$8";
+  char arg2[4] = "$9";
+  array[0] = arg1;
+  array[1] = arg2;
+  array[2] = NULL;
+  retval = write_pass_one(asdf, blt, array, 1);
+  fclose(asdf);
+  CU_ASSERT_EQUAL(retval, 0);
+
+  //correct case
+  FILE* asdf2= fopen("asdf2.txt", "w");
+  CU_ASSERT_PTR_NOT_NULL(asdf2);
+  char *array2[3];
+  char arg3[4] = "$8";
+  char arg4[4] = "$9";
+  char arg5[10] = "label";
+  array2[0] = arg3;
+  array2[1] = arg4;
+  array2[2] = arg5;
+
+  retval = write_pass_one(asdf2, blt, array2, 3); 
+  fclose(asdf2);
+  CU_ASSERT_EQUAL(retval, 2);
+}
+
+void test_plan_expansion() {
+  Expansion exp;
+  InstRecord rec;
+  InstList insts;
+  inst_list_init(&insts);
+
+  //the size comes from the same parse of the immediate as the records
+  char* short_li[] = { "$t0", "-5" };
+  plan_expansion(&exp, "li", short_li, 2);
+  CU_ASSERT_EQUAL(exp.size, 4);
+  CU_ASSERT_EQUAL(exp.count, 1);
+  CU_ASSERT_EQUAL(expansion_record(&rec, &exp, 0), 0);
+  CU_ASSERT_EQUAL(rec.id, INST_ADDIU);
+  CU_ASSERT_EQUAL(rec.rt, 8);
+  CU_ASSERT_EQUAL(rec.imm, -5);
+  CU_ASSERT_STRING_EQUAL(expansion_to_string(&insts.strings, &exp, 0), "addiu $t0 $0 -5");
+
+  char* long_li[] = { "$a0", "0xDEADBEEF" };
+  plan_expansion(&exp, "li", long_li, 2);
+  CU_ASSERT_EQUAL(exp.size, 8);
+  CU_ASSERT_EQUAL(exp.count, 2);
+  CU_ASSERT_EQUAL(expansion_record(&rec, &exp, 0), 0);
+  CU_ASSERT_EQUAL(rec.id, INST_LUI);
+  CU_ASSERT_EQUAL(rec.rt, 1);
+  CU_ASSERT_EQUAL(rec.imm, 0xdead);
+  CU_ASSERT_EQUAL(expansion_record(&rec, &exp, 1), 0);
+  CU_ASSERT_EQUAL(rec.id, INST_ORI);
+  CU_ASSERT_EQUAL(rec.rt, 4);
+  CU_ASSERT_EQUAL(rec.rs, 1);
+  CU_ASSERT_EQUAL(rec.imm, 0xbeef);
+
+  //too large to load, but it still takes up the space of a lui-ori pair
+  char* huge_li[] = { "$t0", "0x1FFFFFFFF" };
+  plan_expansion(&exp, "li", huge_li, 2);
+  CU_ASSERT_EQUAL(exp.size, 8);
+  CU_ASSERT_EQUAL(exp.count, 0);
+
+  //registers are only checked once the record is made
+  char* blt[] = { "$t0", "$bad", "loop" };
+  plan_expansion(&exp, "blt", blt, 3);
+  CU_ASSERT_EQUAL(exp.size, 8);
+  CU_ASSERT_EQUAL(exp.count, 2);
+  InstRecord* slt = inst_list_add_expansion(&insts, &exp, 0, 3);
+  CU_ASSERT_EQUAL(slt->id, INST_INVALID);
+  CU_ASSERT_STRING_EQUAL(slt->text, "slt $at $t0 $bad");
+  InstRecord* bne = inst_list_add_expansion(&insts, &exp, 1, 3);
+  CU_ASSERT_EQUAL(bne->id, INST_BNE);
+  CU_ASSERT_STRING_EQUAL(bne->sym, "loop");
+  CU_ASSERT_STRING_EQUAL(bne->text, "bne $at $0 loop");
+
+  plan_expansion(&exp, "blt", blt, 2);
+  CU_ASSERT_EQUAL(exp.size, 4);
+  CU_ASSERT_EQUAL(exp.count, 0);
+
+  inst_list_free(&insts);
+}
+
+/****************************************
+ *  Test cases for pool.c
+ ****************************************/
+
+static void count_task(void* arg, uint32_t task) {
+    __atomic_fetch_add(&((int*) arg)[task], 1, __ATOMIC_RELAXED);
+}
+
+void test_run_tasks() {
+    int counts[100];
+
+    memset(counts, 0, sizeof(counts));
+    run_tasks(4, 100, count_task, counts);
+    for (int i = 0; i < 100; i++) {
+        CU_ASSERT_EQUAL(counts[i], 1);
+    }
+
+    // more threads than tasks, and no threads at all
+    memset(counts, 0, sizeof(counts));
+    run_tasks(8, 3, count_task, counts);
+    run_tasks(0, 3, count_task, counts);
+    CU_ASSERT_EQUAL(counts[0], 2);
+    CU_ASSERT_EQUAL(counts[2], 2);
+    CU_ASSERT_EQUAL(counts[3], 0);
+}
+
+typedef struct {
+    int counts[1000];
+    uint32_t max_worker;    // largest worker index seen, read after the run
+} WorkerCounts;
+
+static void count_worker_task(void* arg, uint32_t worker, uint32_t task) {
+    WorkerCounts* wc = (WorkerCounts*) arg;
+    uint32_t seen = __atomic_load_n(&wc->max_worker, __ATOMIC_RELAXED);
+    while (worker > seen && !__atomic_compare_exchange_n(&wc->max_worker, &seen, worker,
+            1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    __atomic_fetch_add(&wc->counts[task], 1, __ATOMIC_RELAXED);
+}
+
+void test_run_worker_tasks() {
+    WorkerCounts wc;
+
+    memset(&wc, 0, sizeof(wc));
+    run_worker_tasks(4, 1000, count_worker_task, &wc);
+    CU_ASSERT(wc.max_worker < 4);
+    for (int i = 0; i < 1000; i++) {
+        CU_ASSERT_EQUAL(wc.counts[i], 1);
+    }
+
+    memset(&wc, 0, sizeof(wc));
+    run_worker_tasks(4, 2, count_worker_task, &wc);
+    run_worker_tasks(4, 0, count_worker_task, &wc);
+    CU_ASSERT(wc.max_worker < 4);
+    CU_ASSERT_EQUAL(wc.counts[0], 1);
+    CU_ASSERT_EQUAL(wc.counts[1], 1);
+    CU_ASSERT_EQUAL(wc.counts[2], 0);
+}
+
+void test_state_file() {
+    StateBuilder builder;
+    BuildState state;
+    const char* filename = "test_state.tmp";
+
+    CU_ASSERT_EQUAL(hash_line("addu $t0, $t1, $t2", 18), hash_line("addu $t0, $t1, $t2", 18));
+    CU_ASSERT_NOT_EQUAL(hash_line("addu $t0, $t1, $t2", 18), hash_line("addu $t0, $t1, $t3", 18));
+    CU_ASSERT_NOT_EQUAL(hash_line("", 0), hash_line("\0", 1));
+
+    state_builder_init(&builder);
+    StateLine* line = state_add_line(&builder, 42, "loop", 4, 8);
+    line->first_rec = 0;
+    line->num_recs = 2;
+    state_add_rec(&builder, 0x12345678, STATE_PLAIN, NULL);
+    state_add_rec(&builder, 0x1500ffff, STATE_BRANCH, "loop");
+    state_add_line(&builder, 7, NULL, 0, 0);
+    CU_ASSERT_EQUAL(state_save(&builder, filename), 0);
+    state_builder_free(&builder);
+
+    CU_ASSERT_EQUAL(state_load(&state, filename), 0);
+    CU_ASSERT_EQUAL(state.num_lines, 2);
+    CU_ASSERT_EQUAL(state.num_recs, 2);
+    CU_ASSERT_EQUAL(state.lines[0].hash, 42);
+    CU_ASSERT_EQUAL(state.lines[0].size, 8);
+    CU_ASSERT_STRING_EQUAL(state_string(&state, state.lines[0].label), "loop");
+    CU_ASSERT_PTR_NULL(state_string(&state, state.lines[1].label));
+    CU_ASSERT_EQUAL(state.recs[1].word, 0x1500ffff);
+    CU_ASSERT_EQUAL(state.recs[1].kind, STATE_BRANCH);
+    CU_ASSERT_STRING_EQUAL(state_string(&state, state.recs[1].sym), "loop");
+    state_unload(&state);
+
+    //a truncated file is not used
+    CU_ASSERT_EQUAL(truncate(filename, sizeof(StateHeader) + 3), 0);
+    CU_ASSERT_EQUAL(state_load(&state, filename), -1);
+    CU_ASSERT_EQUAL(state.num_lines, 0);
+    remove(filename);
+    CU_ASSERT_EQUAL(state_load(&state, filename), -1);
+}
+
+/****************************************
+ *  Test cases for assembler.c
+ ****************************************/
+
+/* Assembles SRC into FORMAT, in the byte order LITTLE_ENDIAN asks for, with
+   both passes on JOBS threads, or with single_pass() if JOBS is 0. Returns
+   the output, with a NUL after its LEN bytes, and leaves what was logged in
+   LOG and the result in ERR.
+ */
+static char* assemble_source(const char* src, OutputFormat format, int little_endian,
+    int jobs, OutBuf* log, size_t* len, int* err) {
+    FILE* input = fmemopen((void*) src, strlen(src), "r");
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    AsmOptions opts = { format, little_endian, jobs };
+    ObjectWriter obj;
+
+    log->len = 0;
+    OutBuf* previous = capture_log(log);
+    object_begin_memory(&obj, format, little_endian);
+    if (jobs == 0) {
+        *err = single_pass(input, &obj, symtbl, reltbl, NULL);
+        object_finish(&obj, symtbl, reltbl);
+    } else {
+        InstList insts;
+        inst_list_init(&insts);
+        *err = assemble_stream(input, NULL, &obj, symtbl, reltbl, &insts, &opts, NULL);
+        inst_list_free(&insts);
+    }
+    capture_log(previous);
+    outbuf_putc(log, '\0');
+
+    char* out = object_take_memory(&obj, len);
+    out = (char*) realloc(out, *len + 1);
+    out[*len] = '\0';
+    fclose(input);
+    free_table(symtbl);
+    free_table(reltbl);
+    return out;
+}
+
+void test_single_pass() {
+    OutBuf src, log1, log2;
+    size_t len1, len2;
+    int err1, err2;
+
+    outbuf_open_memory(&src);
+    outbuf_open_memory(&log1);
+    outbuf_open_memory(&log2);
+    outbuf_puts(&src,
+        "start: addu $t0, $t1, $t2\n"
+        "beq $t0, $0, fwd\n"
+        "back: li $t1, 0x12345\n"
+        "bne $t1, $0, back\n"
+        "j later\n"
+        "jal start\n"
+        "fwd: blt $t0, $t1, back\n"
+        "beq $0, $0, nowhere\n"
+        "addu $t0, $t1\n"
+        "later: jr $ra\n"
+        "bne $t0, $t1, far\n");
+    //too far for the offset field of the branch above
+    for (int i = 0; i < 70000; i++) {
+        outbuf_puts(&src, "or $t0 $t0 $t0\n");
+    }
+    outbuf_puts(&src, "far: j start\n");
+    outbuf_putc(&src, '\0');
+
+    char* two = assemble_source(src.data, OUTPUT_TEXT, 0, 1, &log1, &len1, &err1);
+    char* one = assemble_source(src.data, OUTPUT_TEXT, 0, 0, &log2, &len2, &err2);
+    CU_ASSERT_EQUAL(err1, -1);
+    CU_ASSERT_EQUAL(err2, -1);
+    CU_ASSERT_EQUAL(len1, len2);
+    CU_ASSERT(len1 == len2 && memcmp(one, two, len1) == 0);
+    CU_ASSERT_STRING_EQUAL(log2.data, log1.data);
+    CU_ASSERT_STRING_EQUAL(log1.data,
+        "Error - invalid instruction at line 10: beq $0 $0 nowhere\n"
+        "Error - invalid instruction at line 11: addu $t0 $t1\n"
+        "Error - invalid instruction at line 13: bne $t0 $t1 far\n");
+    CU_ASSERT(strstr(two, ".symbol\n0\tstart\n8\tback\n28\tfwd\n44\tlater\n") != NULL);
+    CU_ASSERT(strstr(two, ".relocation\n20\tlater\n24\tstart\n") != NULL);
+    free(one);
+    free(two);
+
+    outbuf_close(&src);
+    outbuf_close(&log1);
+    outbuf_close(&log2);
+}
+
+void test_object_formats() {
+    const char* src = "main: addu $t0, $t1, $t2\njal func\nj ext\nfunc: jr $ra\n";
+    const uint32_t words[] = { 0x012a4021, 0x0c000000, 0x08000000, 0x03e00008 };
+    OutBuf log;
+    size_t len;
+    int err;
+
+    outbuf_open_memory(&log);
+
+    //raw images of the text section in both byte orders
+    char* out = assemble_source(src, OUTPUT_BIN, 0, 1, &log, &len, &err);
+    CU_ASSERT_EQUAL(err, 0);
+    CU_ASSERT_EQUAL(len, 16);
+    CU_ASSERT(memcmp(out, "\x01\x2a\x40\x21\x0c\x00\x00\x00", 8) == 0);
+    free(out);
+    out = assemble_source(src, OUTPUT_BIN, 1, 1, &log, &len, &err);
+    CU_ASSERT_EQUAL(len, 16);
+    CU_ASSERT(memcmp(out, words, sizeof(words)) == 0);
+    free(out);
+
+    //a little-endian object can be read with the structs of the host
+    out = assemble_source(src, OUTPUT_ELF, 1, 1, &log, &len, &err);
+    CU_ASSERT_EQUAL(err, 0);
+    const Elf32_Ehdr* eh = (const Elf32_Ehdr*) out;
+    CU_ASSERT(memcmp(eh->e_ident, ELFMAG, SELFMAG) == 0);
+    CU_ASSERT_EQUAL(eh->e_ident[EI_CLASS], ELFCLASS32);
+    CU_ASSERT_EQUAL(eh->e_ident[EI_DATA], ELFDATA2LSB);
+    CU_ASSERT_EQUAL(eh->e_type, ET_REL);
+    CU_ASSERT_EQUAL(eh->e_machine, EM_MIPS);
+    CU_ASSERT_EQUAL(eh->e_shentsize, sizeof(Elf32_Shdr));
+    CU_ASSERT_EQUAL(eh->e_shnum, 6);
+    CU_ASSERT_EQUAL(eh->e_shoff + 6 * sizeof(Elf32_Shdr), len);
+
+    const Elf32_Shdr* sh = (const Elf32_Shdr*) (out + eh->e_shoff);
+    const char* shstrs = out + sh[eh->e_shstrndx].sh_offset;
+    CU_ASSERT_STRING_EQUAL(shstrs + sh[1].sh_name, ".text");
+    CU_ASSERT_EQUAL(sh[1].sh_size, sizeof(words));
+    CU_ASSERT(memcmp(out + sh[1].sh_offset, words, sizeof(words)) == 0);
+
+    //symbols: null, .text, the labels, then the undefined name
+    CU_ASSERT_STRING_EQUAL(shstrs + sh[3].sh_name, ".symtab");
+    CU_ASSERT_EQUAL(sh[3].sh_size, 5 * sizeof(Elf32_Sym));
+    CU_ASSERT_EQUAL(sh[3].sh_info, 2);
+    const Elf32_Sym* sym = (const Elf32_Sym*) (out + sh[3].sh_offset);
+    const char* strs = out + sh[sh[3].sh_link].sh_offset;
+    CU_ASSERT_STRING_EQUAL(strs + sym[2].st_name, "main");
+    CU_ASSERT_STRING_EQUAL(strs + sym[3].st_name, "func");
+    CU_ASSERT_EQUAL(sym[3].st_value, 12);
+    CU_ASSERT_EQUAL(sym[3].st_shndx, 1);
+    CU_ASSERT_EQUAL(ELF32_ST_BIND(sym[3].st_info), STB_GLOBAL);
+    CU_ASSERT_STRING_EQUAL(strs + sym[4].st_name, "ext");
+    CU_ASSERT_EQUAL(sym[4].st_shndx, SHN_UNDEF);
+
+    CU_ASSERT_STRING_EQUAL(shstrs + sh[2].sh_name, ".rel.text");
+    CU_ASSERT_EQUAL(sh[2].sh_type, SHT_REL);
+    CU_ASSERT_EQUAL(sh[2].sh_link, 3);
+    CU_ASSERT_EQUAL(sh[2].sh_info, 1);
+    CU_ASSERT_EQUAL(sh[2].sh_size, 2 * sizeof(Elf32_Rel));
+    const Elf32_Rel* rel = (const Elf32_Rel*) (out + sh[2].sh_offset);
+    CU_ASSERT_EQUAL(rel[0].r_offset, 4);
+    CU_ASSERT_EQUAL(rel[0].r_info, ELF32_R_INFO(3, R_MIPS_26));
+    CU_ASSERT_EQUAL(rel[1].r_offset, 8);
+    CU_ASSERT_EQUAL(rel[1].r_info, ELF32_R_INFO(4, R_MIPS_26));
+    free(out);
+
+    //the default byte order is big-endian
+    out = assemble_source(src, OUTPUT_ELF, 0, 1, &log, &len, &err);
+    CU_ASSERT_EQUAL(out[EI_DATA], ELFDATA2MSB);
+    CU_ASSERT(memcmp(out + 18, "\x00\x08", 2) == 0);     //e_machine
+    CU_ASSERT(memcmp(out + 52, "\x01\x2a\x40\x21", 4) == 0);  //first word of .text
+    free(out);
+
+    //an empty run of words, as from an empty chunk, adds nothing
+    ObjectWriter obj;
+    object_begin_memory(&obj, OUTPUT_BIN, 0);
+    object_add_words(&obj, NULL, 0);
+    object_add_words(&obj, words, 2);
+    object_add_words(&obj, NULL, 0);
+    CU_ASSERT_EQUAL(obj.num_words, 2);
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+    CU_ASSERT_EQUAL(object_finish(&obj, symtbl, reltbl), 0);
+    out = object_take_memory(&obj, &len);
+    CU_ASSERT_EQUAL(len, 8);
+    CU_ASSERT(memcmp(out, "\x01\x2a\x40\x21\x0c\x00\x00\x00", 8) == 0);
+    free(out);
+    free_table(symtbl);
+    free_table(reltbl);
+
+    outbuf_close(&log);
+}
+
+/* Returns the lines read by STAGE in what print_stats() prints for STATS, or
+   -1 if the stage is not printed.
+ */
+static long printed_lines_read(const AsmStats* stats, const char* stage) {
+    FILE* f = tmpfile();
+    char line[256], name[32];
+    long lines = -1;
+    double wall, cpu;
+
+    print_stats(f, stats);
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, " %31s %lf ms wall %lf ms cpu %ld lines read", name, &wall, &cpu,
+                &lines) == 4 && strcmp(name, stage) == 0) {
+            break;
+        }
+        lines = -1;
+    }
+    fclose(f);
+    return lines;
+}
+
+void test_assemble_stats() {
+    const char* in_name = "test_stats.s";
+    const char* tmp_name = "test_stats.int";
+    const char* out_name = "test_stats.out";
+    FILE* f = fopen(in_name, "w");
+    fputs("# five lines, six instructions\n"
+        "main: li $t0, 0x12345\n"
+        "loop: addiu $t0, $t0, -1\n"
+        "blt $0, $t0, loop\n"
+        "jr $ra\n", f);
+    fclose(f);
+
+    for (int jobs = 1; jobs <= 2; jobs++) {
+        AsmOptions opts = { OUTPUT_TEXT, 0, jobs };
+        AsmStats stats;
+
+        // both passes, with pass two working from the records of pass one
+        memset(&stats, 0, sizeof(stats));
+        CU_ASSERT_EQUAL(assemble(in_name, tmp_name, out_name, &opts, &stats), 0);
+        CU_ASSERT_EQUAL(stats.lines_read[STATS_PASS_ONE], 5);
+        CU_ASSERT_EQUAL(stats.lines_read[STATS_PASS_TWO], 6);
+        CU_ASSERT_EQUAL(printed_lines_read(&stats, "pass_one"), 5);
+        CU_ASSERT_EQUAL(printed_lines_read(&stats, "pass_two"), 6);
+        CU_ASSERT_EQUAL(printed_lines_read(&stats, "single_pass"), -1);
+
+        // pass two alone, from the intermediate file, which fails on the
+        // branch since the labels are unknown but still reads every line
+        memset(&stats, 0, sizeof(stats));
+        CU_ASSERT_EQUAL(assemble(NULL, tmp_name, out_name, &opts, &stats), 1);
+        CU_ASSERT_EQUAL(printed_lines_read(&stats, "pass_one"), -1);
+        CU_ASSERT_EQUAL(printed_lines_read(&stats, "pass_two"), 6);
+    }
+    remove(in_name);
+    remove(tmp_name);
+    remove(out_name);
+}
+
+/* Returns the contents of the file NAME, with a NUL after its LEN bytes, or
+   NULL if it cannot be read.
+ */
+static char* read_whole_file(const char* name, size_t* len) {
+    FILE* f = fopen(name, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    char* data = (char*) malloc(size + 1);
+    *len = fread(data, 1, size, f);
+    data[*len] = '\0';
+    fclose(f);
+    return data;
+}
+
+static void write_whole_file(const char* name, const char* text) {
+    FILE* f = fopen(name, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+/* Builds SRC incrementally with the state file STATE_NAME, and from scratch,
+   in FORMAT. Checks that both give the same result and output, and returns
+   how many lines the incremental build reused.
+ */
+static uint64_t check_incremental(const char* src, const char* state_name, OutputFormat format) {
+    const char* in_name = "test_inc.s";
+    const char* out_name = "test_inc.out";
+    const char* clean_name = "test_inc_clean.out";
+    AsmOptions opts = { format, 0, 1 };
+    AsmStats stats;
+    size_t len, clean_len;
+
+    write_whole_file(in_name, src);
+    memset(&stats, 0, sizeof(stats));
+    int err = assemble_incremental(in_name, out_name, state_name, &opts, &stats);
+    int clean_err = assemble(in_name, NULL, clean_name, &opts, NULL);
+    CU_ASSERT_EQUAL(err, clean_err);
+
+    char* out = read_whole_file(out_name, &len);
+    char* clean = read_whole_file(clean_name, &clean_len);
+    CU_ASSERT(out && clean && len == clean_len && memcmp(out, clean, len) == 0);
+    free(out);
+    free(clean);
+    remove(in_name);
+    remove(out_name);
+    remove(clean_name);
+    return stats.lines_reused;
+}
+
+void test_assemble_incremental() {
+    const char* state_name = "test_inc.state";
+    const char* first =
+        "main: addiu $t0, $0, 10\n"
+        "loop: addiu $t0, $t0, -1\n"
+        "addu $t1, $t1, $t0\n"
+        "bne $t0, $0, loop\n"
+        "j done\n"
+        "li $t2, 0x12345\n"
+        "jal helper\n"
+        "helper: addu $v0, $t1, $0\n"
+        "jr $ra\n"
+        "done: or $v0, $v0, $v0\n";
+    // a line inserted between loop and the branch to it, one edited and one
+    // deleted, which moves both loop and done, the target of the j
+    const char* second =
+        "main: addiu $t0, $0, 10\n"
+        "loop: addiu $t0, $t0, -1\n"
+        "li $t3, 0x54321\n"
+        "addu $t1, $t1, $t1\n"
+        "bne $t0, $0, loop\n"
+        "j done\n"
+        "jal helper\n"
+        "helper: addu $v0, $t1, $0\n"
+        "jr $ra\n"
+        "done: or $v0, $v0, $v0\n";
+    // an error, which only a full build reports
+    const char* broken =
+        "main: addiu $t0, $0, 10\n"
+        "loop: addiu $t0, $t0, -1\n"
+        "li $t3, 0x54321\n"
+        "addu $t1, $t1\n"
+        "bne $t0, $0, loop\n"
+        "j done\n"
+        "done: or $v0, $v0, $v0\n";
+    // the label moves to the end, after the branch that targets it
+    const char* third =
+        "main: addiu $t0, $0, 10\n"
+        "addiu $t0, $t0, -1\n"
+        "li $t3, 0x54321\n"
+        "bne $t0, $0, loop\n"
+        "j done\n"
+        "jal helper\n"
+        "helper: addu $v0, $t1, $0\n"
+        "jr $ra\n"
+        "loop: addu $t1, $t1, $t1\n"
+        "done: or $v0, $v0, $v0\n";
+
+    for (int format = OUTPUT_TEXT; format <= OUTPUT_ELF; format++) {
+        remove(state_name);
+        CU_ASSERT_EQUAL(check_incremental(first, state_name, format), 0);
+        CU_ASSERT_EQUAL(check_incremental(second, state_name, format), 8);
+        CU_ASSERT_EQUAL(check_incremental(broken, state_name, format), 0);
+        CU_ASSERT(check_incremental(third, state_name, format) > 0);
+        CU_ASSERT_EQUAL(check_incremental(third, state_name, format), 10);
+    }
+    remove(state_name);
+}
+
+/* Runs pass one over SRC, serially if JOBS is 0 and with pass_one_parallel()
+   otherwise, leaving the symbols in SYMTBL, the records in INSTS, the
+   intermediate text in INTER and what was logged in LOG. Returns the result
+   of the pass.
+ */
+static int run_pass_one(const char* src, size_t len, int jobs, SymbolTable* symtbl,
+    InstList* insts, OutBuf* inter, OutBuf* log, AsmStats* stats) {
+    FILE* input = fmemopen((void*) src, len, "r");
+    FILE* output = tmpfile();
+
+    OutBuf* previous = capture_log(log);
+    int err = jobs == 0
+        ? pass_one(input, output, symtbl, insts, stats)
+        : pass_one_parallel(input, output, symtbl, insts, jobs, stats);
+    capture_log(previous);
+
+    char piece[4096];
+    size_t n;
+    rewind(output);
+    while ((n = fread(piece, 1, sizeof(piece), output)) > 0) {
+        outbuf_write(inter, piece, n);
+    }
+    fclose(output);
+    fclose(input);
+    return err;
+}
+
+static int same_string(const char* a, const char* b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+void test_pass_one_parallel() {
+    // about 2 MiB, so that every number of jobs below gets as many chunks as
+    // it can use, and every kind of line below starts some chunk
+    OutBuf src;
+    char line[256];
+    outbuf_open_memory(&src);
+    for (int k = 0; src.len < 2 * 1024 * 1024; k++) {
+        int n = 0;
+        n += sprintf(line + n, "L%d:\n", k);
+        n += sprintf(line + n, "addu $t0, $t1, $t2 # %d\n", k);
+        n += sprintf(line + n, "M%d: li $t0, %d\n", k, 70000 + k);
+        //a label from far back, so often from another chunk
+        n += sprintf(line + n, "L%d: blt $t0, $t1, M%d\n", k / 3, k);
+        n += sprintf(line + n, "li $t1, -%d\n", k % 100);
+        if (k % 7 == 0) n += sprintf(line + n, "%dbad: addu $t0, $t0, $t0\n", k);
+        if (k % 5 == 0) n += sprintf(line + n, "N%d: addu $t0 $t1 $t2 $t%d\n", k, k % 8);
+        if (k % 11 == 0) n += sprintf(line + n, "\n  \nblt $t0, $t1\n");
+        n += sprintf(line + n, "j L%d\n", k);
+        outbuf_write(&src, line, n);
+    }
+
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    InstList insts;
+    OutBuf inter, log;
+    AsmStats stats;
+    inst_list_init(&insts);
+    outbuf_open_memory(&inter);
+    outbuf_open_memory(&log);
+    memset(&stats, 0, sizeof(stats));
+    int err = run_pass_one(src.data, src.len, 0, symtbl, &insts, &inter, &log, &stats);
+    CU_ASSERT_EQUAL(err, -1);
+    CU_ASSERT(symtbl->len > 1000);
+    CU_ASSERT(log.len > 0);
+
+    int jobs[] = { 1, 2, 7 };
+    for (int j = 0; j < 3; j++) {
+        SymbolTable* ptbl = create_table(SYMTBL_UNIQUE_NAME);
+        InstList pinsts;
+        OutBuf pinter, plog;
+        AsmStats pstats;
+        inst_list_init(&pinsts);
+        outbuf_open_memory(&pinter);
+        outbuf_open_memory(&plog);
+        memset(&pstats, 0, sizeof(pstats));
+        int perr = run_pass_one(src.data, src.len, jobs[j], ptbl, &pinsts, &pinter, &plog,
+            &pstats);
+
+        CU_ASSERT_EQUAL(perr, err);
+        CU_ASSERT(plog.len == log.len && memcmp(plog.data, log.data, log.len) == 0);
+        CU_ASSERT(pinter.len == inter.len && memcmp(pinter.data, inter.data, inter.len) == 0);
+
+        CU_ASSERT_EQUAL(ptbl->len, symtbl->len);
+        int same_symbols = ptbl->len == symtbl->len;
+        for (uint32_t i = 0; same_symbols && i < symtbl->len; i++) {
+            same_symbols = ptbl->tbl[i].addr == symtbl->tbl[i].addr
+                && strcmp(ptbl->tbl[i].name, symtbl->tbl[i].name) == 0;
+        }
+        CU_ASSERT(same_symbols);
+
+        CU_ASSERT_EQUAL(pinsts.len, insts.len);
+        int same_recs = pinsts.len == insts.len;
+        for (uint32_t i = 0; same_recs && i < insts.len; i++) {
+            const InstRecord* a = &insts.recs[i];
+            const InstRecord* b = &pinsts.recs[i];
+            same_recs = a->id == b->id && a->rd == b->rd && a->rs == b->rs && a->rt == b->rt
+                && a->imm == b->imm && a->line == b->line
+                && same_string(a->sym, b->sym) && same_string(a->text, b->text);
+        }
+        CU_ASSERT(same_recs);
+
+        CU_ASSERT_EQUAL(pstats.lines_read[STATS_PASS_ONE], stats.lines_read[STATS_PASS_ONE]);
+        CU_ASSERT_EQUAL(pstats.li_short, stats.li_short);
+        CU_ASSERT_EQUAL(pstats.li_long, stats.li_long);
+        CU_ASSERT_EQUAL(pstats.blt, stats.blt);
+
+        free_table(ptbl);
+        inst_list_free(&pinsts);
+        outbuf_close(&pinter);
+        outbuf_close(&plog);
+    }
+
+    free_table(symtbl);
+    inst_list_free(&insts);
+    outbuf_close(&inter);
+    outbuf_close(&log);
+    outbuf_close(&src);
+}
+
+/* Runs pass two on JOBS threads, or serially if JOBS is 0, over the records
+   in INSTS, or over the intermediate text INTER if INSTS is NULL. Returns
+   the output in FORMAT, of LEN bytes, leaving the result in ERR, what was
+   logged in LOG and the relocations in RELTBL.
+ */
+static char* run_pass_two(const InstList* insts, const OutBuf* inter, int jobs,
+    OutputFormat format, SymbolTable* symtbl, SymbolTable* reltbl, OutBuf* log,
+    AsmStats* stats, size_t* len, int* err) {
+    ObjectWriter obj;
+    object_begin_memory(&obj, format, 0);
+    log->len = 0;
+    OutBuf* previous = capture_log(log);
+    if (insts) {
+        *err = jobs == 0
+            ? pass_two_records(insts, &obj, symtbl, reltbl, stats)
+            : pass_two_records_parallel(insts, &obj, symtbl, reltbl, jobs, stats);
+    } else {
+        FILE* input = fmemopen(inter->data, inter->len, "r");
+        *err = jobs == 0
+            ? pass_two(input, &obj, symtbl, reltbl, stats)
+            : pass_two_parallel(input, &obj, symtbl, reltbl, jobs, stats);
+        fclose(input);
+    }
+    capture_log(previous);
+    object_finish(&obj, symtbl, reltbl);
+    return object_take_memory(&obj, len);
+}
+
+void test_pass_two_parallel() {
+    // more than enough lines and records for every number of jobs below to
+    // get as many chunks as it can use
+    OutBuf src;
+    char line[256];
+    outbuf_open_memory(&src);
+    for (int k = 0; k < 20000; k++) {
+        int n = 0;
+        n += sprintf(line + n, "L%d: addu $t0, $t1, $t2\n", k);
+        n += sprintf(line + n, "j L%d\n", k / 2);
+        n += sprintf(line + n, "jal ext%d\n", k % 13);
+        n += sprintf(line + n, "beq $t0, $0, L%d\n", k > 0 ? k - 1 : 0);
+        n += sprintf(line + n, "li $t0, %d\n", 70000 + k);
+        n += sprintf(line + n, "blt $t0, $t1, L%d\n", k);
+        //out of range once L0 is far enough behind
+        if (k % 97 == 0) n += sprintf(line + n, "bne $t0, $0, L0\n");
+        if (k % 31 == 0) {
+            n += sprintf(line + n, "addu $t0, $t1\n");
+            n += sprintf(line + n, "ori $t0, $t1, 0x10000\n");
+            n += sprintf(line + n, "sll $t0, $t1, 40\n");
+            n += sprintf(line + n, "beq $t0, $0, missing\n");
+        }
+        outbuf_write(&src, line, n);
+    }
+
+    SymbolTable* symtbl = create_table(SYMTBL_UNIQUE_NAME);
+    InstList insts;
+    OutBuf inter, log;
+    inst_list_init(&insts);
+    outbuf_open_memory(&inter);
+    outbuf_open_memory(&log);
+    CU_ASSERT_EQUAL(run_pass_one(src.data, src.len, 0, symtbl, &insts, &inter, &log, NULL), 0);
+
+    for (int format = OUTPUT_TEXT; format <= OUTPUT_BIN; format++) {
+        for (int records = 0; records <= 1; records++) {
+            const InstList* from = records ? &insts : NULL;
+            SymbolTable* reltbl = create_table(SYMTBL_NON_UNIQUE);
+            OutBuf slog;
+            AsmStats stats;
+            size_t len;
+            int err;
+            outbuf_open_memory(&slog);
+            memset(&stats, 0, sizeof(stats));
+            char* out = run_pass_two(from, &inter, 0, format, symtbl, reltbl, &slog, &stats,
+                &len, &err);
+            CU_ASSERT_EQUAL(err, -1);
+            CU_ASSERT(reltbl->len > 20000);
+            CU_ASSERT(slog.len > 0);
+
+            int jobs[] = { 1, 2, 7 };
+            for (int j = 0; j < 3; j++) {
+                SymbolTable* preltbl = create_table(SYMTBL_NON_UNIQUE);
+                OutBuf plog;
+                AsmStats pstats;
+                size_t plen;
+                int perr;
+                outbuf_open_memory(&plog);
+                memset(&pstats, 0, sizeof(pstats));
+                char* pout = run_pass_two(from, &inter, jobs[j], format, symtbl, preltbl,
+                    &plog, &pstats, &plen, &perr);
+
+                CU_ASSERT_EQUAL(perr, err);
+                CU_ASSERT(plen == len && memcmp(pout, out, len) == 0);
+                CU_ASSERT(plog.len == slog.len && memcmp(plog.data, slog.data, slog.len) == 0);
+
+                CU_ASSERT_EQUAL(preltbl->len, reltbl->len);
+                int same_relocations = preltbl->len == reltbl->len;
+                for (uint32_t i = 0; same_relocations && i < reltbl->len; i++) {
+                    same_relocations = preltbl->tbl[i].addr == reltbl->tbl[i].addr
+                        && strcmp(preltbl->tbl[i].name, reltbl->tbl[i].name) == 0;
+                }
+                CU_ASSERT(same_relocations);
+
+                CU_ASSERT_EQUAL(pstats.lines_read[STATS_PASS_TWO],
+                    stats.lines_read[STATS_PASS_TWO]);
+                CU_ASSERT_EQUAL(pstats.lookups, stats.lookups);
+
+                free(pout);
+                outbuf_close(&plog);
+                free_table(preltbl);
+            }
+            free(out);
+            outbuf_close(&slog);
+            free_table(reltbl);
+        }
+    }
+
+    free_table(symtbl);
+    inst_list_free(&insts);
+    outbuf_close(&inter);
+    outbuf_close(&log);
+    outbuf_close(&src);
+}
+
+/****************************************
+ *  Test cases for mipsasm.c
+ ****************************************/
+
+static void collect_diagnostic(void* user, const char* message) {
+    OutBuf* messages = (OutBuf*) user;
+    outbuf_puts(messages, message);
+    outbuf_putc(messages, '|');
+}
+
+void test_assemble_buffer() {
+    const char* src = "addu $t0, $t1, $t2\nloop: li $t0, 0x12345\nj loop\n";
+    const char* expected = ".text\n012a4021\n3c010001\n34282345\n08000000\n"
+        "\n.symbol\n4\tloop\n\n.relocation\n12\tloop\n";
+    char* out;
+    size_t out_len;
+    OutBuf messages;
+
+    MipsAsmContext* ctx = mips_context_create();
+    CU_ASSERT_PTR_NOT_NULL(ctx);
+    outbuf_open_memory(&messages);
+    mips_set_diagnostics(ctx, collect_diagnostic, &messages);
+
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, src, strlen(src), &out, &out_len), 0);
+    CU_ASSERT_EQUAL(out_len, strlen(expected));
+    CU_ASSERT(out && memcmp(out, expected, out_len) == 0);
+    CU_ASSERT_EQUAL(messages.len, 0);
+    free(out);
+
+    //more threads and a binary format
+    CU_ASSERT_EQUAL(mips_set_jobs(ctx, 0), -1);
+    CU_ASSERT_EQUAL(mips_set_jobs(ctx, 3), 0);
+    mips_set_format(ctx, MIPSASM_BIN);
+    mips_set_little_endian(ctx, 1);
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, src, strlen(src), &out, &out_len), 0);
+    CU_ASSERT_EQUAL(out_len, 16);
+    CU_ASSERT(out && memcmp(out, "\x21\x40\x2a\x01", 4) == 0);
+    free(out);
+
+    //errors are reported in the order the command line would log them
+    const char* bad = "addu $t0, $t1\nbad: label: or $t0 $t0 $t0\nblt $t0, $t1, nowhere";
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, bad, strlen(bad), &out, &out_len), -1);
+    CU_ASSERT_PTR_NULL(out);
+    CU_ASSERT_EQUAL(out_len, 0);
+    outbuf_putc(&messages, '\0');
+    CU_ASSERT_STRING_EQUAL(messages.data,
+        "Error - extra argument at line 2: $t0|"
+        "Error - invalid instruction at line 1: addu $t0 $t1|"
+        "Error - invalid instruction at line 3: bne $at $0 nowhere|");
+
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, NULL, 0, &out, &out_len), 0);
+    CU_ASSERT_EQUAL(out_len, 0);
+    free(out);
+
+    //what the command line writes: the intermediate file, and the output of
+    //a source with errors
+    const char* expected_inter = "addu $t0 $t1 $t2\nlui $at 1\nori $t0 $at 9029\nj loop\n";
+    const char* inter;
+    size_t inter_len;
+    mips_set_format(ctx, MIPSASM_TEXT);
+    CU_ASSERT_PTR_NULL(mips_intermediate(ctx, &inter_len));
+    CU_ASSERT_EQUAL(inter_len, 0);
+    mips_set_keep_intermediate(ctx, 1);
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, src, strlen(src), &out, &out_len), 0);
+    inter = mips_intermediate(ctx, &inter_len);
+    CU_ASSERT_EQUAL(inter_len, strlen(expected_inter));
+    CU_ASSERT(inter && memcmp(inter, expected_inter, inter_len) == 0);
+    CU_ASSERT(out && out_len == strlen(expected) && memcmp(out, expected, out_len) == 0);
+    free(out);
+
+    const char* partial = ".text\n0109082a\n\n.symbol\n4\tbad\n\n.relocation\n";
+    mips_set_output_on_error(ctx, 1);
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, bad, strlen(bad), &out, &out_len), -1);
+    CU_ASSERT(out && out_len == strlen(partial) && memcmp(out, partial, out_len) == 0);
+    free(out);
+
+    //the single pass gives the same program, and no intermediate file
+    mips_set_single_pass(ctx, 1);
+    CU_ASSERT_EQUAL(mips_assemble_buffer(ctx, src, strlen(src), &out, &out_len), 0);
+    CU_ASSERT(out && out_len == strlen(expected) && memcmp(out, expected, out_len) == 0);
+    CU_ASSERT_PTR_NULL(mips_intermediate(ctx, &inter_len));
+    CU_ASSERT_EQUAL(inter_len, 0);
+    free(out);
+
+    outbuf_close(&messages);
+    mips_context_free(ctx);
+}
+
+/****************************************
+ *  Test cases for server.c
+ ****************************************/
+
+void test_parse_serve_request() {
+    ServeRequest req;
+    char data[SERVE_HEADER_SIZE + 4];
+
+    memcpy(data, "\0\0\0\4\0\0\0\2\0\0\0\1nop\n", sizeof(data));
+    CU_ASSERT_EQUAL(parse_serve_request(data, 0, &req), 0);
+    CU_ASSERT_EQUAL(parse_serve_request(data, SERVE_HEADER_SIZE - 1, &req), 0);
+    CU_ASSERT_EQUAL(parse_serve_request(data, SERVE_HEADER_SIZE + 3, &req), 0);
+    CU_ASSERT_EQUAL(parse_serve_request(data, sizeof(data), &req), 1);
+    CU_ASSERT_EQUAL(req.source_len, 4);
+    CU_ASSERT_EQUAL(req.format, MIPSASM_ELF);
+    CU_ASSERT_EQUAL(req.flags, SERVE_LITTLE_ENDIAN);
+
+    //unknown formats and flags, and sources that are too big
+    data[7] = 3;
+    CU_ASSERT_EQUAL(parse_serve_request(data, sizeof(data), &req), -1);
+    data[7] = 0;
+    data[11] = 2;
+    CU_ASSERT_EQUAL(parse_serve_request(data, sizeof(data), &req), -1);
+    data[11] = 0;
+    data[0] = 0x10;
+    CU_ASSERT_EQUAL(parse_serve_request(data, SERVE_HEADER_SIZE, &req), -1);
+}
+
+static void* run_server(void* arg) {
+    return (void*) (intptr_t) serve((const char*) arg, 2);
+}
+
+/* Connects to the server on SOCKET_PATH, waiting for it to start listening.
+   Returns the socket, or -1 if the server never started.
+ */
+static int connect_to_server(const char* socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    for (int tries = 0; tries < 500; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+/* Appends to REQUESTS a request for SRC. */
+static void put_serve_request(OutBuf* requests, const char* src, MipsAsmFormat format,
+    uint32_t flags) {
+    uint32_t header[3] = { htonl(strlen(src)), htonl(format), htonl(flags) };
+    outbuf_write(requests, (const char*) header, sizeof(header));
+    outbuf_puts(requests, src);
+}
+
+static int read_exactly(int fd, char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void collect_diagnostic_line(void* user, const char* message) {
+    OutBuf* messages = (OutBuf*) user;
+    outbuf_puts(messages, message);
+    outbuf_putc(messages, '\n');
+}
+
+/* Reads the next response from FD and checks that it is what the library
+   gives for SRC.
+ */
+static void check_serve_response(int fd, const char* src, MipsAsmFormat format,
+    int little_endian) {
+    OutBuf diags;
+    outbuf_open_memory(&diags);
+    MipsAsmContext* ctx = mips_context_create();
+    mips_set_diagnostics(ctx, collect_diagnostic_line, &diags);
+    mips_set_format(ctx, format);
+    mips_set_little_endian(ctx, little_endian);
+    char* out;
+    size_t out_len;
+    int err = mips_assemble_buffer(ctx, src, strlen(src), &out, &out_len);
+
+    uint32_t header[3] = { 0, 0, 0 };
+    CU_ASSERT_EQUAL(read_exactly(fd, (char*) header, sizeof(header)), 0);
+    CU_ASSERT_EQUAL(ntohl(header[0]), err ? SERVE_FAILED : SERVE_OK);
+    CU_ASSERT_EQUAL(ntohl(header[1]), out_len);
+    CU_ASSERT_EQUAL(ntohl(header[2]), diags.len);
+
+    if (ntohl(header[1]) == out_len && ntohl(header[2]) == diags.len) {
+        char* body = (char*) malloc(out_len + diags.len + 1);
+        CU_ASSERT_EQUAL(read_exactly(fd, body, out_len + diags.len), 0);
+        CU_ASSERT(out_len == 0 || memcmp(body, out, out_len) == 0);
+        CU_ASSERT(memcmp(body + out_len, diags.data, diags.len) == 0);
+        free(body);
+    }
+    free(out);
+    mips_context_free(ctx);
+    outbuf_close(&diags);
+}
+
+void test_serve() {
+    const char* good = "addu $t0, $t1, $t2\nloop: li $t0, 0x12345\nj loop\n";
+    const char* bad = "addu $t0, $t1\nbad: label: or $t0 $t0 $t0\nblt $t0, $t1, nowhere";
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/test_serve_%d.sock", (int) getpid());
+
+    pthread_t server;
+    if (pthread_create(&server, NULL, run_server, socket_path) != 0) {
+        CU_FAIL("Could not start the server thread");
+        return;
+    }
+    int fd = connect_to_server(socket_path);
+    CU_ASSERT(fd >= 0);
+
+    //two pipelined requests in one stream, written a few bytes at a time so
+    //that headers and sources arrive split across reads
+    OutBuf requests;
+    outbuf_open_memory(&requests);
+    put_serve_request(&requests, good, MIPSASM_TEXT, 0);
+    put_serve_request(&requests, bad, MIPSASM_BIN, SERVE_LITTLE_ENDIAN);
+    for (size_t at = 0; at < requests.len; at += 7) {
+        size_t piece = requests.len - at < 7 ? requests.len - at : 7;
+        CU_ASSERT_EQUAL(write(fd, requests.data + at, piece), piece);
+        usleep(1000);
+    }
+    outbuf_close(&requests);
+
+    check_serve_response(fd, good, MIPSASM_TEXT, 0);
+    check_serve_response(fd, bad, MIPSASM_BIN, 1);
+    close(fd);
+
+    //serve() blocks SIGTERM on its thread and takes it from its signalfd
+    void* result;
+    pthread_kill(server, SIGTERM);
+    pthread_join(server, &result);
+    CU_ASSERT_EQUAL((intptr_t) result, 0);
+    CU_ASSERT_NOT_EQUAL(access(socket_path, F_OK), 0);
+}
+
+/****************************************
+ *  Test cases for sim.c
+ ****************************************/
+
+/* Assembles SRC in text format and loads the result into M. */
+static int load_program(Machine* m, const char* src) {
+    char* obj;
+    size_t obj_len;
+    MipsAsmContext* ctx = mips_context_create();
+    int err = mips_assemble_buffer(ctx, src, strlen(src), &obj, &obj_len);
+    mips_context_free(ctx);
+    if (err) {
+        return -1;
+    }
+    FILE* input = fmemopen(obj, obj_len, "r");
+    err = sim_load(m, input, 4096);
+    fclose(input);
+    free(obj);
+    return err;
+}
+
+void test_sim_run() {
+    Machine m;
+    const char* src =
+        "li $a0 5\n"
+        "jal sum\n"
+        "addiu $sp $sp -4\n"
+        "sw $v0 0($sp)\n"
+        "lbu $s0 3($sp)\n"
+        "li $t0 -1\n"
+        "sb $t0 0($sp)\n"
+        "lb $s1 0($sp)\n"
+        "sltu $s2 $0 $s1\n"
+        "slt $s3 $s1 $0\n"
+        "j end\n"
+        "sum: addu $v0 $0 $0\n"
+        "loop: addu $v0 $v0 $a0\n"
+        "addiu $a0 $a0 -1\n"
+        "bne $a0 $0 loop\n"
+        "jr $ra\n"
+        "end: sll $0 $s0 1\n";
+
+    CU_ASSERT_EQUAL(load_program(&m, src), 0);
+    CU_ASSERT_EQUAL(m.regs[29], 4096);
+    CU_ASSERT_EQUAL(sim_run(&m, 0), SIM_HALTED);
+    CU_ASSERT_EQUAL(m.pc, 4 * m.num_words);
+    CU_ASSERT_EQUAL(m.steps, 29);
+    CU_ASSERT_EQUAL(m.regs[0], 0);
+    CU_ASSERT_EQUAL(m.regs[2], 15);             //$v0
+    CU_ASSERT_EQUAL(m.regs[16], 15);            //$s0
+    CU_ASSERT_EQUAL(m.regs[17], 0xffffffff);    //$s1
+    CU_ASSERT_EQUAL(m.regs[18], 1);             //$s2
+    CU_ASSERT_EQUAL(m.regs[19], 1);             //$s3
+    CU_ASSERT_EQUAL(m.regs[31], 8);             //$ra
+    sim_free(&m);
+
+    //a loop that never ends stops at the limit, and can be resumed
+    CU_ASSERT_EQUAL(load_program(&m, "loop: addiu $t0 $t0 1\nj loop\n"), 0);
+    CU_ASSERT_EQUAL(sim_run(&m, 1000), SIM_STEP_LIMIT);
+    CU_ASSERT_EQUAL(m.steps, 1000);
+    CU_ASSERT_EQUAL(m.regs[8], 500);
+    CU_ASSERT_EQUAL(sim_run(&m, 10), SIM_STEP_LIMIT);
+    CU_ASSERT_EQUAL(m.regs[8], 505);
+    sim_free(&m);
+
+    //code is read-only, and memory ends where $sp starts
+    CU_ASSERT_EQUAL(load_program(&m, "lw $t0 0($0)\nsw $t0 4($0)\n"), 0);
+    CU_ASSERT_EQUAL(sim_run(&m, 0), SIM_FAULT);
+    CU_ASSERT_EQUAL(m.pc, 4);
+    CU_ASSERT_EQUAL(m.regs[8], 0x8c080000);
+    sim_free(&m);
+    CU_ASSERT_EQUAL(load_program(&m, "lw $t0 0($sp)\n"), 0);
+    CU_ASSERT_EQUAL(sim_run(&m, 0), SIM_FAULT);
+    sim_free(&m);
+
+    CU_ASSERT_EQUAL(load_program(&m, "j nowhere\n"), -1);
+}
+
+/* Loads the single word WORD into M, as the text output of the assembler. */
+static int load_word(Machine* m, uint32_t word) {
+    char obj[64];
+    int len = sprintf(obj, ".text\n%08x\n\n.symbol\n\n.relocation\n", word);
+    FILE* input = fmemopen(obj, len, "r");
+    int err = sim_load(m, input, 4096);
+    fclose(input);
+    return err;
+}
+
+void test_sim_illegal() {
+    // each word runs, but not with any of the bits that must be 0 set
+    struct { uint32_t word, zero_bits; } cases[] = {
+        { 0x012a4021, 0x40 },           // addu $t0 $t1 $t2, shamt
+        { 0x012a4025, 0x400 },          // or, shamt
+        { 0x012a402a, 0x80 },           // slt, shamt
+        { 0x012a402b, 0x7c0 },          // sltu, shamt
+        { 0x00094080, 0x00200000 },     // sll $t0 $t1 2, rs
+        { 0x00094080, 0x03e00000 },
+        { 0x03e00008, 0x00010000 },     // jr $ra, rt
+        { 0x03e00008, 0x00000800 },     // rd
+        { 0x03e00008, 0x00000040 },     // shamt
+        { 0x3c080001, 0x00200000 },     // lui $t0 1, rs
+    };
+    Machine m;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        CU_ASSERT_EQUAL(load_word(&m, cases[i].word), 0);
+        CU_ASSERT_EQUAL(sim_run(&m, 0), SIM_HALTED);
+        sim_free(&m);
+
+        CU_ASSERT_EQUAL(load_word(&m, cases[i].word | cases[i].zero_bits), 0);
+        CU_ASSERT_EQUAL(sim_run(&m, 0), SIM_FAULT);
+        CU_ASSERT_EQUAL(m.pc, 0);
+        CU_ASSERT_EQUAL(m.steps, 0);
+        sim_free(&m);
+    }
+}
+
+/****************************************
+ *  Test cases for trace.c
+ ****************************************/
+
+static const char* json_skip_space(const char* p) {
+    while (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r') p++;
+    return p;
+}
+
+/* Returns the end of the JSON value at the start of P, or NULL if there is
+   no well-formed value there.
+ */
+static const char* json_value(const char* p) {
+    p = json_skip_space(p);
+    if (*p == '{' || *p == '[') {
+        char close = *p == '{' ? '}' : ']';
+        p = json_skip_space(p + 1);
+        if (*p == close) return p + 1;
+        while (1) {
+            if (close == '}') {
+                if (*p != '"' || !(p = json_value(p))) return NULL;
+                p = json_skip_space(p);
+                if (*p++ != ':') return NULL;
+            }
+            if (!(p = json_value(p))) return NULL;
+            p = json_skip_space(p);
+            if (*p == close) return p + 1;
+            if (*p++ != ',') return NULL;
+            p = json_skip_space(p);
+        }
+    }
+    if (*p == '"') {
+        for (p++; *p != '"'; p++) {
+            if ((unsigned char) *p < 0x20) return NULL;
+            if (*p == '\\') {
+                p++;
+                if (*p == 'u') {
+                    for (int i = 1; i <= 4; i++) {
+                        if (!isxdigit((unsigned char) p[i])) return NULL;
+                    }
+                    p += 4;
+                } else if (!strchr("\"\\/bfnrt", *p) || *p == '\0') {
+                    return NULL;
+                }
+            }
+        }
+        return p + 1;
+    }
+    if (strncmp(p, "true", 4) == 0 || strncmp(p, "null", 4) == 0) return p + 4;
+    if (strncmp(p, "false", 5) == 0) return p + 5;
+
+    const char* start = p;
+    if (*p == '-') p++;
+    if (!isdigit((unsigned char) *p)) return NULL;
+    while (isdigit((unsigned char) *p)) p++;
+    if (*p == '.') {
+        if (!isdigit((unsigned char) *++p)) return NULL;
+        while (isdigit((unsigned char) *p)) p++;
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        if (*p == '+' || *p == '-') p++;
+        if (!isdigit((unsigned char) *p)) return NULL;
+        while (isdigit((unsigned char) *p)) p++;
+    }
+    return p > start ? p : NULL;
+}
+
+#define TRACE_MAX_TIDS 64
+#define TRACE_MAX_DEPTH 16
+
+void test_trace() {
+    const char* in_name = "test_trace.s";
+    const char* out_name = "test_trace.out";
+    const char* trace_name = "test_trace.json";
+
+    // big enough for both passes to be split between several threads
+    FILE* f = fopen(in_name, "w");
+    for (int k = 0; k < 20000; k++) {
+        fprintf(f, "L%d: addu $t0, $t1, $t2\nli $t0, %d\nbeq $t0, $0, L%d\n", k, 70000 + k, k);
+    }
+    fclose(f);
+
+    AsmOptions opts = { OUTPUT_TEXT, 0, 4 };
+    trace_start();
+    CU_ASSERT_EQUAL(assemble(in_name, NULL, out_name, &opts, NULL), 0);
+    CU_ASSERT_EQUAL(trace_finish(trace_name), 0);
+
+    f = fopen(trace_name, "r");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    rewind(f);
+    char* text = (char*) malloc(size + 1);
+    CU_ASSERT_EQUAL(fread(text, 1, size, f), (size_t) size);
+    text[size] = '\0';
+    fclose(f);
+
+    const char* end = json_value(text);
+    CU_ASSERT_PTR_NOT_NULL(end);
+    if (end) {
+        CU_ASSERT_EQUAL(*json_skip_space(end), '\0');
+    }
+
+    // one event per line after the first: every E closes the latest B of
+    // its thread, and every thread that logged events is named once
+    char stacks[TRACE_MAX_TIDS][TRACE_MAX_DEPTH][64];
+    int depth[TRACE_MAX_TIDS] = { 0 };
+    int named[TRACE_MAX_TIDS] = { 0 };
+    int logged[TRACE_MAX_TIDS] = { 0 };
+    int balanced = 1, num_events = 0;
+    for (char* line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        char name[64], phase;
+        unsigned tid;
+        const char* ph = strstr(line, "\"ph\": \"");
+        const char* tid_field = strstr(line, "\"tid\": ");
+        if (sscanf(line, "{\"name\": \"%63[^\"]\"", name) != 1 || !ph || !tid_field) {
+            continue;
+        }
+        phase = ph[7];
+        tid = strtoul(tid_field + 7, NULL, 10);
+        CU_ASSERT(tid > 0 && tid < TRACE_MAX_TIDS);
+        if (tid == 0 || tid >= TRACE_MAX_TIDS) break;
+
+        if (phase == 'M') {
+            CU_ASSERT_STRING_EQUAL(name, "thread_name");
+            named[tid] += 1;
+        } else if (phase == 'B') {
+            logged[tid] = 1;
+            num_events += 1;
+            CU_ASSERT(depth[tid] < TRACE_MAX_DEPTH);
+            if (depth[tid] < TRACE_MAX_DEPTH) strcpy(stacks[tid][depth[tid]++], name);
+        } else if (phase == 'E') {
+            logged[tid] = 1;
+            num_events += 1;
+            if (depth[tid] == 0 || strcmp(stacks[tid][--depth[tid]], name) != 0) {
+                balanced = 0;
+            }
+        } else {
+            balanced = 0;
+        }
+    }
+    CU_ASSERT(balanced);
+    CU_ASSERT(num_events > 0);
+    int threads = 0;
+    for (int tid = 0; tid < TRACE_MAX_TIDS; tid++) {
+        CU_ASSERT_EQUAL(depth[tid], 0);
+        CU_ASSERT_EQUAL(named[tid], logged[tid]);
+        threads += logged[tid];
+    }
+    CU_ASSERT(threads > 1);
+
+    free(text);
+    remove(in_name);
+    remove(out_name);
+    remove(trace_name);
+}
+
+int main(int argc, char** argv) {
+    CU_pSuite pSuite1 = NULL, pSuite2 = NULL, pSuite3 = NULL, pSuite4 = NULL;
+    CU_pSuite pSuite5 = NULL, pSuite6 = NULL, pSuite7 = NULL, pSuite8 = NULL;
+    CU_pSuite pSuite9 = NULL, pSuite10 = NULL, pSuite11 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    /* Suite 1 */
+    pSuite1 = CU_add_suite("Testing translate_utils.c", NULL, NULL);
+    if (!pSuite1) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite1, "test_translate_reg", test_translate_reg)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite1, "test_translate_num", test_translate_num)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite1, "test_reader", test_reader)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite1, "test_scan_tokens", test_scan_tokens)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite1, "test_write_inst_hex_n", test_write_inst_hex_n)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite1, "test_outbuf", test_outbuf)) {
+        goto exit;
+    }
+
+    /* Suite 2 */
+    pSuite2 = CU_add_suite("Testing tables.c", init_log_file, close_log);
+    if (!pSuite2) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_table_1", test_table_1)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_table_2", test_table_2)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_table_3", test_table_3)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_reset_table", test_reset_table)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite2, "test_index_for_symbol", test_index_for_symbol)) {
+        goto exit;
+    }
+
+    /* Suite 3 */
+    pSuite3 = CU_add_suite("Testing li and blt expansion", NULL, NULL);
+    if (!pSuite3) {
+      goto exit;
+    }
+    if (!CU_add_test(pSuite3, "test_li_expansion", test_li_expansion)) {
+        goto exit;
+    }   
+    if (!CU_add_test(pSuite3, "test_blt_expansion", test_blt_expansion)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite3, "test_plan_expansion", test_plan_expansion)) {
+        goto exit;
+    }
+
+    /* Suite 4 */
+    pSuite4 = CU_add_suite("Testing step 3", NULL, NULL);
+    if (!pSuite4) {
+      goto exit;
+    }
+    if (!CU_add_test(pSuite4, "test_lookup_inst", test_lookup_inst)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite4, "test_translate_inst", test_translate_inst)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite4, "test_inst_records", test_inst_records)) {
+        goto exit;
+    }   
+
+    /* Suite 5 */
+    pSuite5 = CU_add_suite("Testing pool.c", NULL, NULL);
+    if (!pSuite5) {
+      goto exit;
+    }
+    if (!CU_add_test(pSuite5, "test_run_tasks", test_run_tasks)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite5, "test_run_worker_tasks", test_run_worker_tasks)) {
+        goto exit;
+    }
+
+    /* Suite 6 */
+    pSuite6 = CU_add_suite("Testing state.c", NULL, NULL);
+    if (!pSuite6) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite6, "test_state_file", test_state_file)) {
+        goto exit;
+    }
+
+    /* Suite 7 */
+    pSuite7 = CU_add_suite("Testing mipsasm.c", NULL, NULL);
+    if (!pSuite7) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite7, "test_assemble_buffer", test_assemble_buffer)) {
+        goto exit;
+    }
+
+    /* Suite 8 */
+    pSuite8 = CU_add_suite("Testing server.c", NULL, NULL);
+    if (!pSuite8) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite8, "test_parse_serve_request", test_parse_serve_request)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite8, "test_serve", test_serve)) {
+        goto exit;
+    }
+
+    /* Suite 9 */
+    pSuite9 = CU_add_suite("Testing sim.c", init_log_file, close_log);
+    if (!pSuite9) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite9, "test_sim_run", test_sim_run)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite9, "test_sim_illegal", test_sim_illegal)) {
+        goto exit;
+    }
+
+    /* Suite 10 */
+    pSuite10 = CU_add_suite("Testing assembler.c", NULL, NULL);
+    if (!pSuite10) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite10, "test_single_pass", test_single_pass)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite10, "test_object_formats", test_object_formats)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite10, "test_assemble_stats", test_assemble_stats)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite10, "test_assemble_incremental", test_assemble_incremental)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite10, "test_pass_one_parallel", test_pass_one_parallel)) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite10, "test_pass_two_parallel", test_pass_two_parallel)) {
+        goto exit;
+    }
+
+    /* Suite 11 */
+    pSuite11 = CU_add_suite("Testing trace.c", NULL, NULL);
+    if (!pSuite11) {
+        goto exit;
+    }
+    if (!CU_add_test(pSuite11, "test_trace", test_trace)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+exit:
+    CU_cleanup_registry();
+    return CU_get_error();;
+}